@@ -12,12 +12,17 @@ namespace hardware {
 namespace biometrics {
 namespace fingerprint {
 
-CancellationSignal::CancellationSignal(Session* session)
-    : mSession(session) {
+CancellationSignal::CancellationSignal(std::weak_ptr<Session> session, int64_t operationId)
+    : mSession(std::move(session)), mOperationId(operationId) {
 }
 
 ndk::ScopedAStatus CancellationSignal::cancel() {
-    return mSession->cancel();
+    auto session = mSession.lock();
+    if (!session) {
+        ALOGW("cancel: session is already gone");
+        return ndk::ScopedAStatus::ok();
+    }
+    return session->cancel(mOperationId);
 }
 
 } // namespace fingerprint
@@ -20,11 +20,14 @@ namespace fingerprint {
 
 class CancellationSignal : public BnCancellationSignal {
 public:
-    CancellationSignal(Session* session);
+    CancellationSignal(std::weak_ptr<Session> session, int64_t operationId);
     ndk::ScopedAStatus cancel() override;
 
 private:
-    Session* mSession;
+    // The framework may hold on to the signal after the session is gone
+    std::weak_ptr<Session> mSession;
+    // Cancels only this operation, not whatever the session runs by then
+    int64_t mOperationId;
 };
 
 } // namespace fingerprint
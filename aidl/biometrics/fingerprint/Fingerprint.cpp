@@ -8,9 +8,15 @@
 #include <android-base/logging.h>
 #include <cutils/properties.h>
 
+#include <cinttypes>
 #include <cstdlib>
+#include <cstring>
+#include <limits>
 
 #include "Fingerprint.h"
+#include "FingerprintMetrics.h"
+#include "FingerprintTrace.h"
+#include "MessageCapture.h"
 
 namespace aidl {
 namespace android {
@@ -19,73 +25,202 @@ namespace biometrics {
 namespace fingerprint {
 
 namespace {
-constexpr int SENSOR_ID = 0;
+constexpr size_t WORKER_QUEUE_SIZE = 16;
+
+// Defaults for the ro.vendor.fingerprint.* properties
 constexpr common::SensorStrength SENSOR_STRENGTH = common::SensorStrength::STRONG;
 constexpr int MAX_ENROLLMENTS_PER_USER = 7;
 constexpr bool SUPPORTS_NAVIGATION_GESTURES = false;
 constexpr char HW_COMPONENT_ID[] = "fingerprintSensor";
 constexpr char HW_VERSION[] = "vendor/model/revision";
-constexpr char FW_VERSION[] = "1.01";
 constexpr char SERIAL_NUMBER[] = "00000001";
 constexpr char SW_COMPONENT_ID[] = "matchingAlgorithm";
 constexpr char SW_VERSION[] = "vendor/version/revision";
 
-}  // namespace
+constexpr char kConfigPropPrefix[] = "ro.vendor.fingerprint.";
 
-Fingerprint::Fingerprint()
-    : mEngine(makeFingerprintEngine()),
-      mMaxEnrollmentsPerUser(MAX_ENROLLMENTS_PER_USER),
-      mSupportsGestures(SUPPORTS_NAVIGATION_GESTURES) {}
+std::string getConfigString(const char* name, const char* defaultValue) {
+    char value[PROPERTY_VALUE_MAX];
+    property_get((std::string(kConfigPropPrefix) + name).c_str(), value, defaultValue);
+    return value;
+}
 
-Fingerprint::~Fingerprint() {
-    ALOGV("~Fingerprint()");
+int64_t getConfigInt(const char* name, int64_t defaultValue) {
+    return property_get_int64((std::string(kConfigPropPrefix) + name).c_str(), defaultValue);
 }
 
-ndk::ScopedAStatus Fingerprint::getSensorProps(std::vector<SensorProps>* out) {
-    std::vector<common::ComponentInfo> componentInfo = {
-            {HW_COMPONENT_ID, HW_VERSION, FW_VERSION, SERIAL_NUMBER, "" /* softwareVersion */},
-            {SW_COMPONENT_ID, "" /* hardwareVersion */, "" /* firmwareVersion */,
-            "" /* serialNumber */, SW_VERSION}};
-    common::CommonProps commonProps = {SENSOR_ID, SENSOR_STRENGTH,
-                                       mMaxEnrollmentsPerUser, componentInfo};
+// Counts and durations, where 0 or less would disable the feature they configure
+int64_t getPositiveConfigInt(const char* name, int64_t defaultValue) {
+    int64_t value = getConfigInt(name, defaultValue);
+    if (value <= 0 || value > std::numeric_limits<int32_t>::max()) {
+        ALOGE("Invalid %s %" PRId64 ", using default %" PRId64, name, value, defaultValue);
+        return defaultValue;
+    }
+    return value;
+}
 
-    SensorLocation sensorLocation;
+}  // namespace
 
-    sensorLocation.sensorLocationX = mEngine->getCenterPositionX();
-    sensorLocation.sensorLocationY = mEngine->getCenterPositionY();
-    sensorLocation.sensorRadius = mEngine->getCenterPositionR();
+// Weak so that devices providing only makeFingerprintEngines() still link
+__attribute__((weak)) std::shared_ptr<FingerprintEngine> makeFingerprintEngine();
 
-    FingerprintSensorType sensorType = mEngine->getSensorType();
+__attribute__((weak)) std::vector<std::shared_ptr<FingerprintEngine>> makeFingerprintEngines() {
+    CHECK(makeFingerprintEngine) << "No makeFingerprintEngine() or makeFingerprintEngines()";
+    return {makeFingerprintEngine()};
+}
 
-    ALOGI("Sensor type: %s, location: %s", ::android::internal::ToString(sensorType).c_str(), sensorLocation.toString().c_str());
+Fingerprint::Config Fingerprint::loadConfig() {
+    Config config;
+    int64_t strength = getConfigInt("strength", static_cast<int64_t>(SENSOR_STRENGTH));
+    if (strength < static_cast<int64_t>(common::SensorStrength::CONVENIENCE) ||
+        strength > static_cast<int64_t>(common::SensorStrength::STRONG)) {
+        ALOGE("Invalid sensor strength %" PRId64 ", using default", strength);
+        strength = static_cast<int64_t>(SENSOR_STRENGTH);
+    }
+    config.strength = static_cast<common::SensorStrength>(strength);
+    config.maxEnrollmentsPerUser =
+            getPositiveConfigInt("max_enrollments", MAX_ENROLLMENTS_PER_USER);
+    config.supportsNavigationGestures =
+            getConfigInt("navigation_gestures", SUPPORTS_NAVIGATION_GESTURES) != 0;
+    config.hwComponentId = getConfigString("hw_component_id", HW_COMPONENT_ID);
+    config.hwVersion = getConfigString("hw_version", HW_VERSION);
+    config.fwVersion = getConfigString("fw_version", "");
+    config.serialNumber = getConfigString("serial_number", SERIAL_NUMBER);
+    config.swComponentId = getConfigString("sw_component_id", SW_COMPONENT_ID);
+    config.swVersion = getConfigString("sw_version", SW_VERSION);
+    config.lockout.timedThreshold =
+            getPositiveConfigInt("lockout.timed_threshold", config.lockout.timedThreshold);
+    config.lockout.timedDurationMs =
+            getPositiveConfigInt("lockout.timed_duration_ms", config.lockout.timedDurationMs);
+    config.lockout.permanentThreshold =
+            getPositiveConfigInt("lockout.permanent_threshold", config.lockout.permanentThreshold);
+    return config;
+}
 
-    *out = {{commonProps,
-             sensorType,
-             {sensorLocation},
-             mSupportsGestures,
-             false,
-             false,
-             false,
-             std::nullopt}};
+Fingerprint::Fingerprint() : mConfig(loadConfig()) {
+    for (auto& engine : makeFingerprintEngines()) {
+        engine->start();
+        mSensors.push_back({engine, std::make_shared<WorkerThread>(WORKER_QUEUE_SIZE), nullptr,
+                            LockoutTracker(mConfig.lockout)});
+    }
+    CHECK(!mSensors.empty()) << "No fingerprint engine";
+}
 
+Fingerprint::~Fingerprint() {
+    ALOGV("~Fingerprint()");
+}
+
+void Fingerprint::buildSensorProps() {
+    for (int32_t sensorId = 0; sensorId < static_cast<int32_t>(mSensors.size()); sensorId++) {
+        const auto& engine = mSensors[sensorId].engine;
+        std::string fwVersion =
+                mConfig.fwVersion.empty() ? engine->getFirmwareVersion() : mConfig.fwVersion;
+        std::vector<common::ComponentInfo> componentInfo = {
+                {mConfig.hwComponentId, mConfig.hwVersion, fwVersion, mConfig.serialNumber,
+                 "" /* softwareVersion */},
+                {mConfig.swComponentId, "" /* hardwareVersion */, "" /* firmwareVersion */,
+                 "" /* serialNumber */, mConfig.swVersion}};
+        common::CommonProps commonProps = {sensorId, mConfig.strength,
+                                           mConfig.maxEnrollmentsPerUser, componentInfo};
+
+        SensorLocation sensorLocation;
+
+        sensorLocation.sensorLocationX = engine->getCenterPositionX();
+        sensorLocation.sensorLocationY = engine->getCenterPositionY();
+        sensorLocation.sensorRadius = engine->getCenterPositionR();
+
+        FingerprintSensorType sensorType = engine->getSensorType();
+
+        ALOGI("Sensor %d type: %s, location: %s, firmware: %s", sensorId,
+              ::android::internal::ToString(sensorType).c_str(), sensorLocation.toString().c_str(),
+              fwVersion.c_str());
+
+        mSensorProps.push_back({commonProps,
+                                sensorType,
+                                {sensorLocation},
+                                mConfig.supportsNavigationGestures,
+                                false,
+                                false,
+                                false,
+                                std::nullopt});
+    }
+}
+
+ndk::ScopedAStatus Fingerprint::getSensorProps(std::vector<SensorProps>* out) {
+    std::call_once(mSensorPropsOnce, [this] { buildSensorProps(); });
+    *out = mSensorProps;
     return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Fingerprint::createSession(int32_t /*sensorId*/, int32_t userId,
+ndk::ScopedAStatus Fingerprint::createSession(int32_t sensorId, int32_t userId,
                                               const std::shared_ptr<ISessionCallback>& cb,
                                               std::shared_ptr<ISession>* out) {
-    CHECK(mSession == nullptr || mSession->isClosed()) << "Open session already exists!";
+    if (sensorId < 0 || sensorId >= static_cast<int32_t>(mSensors.size())) {
+        ALOGE("createSession: invalid sensor id %d", sensorId);
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    Sensor& sensor = mSensors[sensorId];
+    CHECK(sensor.session == nullptr || sensor.session->isClosed())
+            << "Open session already exists for sensor " << sensorId << "!";
 
-    mSession = SharedRefBase::make<Session>(mEngine, cb, mLockoutTracker);
-    mEngine->setSession(mSession);
-    mEngine->setActiveGroup(userId);
-    *out = mSession;
+    sensor.session = SharedRefBase::make<Session>(sensor.engine, sensor.worker, cb,
+                                                  sensor.lockoutTracker);
+    sensor.engine->setSession(sensor.session);
+    sensor.worker->schedule(Callable::from([engine = sensor.engine, userId] {
+        engine->setActiveGroup(userId);
+    }));
+    *out = sensor.session;
 
-    mSession->linkToDeath(cb->asBinder().get());
+    sensor.session->linkToDeath(cb->asBinder().get());
 
     return ndk::ScopedAStatus::ok();
 }
 
+binder_status_t Fingerprint::dump(int fd, const char** args, uint32_t numArgs) {
+    FingerprintTrace& trace = FingerprintTrace::get();
+
+    for (uint32_t i = 0; i < numArgs; i++) {
+        if (!strcmp(args[i], "--trace")) {
+            trace.dumpSystrace(fd);
+            return STATUS_OK;
+        } else if (!strcmp(args[i], "--capture")) {
+            // Binary, redirect it to a file for fingerprint-replay.nubia
+            MessageCapture::get().dump(fd);
+            return STATUS_OK;
+        } else if (!strcmp(args[i], "--capture-on")) {
+            MessageCapture::get().start();
+        } else if (!strcmp(args[i], "--capture-off")) {
+            MessageCapture::get().stop();
+        } else if (!strcmp(args[i], "--metrics-json")) {
+            FingerprintMetrics::get().dumpJson(fd);
+            return STATUS_OK;
+        } else if (!strcmp(args[i], "--trace-on")) {
+            trace.setEnabled(true);
+        } else if (!strcmp(args[i], "--trace-off")) {
+            trace.setEnabled(false);
+        } else {
+            dprintf(fd,
+                    "usage: dumpsys %s/default [--trace | --metrics-json | --capture | "
+                    "--trace-on | --trace-off | --capture-on | --capture-off]\n",
+                    descriptor);
+            return STATUS_BAD_VALUE;
+        }
+    }
+
+    for (size_t sensorId = 0; sensorId < mSensors.size(); sensorId++) {
+        dprintf(fd, "Sensor %zu:\n", sensorId);
+        mSensors[sensorId].engine->dump(fd);
+        mSensors[sensorId].engine->udfps().dump(fd);
+        if (mSensors[sensorId].session) {
+            mSensors[sensorId].session->dump(fd);
+        }
+    }
+    FingerprintMetrics::get().dump(fd);
+    trace.dumpAttempts(fd);
+    return STATUS_OK;
+}
+
 } // namespace fingerprint
 } // namespace biometrics
 } // namespace hardware
@@ -9,6 +9,9 @@
 
 #include <aidl/android/hardware/biometrics/fingerprint/BnFingerprint.h>
 
+#include <mutex>
+#include <string>
+
 #include <LockoutTracker.h>
 #include <FingerprintEngine.h>
 #include <Session.h>
@@ -33,14 +36,40 @@ public:
     ndk::ScopedAStatus createSession(int32_t sensorId, int32_t userId,
                                      const std::shared_ptr<ISessionCallback>& cb,
                                      std::shared_ptr<ISession>* out) override;
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
 
 private:
-    std::shared_ptr<Session> mSession;
-    LockoutTracker mLockoutTracker;
-    int mMaxEnrollmentsPerUser;
-    bool mSupportsGestures;
+    struct Sensor {
+        std::shared_ptr<FingerprintEngine> engine;
+        std::shared_ptr<WorkerThread> worker;
+        std::shared_ptr<Session> session;
+        LockoutTracker lockoutTracker;
+    };
+
+    // Read once from ro.vendor.fingerprint.* at startup
+    struct Config {
+        common::SensorStrength strength;
+        int32_t maxEnrollmentsPerUser;
+        bool supportsNavigationGestures;
+        std::string hwComponentId;
+        std::string hwVersion;
+        // Empty to report the version of the vendor module
+        std::string fwVersion;
+        std::string serialNumber;
+        std::string swComponentId;
+        std::string swVersion;
+        LockoutConfig lockout;
+    };
+
+    static Config loadConfig();
+    void buildSensorProps();
 
-    std::shared_ptr<FingerprintEngine> mEngine;
+    const Config mConfig;
+    // Indexed by sensor id
+    std::vector<Sensor> mSensors;
+    // Built on the first getSensorProps call and never changed afterwards
+    std::once_flag mSensorPropsOnce;
+    std::vector<SensorProps> mSensorProps;
 };
 
 } // namespace fingerprint
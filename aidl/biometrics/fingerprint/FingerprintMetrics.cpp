@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <FingerprintMetrics.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <iterator>
+#include <string>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+constexpr const char* kCounterNames[] = {
+        "authenticate", "authentication_succeeded", "authentication_failed", "lockout_timed",
+        "lockout_permanent", "cancel", "enrollment_step",
+};
+static_assert(std::size(kCounterNames) == static_cast<size_t>(FingerprintMetrics::Counter::COUNT));
+
+constexpr const char* kLatencyNames[] = {
+        "generate_challenge", "revoke_challenge", "enroll", "authenticate",
+        "detect_interaction", "enumerate_enrollments", "remove_enrollments",
+        "get_authenticator_id", "invalidate_authenticator_id", "pointer_down", "pointer_up",
+        "ui_ready", "context_changed", "cancel", "notify_error", "notify_acquired",
+        "notify_enrolling", "notify_removed", "notify_authenticated", "notify_enumerating",
+};
+static_assert(std::size(kLatencyNames) == static_cast<size_t>(FingerprintMetrics::Latency::COUNT));
+}  // namespace
+
+FingerprintMetrics& FingerprintMetrics::get() {
+    static FingerprintMetrics sInstance;
+    return sInstance;
+}
+
+FingerprintMetrics::Shard& FingerprintMetrics::shard() {
+    // Threads are spread over the shards in the order they first record something
+    thread_local size_t sIndex = mNextShard.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return mShards[sIndex];
+}
+
+void FingerprintMetrics::error(Error error, int32_t vendorCode) {
+    Shard& s = shard();
+    size_t index = std::min(static_cast<size_t>(error), kErrors - 1);
+    s.errors[index].fetch_add(1, std::memory_order_relaxed);
+    if (error == Error::VENDOR) {
+        size_t vendorIndex = vendorCode >= 0 && vendorCode < kVendorErrors
+                                     ? static_cast<size_t>(vendorCode)
+                                     : static_cast<size_t>(kVendorErrors);
+        s.vendorErrors[vendorIndex].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void FingerprintMetrics::recordLatency(Latency latency, int64_t durationNs) {
+    uint64_t us = static_cast<uint64_t>(std::max<int64_t>(durationNs, 0)) / 1000;
+    size_t bucket = std::min<size_t>(std::bit_width(us), kBuckets - 1);
+
+    Histogram& histogram = shard().latencies[static_cast<size_t>(latency)];
+    histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    histogram.totalUs.fetch_add(us, std::memory_order_relaxed);
+    // Threads sharing the shard race on the max
+    uint64_t maxUs = histogram.maxUs.load(std::memory_order_relaxed);
+    while (us > maxUs &&
+           !histogram.maxUs.compare_exchange_weak(maxUs, us, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t FingerprintMetrics::HistogramSnapshot::percentileUs(uint32_t percentile) const {
+    uint64_t target = (count * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+        seen += buckets[i];
+        if (seen >= target && seen > 0) {
+            // The open ended bucket is only bounded by the max
+            return i + 1 < kBuckets ? std::min<uint64_t>(1ULL << i, maxUs) : maxUs;
+        }
+    }
+    return 0;
+}
+
+FingerprintMetrics::Snapshot FingerprintMetrics::snapshot() const {
+    Snapshot result;
+    for (const Shard& s : mShards) {
+        for (size_t i = 0; i < kCounters; i++) {
+            result.counters[i] += s.counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < kErrors; i++) {
+            result.errors[i] += s.errors[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i <= kVendorErrors; i++) {
+            result.vendorErrors[i] += s.vendorErrors[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < kLatencies; i++) {
+            const Histogram& histogram = s.latencies[i];
+            HistogramSnapshot& out = result.latencies[i];
+            for (size_t b = 0; b < kBuckets; b++) {
+                uint64_t count = histogram.buckets[b].load(std::memory_order_relaxed);
+                out.buckets[b] += count;
+                out.count += count;
+            }
+            out.totalUs += histogram.totalUs.load(std::memory_order_relaxed);
+            out.maxUs = std::max(out.maxUs, histogram.maxUs.load(std::memory_order_relaxed));
+        }
+    }
+    return result;
+}
+
+void FingerprintMetrics::dump(int fd) {
+    Snapshot s = snapshot();
+
+    dprintf(fd, "Metrics:\n ");
+    for (size_t i = 0; i < kCounters; i++) {
+        dprintf(fd, " %s=%" PRIu64, kCounterNames[i], s.counters[i]);
+    }
+    dprintf(fd, "\n  errors:");
+    for (size_t i = 0; i < kErrors; i++) {
+        if (s.errors[i] == 0) continue;
+        dprintf(fd, " %s=%" PRIu64, toString(static_cast<Error>(i)).c_str(), s.errors[i]);
+    }
+    for (int32_t code = 0; code <= kVendorErrors; code++) {
+        if (s.vendorErrors[code] == 0) continue;
+        if (code == kVendorErrors) {
+            dprintf(fd, " vendor+other=%" PRIu64, s.vendorErrors[code]);
+        } else {
+            dprintf(fd, " vendor+%d=%" PRIu64, code, s.vendorErrors[code]);
+        }
+    }
+    dprintf(fd, "\n  latency (ms):\n");
+    for (size_t i = 0; i < kLatencies; i++) {
+        const HistogramSnapshot& h = s.latencies[i];
+        if (h.count == 0) continue;
+        dprintf(fd, "    %s: n=%" PRIu64 " avg %.2f, p50 <=%.2f, p90 <=%.2f, p99 <=%.2f, max %.2f\n",
+                kLatencyNames[i], h.count, h.totalUs / 1000.0 / h.count,
+                h.percentileUs(50) / 1000.0, h.percentileUs(90) / 1000.0,
+                h.percentileUs(99) / 1000.0, h.maxUs / 1000.0);
+    }
+}
+
+void FingerprintMetrics::dumpJson(int fd) {
+    Snapshot s = snapshot();
+
+    dprintf(fd, "{\"counters\":{");
+    for (size_t i = 0; i < kCounters; i++) {
+        dprintf(fd, "%s\"%s\":%" PRIu64, i ? "," : "", kCounterNames[i], s.counters[i]);
+    }
+    dprintf(fd, "},\"errors\":{");
+    const char* separator = "";
+    for (size_t i = 0; i < kErrors; i++) {
+        if (s.errors[i] == 0) continue;
+        dprintf(fd, "%s\"%s\":%" PRIu64, separator, toString(static_cast<Error>(i)).c_str(),
+                s.errors[i]);
+        separator = ",";
+    }
+    dprintf(fd, "},\"vendor_errors\":{");
+    separator = "";
+    for (int32_t code = 0; code <= kVendorErrors; code++) {
+        if (s.vendorErrors[code] == 0) continue;
+        std::string name = code == kVendorErrors ? "other" : std::to_string(code);
+        dprintf(fd, "%s\"%s\":%" PRIu64, separator, name.c_str(), s.vendorErrors[code]);
+        separator = ",";
+    }
+    // Bucket i holds durations under 2^i us
+    dprintf(fd, "},\"latency_us\":{");
+    for (size_t i = 0; i < kLatencies; i++) {
+        const HistogramSnapshot& h = s.latencies[i];
+        dprintf(fd, "%s\"%s\":{\"count\":%" PRIu64 ",\"total\":%" PRIu64 ",\"max\":%" PRIu64
+                ",\"buckets\":[",
+                i ? "," : "", kLatencyNames[i], h.count, h.totalUs, h.maxUs);
+        for (size_t b = 0; b < kBuckets; b++) {
+            dprintf(fd, "%s%" PRIu64, b ? "," : "", h.buckets[b]);
+        }
+        dprintf(fd, "]}");
+    }
+    dprintf(fd, "}}\n");
+}
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
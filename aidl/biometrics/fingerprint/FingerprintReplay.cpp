@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Feeds a capture taken with `dumpsys <IFingerprint>/default --capture` back
+// through HwFingerprintEngine::notify into a Session, with a stub vendor device
+// underneath and a stub callback on top. Prints the callbacks the session made
+// and the dispatch cost of every message, then checks the lockout and
+// enumeration callbacks against what the messages should have produced.
+//
+//   fingerprint-replay.nubia [--paced] <capture>
+
+#define LOG_TAG "FingerprintReplay"
+
+#include <aidl/android/hardware/biometrics/fingerprint/BnSessionCallback.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <FingerprintMetrics.h>
+#include <HwFingerprintEngine.h>
+#include <MessageCapture.h>
+#include <Session.h>
+
+using namespace ::aidl::android::hardware::biometrics::fingerprint;
+using ::aidl::android::hardware::biometrics::WorkerThread;
+using ::aidl::android::hardware::keymaster::HardwareAuthToken;
+
+namespace {
+
+constexpr size_t kWorkerQueueSize = 16;
+constexpr auto kDeviceTimeout = std::chrono::seconds(5);
+// A timed lockout that never runs out during a replay, even a paced one, so the
+// expected callbacks only depend on the messages
+constexpr int64_t kReplayLockoutMs = 24 * 60 * 60 * 1000;
+
+std::atomic<fingerprint_notify_t> sNotify = nullptr;
+
+// Vendor device that accepts every request and never sends anything by itself
+int stubSetNotify(fingerprint_device_t*, fingerprint_notify_t notify) {
+    sNotify.store(notify);
+    return 0;
+}
+uint64_t stubPreEnroll(fingerprint_device_t*) { return 1; }
+int stubEnroll(fingerprint_device_t*, const hw_auth_token_t*, uint32_t, uint32_t) { return 0; }
+int stubPostEnroll(fingerprint_device_t*) { return 0; }
+uint64_t stubGetAuthenticatorId(fingerprint_device_t*) { return 1; }
+int stubCancel(fingerprint_device_t*) { return 0; }
+int stubEnumerate(fingerprint_device_t*) { return 0; }
+int stubRemove(fingerprint_device_t*, uint32_t, uint32_t) { return 0; }
+int stubSetActiveGroup(fingerprint_device_t*, uint32_t, const char*) { return 0; }
+int stubAuthenticate(fingerprint_device_t*, uint64_t, uint32_t) { return 0; }
+int stubClose(hw_device_t*) { return 0; }
+
+hw_module_t sStubModule = {
+        .tag = HARDWARE_MODULE_TAG,
+        .module_api_version = FINGERPRINT_MODULE_API_VERSION_2_1,
+        .hal_api_version = HARDWARE_HAL_API_VERSION,
+        .id = "replay",
+        .name = "Fingerprint replay",
+        .author = "Paranoid Android",
+};
+
+fingerprint_device_t* openStubDevice() {
+    static fingerprint_device_t sDevice = [] {
+        fingerprint_device_t device = {};
+        device.common.tag = HARDWARE_DEVICE_TAG;
+        device.common.version = FINGERPRINT_MODULE_API_VERSION_2_1;
+        device.common.module = &sStubModule;
+        device.common.close = stubClose;
+        device.set_notify = stubSetNotify;
+        device.pre_enroll = stubPreEnroll;
+        device.enroll = stubEnroll;
+        device.post_enroll = stubPostEnroll;
+        device.get_authenticator_id = stubGetAuthenticatorId;
+        device.cancel = stubCancel;
+        device.enumerate = stubEnumerate;
+        device.remove = stubRemove;
+        device.set_active_group = stubSetActiveGroup;
+        device.authenticate = stubAuthenticate;
+        return device;
+    }();
+    return &sDevice;
+}
+
+class ReplayEngine : public HwFingerprintEngine {
+  public:
+    ReplayEngine()
+        : HwFingerprintEngine(
+                  {{"replay", nullptr, FingerprintSensorType::UNKNOWN, openStubDevice}}) {}
+
+    int32_t getCenterPositionR() const override { return 0; }
+    int32_t getCenterPositionX() const override { return 0; }
+    int32_t getCenterPositionY() const override { return 0; }
+    void onPointerDownImpl(int32_t, int32_t, int32_t, float, float) override {}
+    void onPointerUpImpl(int32_t) override {}
+    void onUiReadyImpl() override {}
+};
+
+// Counts what the session reports
+class StubSessionCallback : public BnSessionCallback {
+  public:
+    enum Event {
+        ACQUIRED,
+        ENROLLMENT_PROGRESS,
+        AUTHENTICATION_SUCCEEDED,
+        AUTHENTICATION_FAILED,
+        LOCKOUT_TIMED,
+        LOCKOUT_PERMANENT,
+        LOCKOUT_CLEARED,
+        INTERACTION_DETECTED,
+        ENROLLMENTS_ENUMERATED,
+        ENROLLMENTS_REMOVED,
+        ERROR,
+        OTHER,
+        COUNT
+    };
+
+    ndk::ScopedAStatus onChallengeGenerated(int64_t) override { return count(OTHER); }
+    ndk::ScopedAStatus onChallengeRevoked(int64_t) override { return count(OTHER); }
+    ndk::ScopedAStatus onAcquired(AcquiredInfo, int32_t) override { return count(ACQUIRED); }
+    ndk::ScopedAStatus onError(Error, int32_t) override { return count(ERROR); }
+    ndk::ScopedAStatus onEnrollmentProgress(int32_t, int32_t) override {
+        return count(ENROLLMENT_PROGRESS);
+    }
+    ndk::ScopedAStatus onAuthenticationSucceeded(int32_t, const HardwareAuthToken&) override {
+        return log(AUTHENTICATION_SUCCEEDED);
+    }
+    ndk::ScopedAStatus onAuthenticationFailed() override { return log(AUTHENTICATION_FAILED); }
+    ndk::ScopedAStatus onLockoutTimed(int64_t) override { return log(LOCKOUT_TIMED); }
+    ndk::ScopedAStatus onLockoutPermanent() override { return log(LOCKOUT_PERMANENT); }
+    ndk::ScopedAStatus onLockoutCleared() override { return log(LOCKOUT_CLEARED); }
+    ndk::ScopedAStatus onInteractionDetected() override { return count(INTERACTION_DETECTED); }
+    ndk::ScopedAStatus onEnrollmentsEnumerated(const std::vector<int32_t>& ids) override {
+        mEnrolled = ids.size();
+        return log(ENROLLMENTS_ENUMERATED, ids);
+    }
+    ndk::ScopedAStatus onEnrollmentsRemoved(const std::vector<int32_t>&) override {
+        return count(ENROLLMENTS_REMOVED);
+    }
+    ndk::ScopedAStatus onAuthenticatorIdRetrieved(int64_t) override { return count(OTHER); }
+    ndk::ScopedAStatus onAuthenticatorIdInvalidated(int64_t) override { return count(OTHER); }
+    ndk::ScopedAStatus onSessionClosed() override { return count(OTHER); }
+
+    // A lockout or enumeration callback
+    struct Call {
+        Event event;
+        std::vector<int32_t> ids;
+        bool operator==(const Call&) const = default;
+    };
+
+    static constexpr const char* kNames[] = {
+            "acquired", "enrollment_progress", "authentication_succeeded",
+            "authentication_failed", "lockout_timed", "lockout_permanent", "lockout_cleared",
+            "interaction_detected", "enrollments_enumerated", "enrollments_removed", "error",
+            "other",
+    };
+    static_assert(std::size(kNames) == COUNT);
+
+    std::vector<Call> calls() {
+        std::lock_guard<std::mutex> lock(mCallsLock);
+        return mCalls;
+    }
+
+    void print() const {
+        printf("Callbacks:\n");
+        for (size_t i = 0; i < COUNT; i++) {
+            uint32_t value = mCounts[i].load(std::memory_order_relaxed);
+            if (value) printf("  %s: %u\n", kNames[i], value);
+        }
+        printf("  last enumeration: %zu enrollments\n", mEnrolled.load());
+    }
+
+  private:
+    ndk::ScopedAStatus count(Event event) {
+        mCounts[event].fetch_add(1, std::memory_order_relaxed);
+        return ndk::ScopedAStatus::ok();
+    }
+
+    ndk::ScopedAStatus log(Event event, std::vector<int32_t> ids = {}) {
+        {
+            std::lock_guard<std::mutex> lock(mCallsLock);
+            mCalls.push_back({event, std::move(ids)});
+        }
+        return count(event);
+    }
+
+    std::array<std::atomic<uint32_t>, COUNT> mCounts = {};
+    std::mutex mCallsLock;
+    std::vector<Call> mCalls;
+    std::atomic<size_t> mEnrolled = 0;
+};
+
+// What the session should report for the captured messages, following
+// LockoutTracker's thresholds and the engine's enumeration batching. A message
+// the engine doesn't know starts a recovery, which resets its state, so the model
+// stops at the first one and *modeled tells how many messages it covers.
+std::vector<StubSessionCallback::Call> expectedCalls(const std::vector<CapturedMessage>& messages,
+                                                     const LockoutConfig& config,
+                                                     size_t* modeled) {
+    using Call = StubSessionCallback::Call;
+    std::vector<Call> calls;
+    int32_t failed = 0;
+    std::vector<int32_t> enumerated;
+    for (*modeled = 0; *modeled < messages.size(); ++*modeled) {
+        const CapturedMessage& captured = messages[*modeled];
+        switch (captured.type) {
+            case FINGERPRINT_AUTHENTICATED:
+                if (captured.args[0] != 0) {
+                    calls.push_back({StubSessionCallback::AUTHENTICATION_SUCCEEDED, {}});
+                    failed = 0;
+                    break;
+                }
+                calls.push_back({StubSessionCallback::AUTHENTICATION_FAILED, {}});
+                if (++failed >= config.permanentThreshold) {
+                    calls.push_back({StubSessionCallback::LOCKOUT_PERMANENT, {}});
+                } else if (failed >= config.timedThreshold) {
+                    calls.push_back({StubSessionCallback::LOCKOUT_TIMED, {}});
+                }
+                break;
+            case FINGERPRINT_TEMPLATE_ENUMERATING:
+                enumerated.push_back(captured.args[0]);
+                if (captured.args[2] == 0) {
+                    calls.push_back({StubSessionCallback::ENROLLMENTS_ENUMERATED, {}});
+                    calls.back().ids.swap(enumerated);
+                }
+                break;
+            case FINGERPRINT_ERROR:
+            case FINGERPRINT_ACQUIRED:
+            case FINGERPRINT_TEMPLATE_ENROLLING:
+            case FINGERPRINT_TEMPLATE_REMOVED:
+                break;
+            default:
+                return calls;
+        }
+    }
+    return calls;
+}
+
+// Prints the first difference, true when there is none
+bool verify(const std::vector<StubSessionCallback::Call>& expected,
+            const std::vector<StubSessionCallback::Call>& actual) {
+    for (size_t i = 0; i < std::max(expected.size(), actual.size()); i++) {
+        if (i < expected.size() && i < actual.size() && expected[i] == actual[i]) continue;
+        fprintf(stderr, "Callback %zu: expected %s, got %s\n", i,
+                i < expected.size() ? StubSessionCallback::kNames[expected[i].event] : "nothing",
+                i < actual.size() ? StubSessionCallback::kNames[actual[i].event] : "nothing");
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bool paced = false;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--paced")) {
+            paced = true;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s [--paced] <capture>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ::android::base::unique_fd fd(open(path, O_RDONLY | O_CLOEXEC));
+    std::vector<CapturedMessage> messages;
+    if (fd < 0 || !MessageCapture::read(fd.get(), &messages)) {
+        fprintf(stderr, "Can't read a capture from %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    auto engine = std::make_shared<ReplayEngine>();
+    engine->start();
+    auto worker = std::make_shared<WorkerThread>(kWorkerQueueSize);
+    auto cb = ndk::SharedRefBase::make<StubSessionCallback>();
+    LockoutConfig lockoutConfig;
+    lockoutConfig.timedDurationMs = kReplayLockoutMs;
+    auto session =
+            ndk::SharedRefBase::make<Session>(engine, worker, cb, LockoutTracker(lockoutConfig));
+    engine->setSession(session);
+
+    auto deadline = std::chrono::steady_clock::now() + kDeviceTimeout;
+    while (!sNotify.load()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            fprintf(stderr, "The stub device was never opened\n");
+            return EXIT_FAILURE;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    fingerprint_notify_t notify = sNotify.load();
+
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+    size_t modeled;
+    auto expected = expectedCalls(messages, lockoutConfig, &modeled);
+    size_t verifiable = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < messages.size(); i++) {
+        const CapturedMessage& captured = messages[i];
+        // Callbacks go out from notify itself, so everything before the message
+        // the model stopped at is logged by now
+        if (i == modeled) verifiable = cb->calls().size();
+        if (paced) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(captured.timeNs));
+        }
+        fingerprint_msg_t msg = MessageCapture::decode(captured);
+        int64_t beginNs = FingerprintMetrics::now();
+        notify(&msg);
+        uint64_t ns = FingerprintMetrics::now() - beginNs;
+        totalNs += ns;
+        maxNs = std::max(maxNs, ns);
+    }
+    if (modeled == messages.size()) verifiable = cb->calls().size();
+
+    printf("Replayed %zu messages, dispatch avg %.2f us, max %.2f us\n", messages.size(),
+           messages.empty() ? 0.0 : totalNs / 1000.0 / messages.size(), maxNs / 1000.0);
+    cb->print();
+    fflush(stdout);
+    engine->dump(STDOUT_FILENO);
+    session->dump(STDOUT_FILENO);
+    FingerprintMetrics::get().dump(STDOUT_FILENO);
+
+    auto actual = cb->calls();
+    actual.resize(std::min(actual.size(), verifiable));
+    if (modeled < messages.size()) {
+        printf("Message %zu has unknown type %d, checked the callbacks up to it\n", modeled,
+               messages[modeled].type);
+    }
+    if (!verify(expected, actual)) {
+        fprintf(stderr, "Lockout and enumeration callbacks don't match the capture\n");
+        return EXIT_FAILURE;
+    }
+    printf("Lockout and enumeration callbacks match the capture (%zu checked)\n",
+           expected.size());
+    return EXIT_SUCCESS;
+}
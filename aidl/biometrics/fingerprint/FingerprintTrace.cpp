@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <FingerprintTrace.h>
+
+#include <cutils/properties.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <iterator>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+constexpr char kTraceProp[] = "persist.vendor.fingerprint.trace";
+constexpr const char* kStageNames[] = {
+        "start", "pointer_down", "ui_ready", "acquired", "match", "callback",
+};
+static_assert(std::size(kStageNames) == static_cast<size_t>(AttemptStage::COUNT));
+}  // namespace
+
+FingerprintTrace& FingerprintTrace::get() {
+    static FingerprintTrace sInstance;
+    return sInstance;
+}
+
+FingerprintTrace::FingerprintTrace()
+    : mEnabled(property_get_bool(kTraceProp, false)) {}
+
+void FingerprintTrace::record(const char* name, int64_t beginNs, int64_t endNs) {
+    if (!enabled()) return;
+
+    uint64_t index = mNextEvent.fetch_add(1, std::memory_order_relaxed);
+    Event& event = mEvents[index % kMaxEvents];
+    // Odd sequence while the slot is being written, readers skip it
+    uint32_t seq = static_cast<uint32_t>(index / kMaxEvents) * 2 + 1;
+    event.seq.store(seq, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name, std::memory_order_relaxed);
+    event.beginNs.store(beginNs, std::memory_order_relaxed);
+    event.endNs.store(endNs, std::memory_order_relaxed);
+    event.tid.store(gettid(), std::memory_order_relaxed);
+    event.seq.store(seq + 1, std::memory_order_release);
+}
+
+void FingerprintTrace::beginAttempt() {
+    std::lock_guard<std::mutex> lock(mAttemptLock);
+    int32_t id = mCurrentAttempt.load(std::memory_order_relaxed) + 1;
+    Attempt& attempt = mAttempts[id % kMaxAttempts];
+    attempt = Attempt();
+    attempt.id = id;
+    attempt.stages[static_cast<size_t>(AttemptStage::START)] = now();
+    mCurrentAttempt.store(id, std::memory_order_relaxed);
+}
+
+void FingerprintTrace::markAttempt(AttemptStage stage) {
+    std::lock_guard<std::mutex> lock(mAttemptLock);
+    int32_t id = mCurrentAttempt.load(std::memory_order_relaxed);
+    Attempt& attempt = mAttempts[id % kMaxAttempts];
+    if (attempt.id != id || id == 0 || attempt.done) return;
+
+    if (stage == AttemptStage::ACQUIRED) {
+        attempt.acquiredCount++;
+    }
+    int64_t& ts = attempt.stages[static_cast<size_t>(stage)];
+    if (ts == 0) {
+        ts = now();
+    }
+}
+
+void FingerprintTrace::endAttempt(bool matched) {
+    std::lock_guard<std::mutex> lock(mAttemptLock);
+    int32_t id = mCurrentAttempt.load(std::memory_order_relaxed);
+    Attempt& attempt = mAttempts[id % kMaxAttempts];
+    if (attempt.id != id || id == 0 || attempt.done) return;
+
+    attempt.stages[static_cast<size_t>(AttemptStage::CALLBACK)] = now();
+    attempt.matched = matched;
+    attempt.done = true;
+}
+
+void FingerprintTrace::dumpAttempts(int fd) {
+    std::array<Attempt, kMaxAttempts> attempts;
+    int32_t current;
+    {
+        std::lock_guard<std::mutex> lock(mAttemptLock);
+        attempts = mAttempts;
+        current = mCurrentAttempt.load(std::memory_order_relaxed);
+    }
+
+    dprintf(fd, "Authentication attempts (tracing %s):\n", enabled() ? "enabled" : "disabled");
+    for (int32_t id = std::max(1, current - static_cast<int32_t>(kMaxAttempts) + 1); id <= current;
+         id++) {
+        const Attempt& attempt = attempts[id % kMaxAttempts];
+        if (attempt.id != id) continue;
+
+        dprintf(fd, "  #%d %s, acquired x%d:", id,
+                !attempt.done ? "pending" : attempt.matched ? "match" : "no match",
+                attempt.acquiredCount);
+        int64_t prev = attempt.stages[static_cast<size_t>(AttemptStage::START)];
+        for (size_t i = 1; i < static_cast<size_t>(AttemptStage::COUNT); i++) {
+            if (attempt.stages[i] == 0) {
+                dprintf(fd, " %s=-", kStageNames[i]);
+                continue;
+            }
+            dprintf(fd, " %s=%+.2fms", kStageNames[i], (attempt.stages[i] - prev) / 1e6);
+            prev = attempt.stages[i];
+        }
+        dprintf(fd, "\n");
+    }
+}
+
+void FingerprintTrace::dumpSystrace(int fd) {
+    struct Mark {
+        int64_t ts;
+        char type;  // B/E: span on a thread, S/F: async attempt stage
+        int64_t duration;
+        const char* name;
+        int32_t tid;
+        int32_t cookie;
+    };
+
+    std::vector<Mark> marks;
+    marks.reserve(kMaxEvents * 2);
+    for (Event& event : mEvents) {
+        uint32_t seq = event.seq.load(std::memory_order_acquire);
+        if (seq == 0 || (seq & 1)) continue;
+        const char* name = event.name.load(std::memory_order_relaxed);
+        int64_t begin = event.beginNs.load(std::memory_order_relaxed);
+        // Give very short spans a visible width
+        int64_t end = std::max(event.endNs.load(std::memory_order_relaxed), begin + 1000);
+        int32_t tid = event.tid.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (event.seq.load(std::memory_order_relaxed) != seq) continue;
+
+        marks.push_back({begin, 'B', end - begin, name, tid, 0});
+        marks.push_back({end, 'E', end - begin, name, tid, 0});
+    }
+
+    std::array<Attempt, kMaxAttempts> attempts;
+    {
+        std::lock_guard<std::mutex> lock(mAttemptLock);
+        attempts = mAttempts;
+    }
+    pid_t pid = getpid();
+    for (const Attempt& attempt : attempts) {
+        if (attempt.id == 0) continue;
+        int64_t prev = attempt.stages[static_cast<size_t>(AttemptStage::START)];
+        for (size_t i = 1; i < static_cast<size_t>(AttemptStage::COUNT); i++) {
+            int64_t ts = attempt.stages[i];
+            if (ts == 0) continue;
+            marks.push_back({prev, 'S', ts - prev, kStageNames[i], pid, attempt.id});
+            marks.push_back({ts, 'F', ts - prev, kStageNames[i], pid, attempt.id});
+            prev = ts;
+        }
+    }
+
+    // Keep B/E properly nested: at equal timestamps close spans before opening new
+    // ones, open outer spans first and close inner spans first
+    std::sort(marks.begin(), marks.end(), [](const Mark& a, const Mark& b) {
+        if (a.ts != b.ts) return a.ts < b.ts;
+        bool aOpens = a.type == 'B' || a.type == 'S';
+        bool bOpens = b.type == 'B' || b.type == 'S';
+        if (aOpens != bOpens) return !aOpens;
+        return aOpens ? a.duration > b.duration : a.duration < b.duration;
+    });
+
+    dprintf(fd, "# tracer: nop\n#\n");
+    for (const Mark& mark : marks) {
+        dprintf(fd, "fingerprint-%d (%d) [000] .... %" PRId64 ".%06" PRId64 ": tracing_mark_write: ",
+                mark.tid, pid, mark.ts / 1000000000, (mark.ts % 1000000000) / 1000);
+        switch (mark.type) {
+            case 'B':
+                dprintf(fd, "B|%d|%s\n", pid, mark.name);
+                break;
+            case 'E':
+                dprintf(fd, "E|%d\n", pid);
+                break;
+            default:
+                dprintf(fd, "%c|%d|attempt:%s|%d\n", mark.type, pid, mark.name, mark.cookie);
+                break;
+        }
+    }
+}
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
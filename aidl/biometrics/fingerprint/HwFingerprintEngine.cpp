@@ -6,9 +6,19 @@
 
 #define LOG_TAG "HwFingerprintEngine"
 
+#include <android-base/chrono_utils.h>
 #include <android/log.h>
+#include <cutils/properties.h>
 #include <log/log.h>
 
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <utility>
+
+#include <FingerprintMetrics.h>
+#include <FingerprintTrace.h>
+#include <MessageCapture.h>
 #include <Session.h>
 #include <HwFingerprintEngine.h>
 #include <Legacy2Aidl.h>
@@ -17,36 +27,95 @@ namespace aidl::android::hardware::biometrics::fingerprint {
 
 static const uint16_t kVersion = HARDWARE_MODULE_API_VERSION(2, 1);
 
-static HwFingerprintEngine* sInstance = nullptr;
+// The legacy notify callback carries no device or cookie, so every engine gets
+// its own trampoline that routes messages to the instance registered in its slot
+static std::array<std::atomic<HwFingerprintEngine*>, HwFingerprintEngine::kMaxInstances> sInstances;
 
-HwFingerprintEngine::HwFingerprintEngine(const std::vector<HwFingerprintModule> &modules, bool setNotifyCallback)
-    : mDevice(nullptr), mAuthId(0), mChallengeId(0) {
-    sInstance = this;  // keep track of the most recent instance
-    for (auto& [id_name, class_name, sensor_type] : modules) {
-        mDevice = openHwModule(id_name, class_name);
-        if (!mDevice) {
-            ALOGE("Can't open HAL module, id %s, class %s", id_name, class_name);
-            continue;
-        }
-        int err;
-        if (setNotifyCallback && (err = mDevice->set_notify(mDevice, HwFingerprintEngine::notify)) != 0) {
-            ALOGE("Can't register fingerprint module callback, error: %d", err);
-            continue;
-        }
+template <size_t Slot>
+void HwFingerprintEngine::notifySlot(const fingerprint_msg_t* msg) {
+    notify(sInstances[Slot].load(std::memory_order_acquire), msg);
+}
 
-        ALOGI("Opened fingerprint HAL, id %s, class %s", id_name, class_name);
-        mSensorType = sensor_type;
-        break;
+template <size_t... Slots>
+static constexpr std::array<fingerprint_notify_t, sizeof...(Slots)> makeNotifySlots(
+        std::index_sequence<Slots...>) {
+    return {&HwFingerprintEngine::notifySlot<Slots>...};
+}
+
+static constexpr auto kNotifySlots =
+        makeNotifySlots(std::make_index_sequence<HwFingerprintEngine::kMaxInstances>());
+
+static constexpr char kLastModuleProp[] = "persist.vendor.fingerprint.last_module.";
+
+// Set on the loader thread while it replays the operations queued before the device was ready
+static thread_local bool sReplayingOps = false;
+
+// Opening the module is retried with exponential backoff. At startup the service
+// gives up after kMaxOpenAttempts, a recovery reports the failure and keeps trying.
+static constexpr int kMaxOpenAttempts = 6;
+static constexpr std::chrono::milliseconds kOpenBackoffMin(100);
+static constexpr std::chrono::milliseconds kOpenBackoffMax(2000);
+
+// A removal batch the vendor library didn't finish reporting by then is failed
+static constexpr std::chrono::seconds kRemovalTimeout(5);
+
+// Histogram for the time from notify to the session callback returning
+static std::optional<FingerprintMetrics::Latency> notifyLatency(int32_t type) {
+    using Latency = FingerprintMetrics::Latency;
+    switch (type) {
+        case FINGERPRINT_ERROR:
+            return Latency::NOTIFY_ERROR;
+        case FINGERPRINT_ACQUIRED:
+            return Latency::NOTIFY_ACQUIRED;
+        case FINGERPRINT_TEMPLATE_ENROLLING:
+            return Latency::NOTIFY_ENROLLING;
+        case FINGERPRINT_TEMPLATE_REMOVED:
+            return Latency::NOTIFY_REMOVED;
+        case FINGERPRINT_AUTHENTICATED:
+            return Latency::NOTIFY_AUTHENTICATED;
+        case FINGERPRINT_TEMPLATE_ENUMERATING:
+            return Latency::NOTIFY_ENUMERATING;
+        default:
+            return std::nullopt;
     }
+}
 
-    if (!mDevice) {
-        ALOGE("Can't open any HAL module");
-        abort();
+HwFingerprintEngine::HwFingerprintEngine(const std::vector<HwFingerprintModule> &modules, bool setNotifyCallback,
+                                         const VendorCodeLuts& vendorCodes)
+    : mUserId(-1), mAuthId(0), mChallengeId(0), mModules(modules), mSetNotifyCallback(setNotifyCallback),
+      mDevice(nullptr), mReady(false), mVendorCodes(&vendorCodes) {
+    for (mSlot = 0; mSlot < kMaxInstances; mSlot++) {
+        HwFingerprintEngine* expected = nullptr;
+        if (sInstances[mSlot].compare_exchange_strong(expected, this)) break;
     }
+    LOG_ALWAYS_FATAL_IF(mSlot == kMaxInstances, "Too many fingerprint engines");
+    mCreatedAt = std::chrono::steady_clock::now();
+    // Reused for every successful authentication
+    mAuthToken.mac.resize(kHwAuthTokenHmacSize);
+}
+
+void HwFingerprintEngine::start() {
+    std::lock_guard<std::mutex> lock(mLoaderLock);
+    LOG_ALWAYS_FATAL_IF(mLoader.joinable(), "Fingerprint engine started twice");
+    // dlopen and TEE initialization of the vendor library are slow, keep them
+    // off the service registration path
+    mLoader = std::thread([this] { loadDevice(false /* recovering */); });
 }
 
 HwFingerprintEngine::~HwFingerprintEngine() {
     ALOGD("~HwFingerprintEngine");
+    std::thread loader;
+    {
+        // No recovery can start a new loader from here on
+        std::lock_guard<std::mutex> lock(mLoaderLock);
+        mStopping = true;
+        loader = std::move(mLoader);
+    }
+    mLoaderCv.notify_all();
+    if (loader.joinable()) {
+        loader.join();
+    }
+    sInstances[mSlot].store(nullptr, std::memory_order_release);
     if (mDevice == nullptr) {
         ALOGE("No valid device");
         return;
@@ -59,6 +128,221 @@ HwFingerprintEngine::~HwFingerprintEngine() {
     mDevice = nullptr;
 }
 
+static std::string moduleKey(const HwFingerprintModule& module) {
+    return std::string(module.id_name) + "/" + (module.class_name ? module.class_name : "");
+}
+
+fingerprint_device_t* HwFingerprintEngine::probeModules() {
+    // Try the module that worked last time first, the others are only
+    // probed when it fails
+    std::vector<HwFingerprintModule> modules = mModules;
+    // With a single module there is nothing to order, leave the hint alone
+    std::string hintProp = kLastModuleProp + std::to_string(mSlot);
+    char hint[PROPERTY_VALUE_MAX] = "";
+    if (modules.size() > 1 && property_get(hintProp.c_str(), hint, "") > 0) {
+        std::stable_partition(modules.begin(), modules.end(),
+                [&hint](const HwFingerprintModule& module) { return moduleKey(module) == hint; });
+    }
+
+    for (auto& module : modules) {
+        auto& [id_name, class_name, sensor_type, open] = module;
+        fingerprint_device_t* device = open ? open() : openHwModule(id_name, class_name);
+        if (!device) {
+            ALOGE("Can't open HAL module, id %s, class %s", id_name, class_name);
+            continue;
+        }
+        int err;
+        if (mSetNotifyCallback && (err = device->set_notify(device, kNotifySlots[mSlot])) != 0) {
+            ALOGE("Can't register fingerprint module callback, error: %d", err);
+            device->common.close(reinterpret_cast<hw_device_t*>(device));
+            continue;
+        }
+
+        ALOGI("Opened fingerprint HAL, id %s, class %s", id_name, class_name);
+        if (modules.size() > 1 && moduleKey(module) != hint) {
+            property_set(hintProp.c_str(), moduleKey(module).c_str());
+        }
+        const hw_module_t* hwModule = device->common.module;
+        char version[128];
+        snprintf(version, sizeof(version), "%s %u.%u", hwModule->name,
+                 (hwModule->module_api_version >> 8) & 0xff, hwModule->module_api_version & 0xff);
+        {
+            std::lock_guard<std::mutex> lock(mDeviceLock);
+            mSensorType = sensor_type;
+            mFirmwareVersion = version;
+        }
+        return device;
+    }
+
+    return nullptr;
+}
+
+bool HwFingerprintEngine::loadDevice(bool recovering) {
+    auto startedAt = std::chrono::steady_clock::now();
+    auto backoff = kOpenBackoffMin;
+    fingerprint_device_t* device = nullptr;
+    for (int attempt = 1; !(device = probeModules()); attempt++) {
+        if (attempt == kMaxOpenAttempts) {
+            // Aborting here would take every other sensor and session down with us
+            LOG_ALWAYS_FATAL_IF(!recovering, "Can't open any HAL module");
+            ALOGE("Can't reopen any HAL module, still trying");
+            WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onError, Error::HW_UNAVAILABLE,
+                                               0 /* vendorCode */);
+        }
+        ALOGE("Can't open any HAL module, retrying in %lld ms",
+              static_cast<long long>(backoff.count()));
+        std::unique_lock<std::mutex> lock(mLoaderLock);
+        if (mLoaderCv.wait_for(lock, backoff, [this] { return mStopping; })) {
+            return false;
+        }
+        backoff = std::min(backoff * 2, kOpenBackoffMax);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mDeviceLock);
+        mDevice = device;
+    }
+    mDeviceOpened.notify_all();
+    auto openedAt = std::chrono::steady_clock::now();
+
+    // Replay the calls that arrived while the device was being opened, in order
+    std::vector<std::function<void()>> ops;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mDeviceLock);
+            if (mPendingOps.empty()) {
+                mReady.store(true, std::memory_order_release);
+                break;
+            }
+            ops.swap(mPendingOps);
+        }
+        sReplayingOps = true;
+        for (auto& op : ops) {
+            op();
+        }
+        sReplayingOps = false;
+        ops.clear();
+    }
+
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+    auto now = std::chrono::steady_clock::now();
+    ALOGI("Fingerprint HAL ready in %lld ms (open: %lld ms, since start: %lld ms, boot: %lld ms)",
+          static_cast<long long>(duration_cast<milliseconds>(now - startedAt).count()),
+          static_cast<long long>(duration_cast<milliseconds>(openedAt - startedAt).count()),
+          static_cast<long long>(duration_cast<milliseconds>(now - mCreatedAt).count()),
+          static_cast<long long>(duration_cast<milliseconds>(
+                  ::android::base::boot_clock::now().time_since_epoch()).count()));
+    return true;
+}
+
+void HwFingerprintEngine::requestRecovery(const char* reason) {
+    if (!mReady.load(std::memory_order_acquire) || mRecovering.exchange(true)) {
+        ALOGW("Ignoring recovery request (%s), device is being opened", reason);
+        return;
+    }
+
+    std::lock_guard<std::mutex> loaderLock(mLoaderLock);
+    if (mStopping) {
+        ALOGW("Ignoring recovery request (%s), engine is going away", reason);
+        return;
+    }
+
+    ALOGE("Recovering fingerprint HAL: %s", reason);
+    {
+        // New calls are queued from now on and replayed on the reopened device
+        std::lock_guard<std::mutex> lock(mDeviceLock);
+        mReady.store(false, std::memory_order_release);
+    }
+
+    // Usually called from the vendor notify thread, never close the device from there.
+    // The previous loader is past its last use of the device, joining it is quick.
+    if (mLoader.joinable()) {
+        mLoader.join();
+    }
+    mLoader = std::thread([this] {
+        auto startedAt = std::chrono::steady_clock::now();
+        bool operationFailed;
+        {
+            // Waits for the calls that are using the device right now
+            std::unique_lock<std::shared_mutex> exclusive(mDeviceUse);
+
+            operationFailed = mOperationInFlight.exchange(false);
+            {
+                // The reopened device starts a new enumeration from scratch
+                std::lock_guard<std::mutex> lock(mEnrollmentsLock);
+                mEnumerated.clear();
+            }
+            mDetecting = false;
+            mDetectCancelGeneration = 0;
+
+            fingerprint_device_t* device;
+            {
+                std::lock_guard<std::mutex> lock(mDeviceLock);
+                device = mDevice;
+                mDevice = nullptr;
+                // The new device starts without an active group
+                mActiveGroupSet = false;
+                // Nothing to restore when no group was ever set
+                if (int32_t userId = mUserId; userId >= 0) {
+                    mPendingOps.insert(mPendingOps.begin(),
+                                       [this, userId] { setActiveGroup(userId); });
+                }
+            }
+            int err = device->common.close(reinterpret_cast<hw_device_t*>(device));
+            if (err) {
+                ALOGE("Can't close fingerprint module, error: %d", err);
+            }
+        }
+
+        // New calls are queued until the device is back, nothing can race these
+        if (operationFailed) {
+            WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onError, Error::HW_UNAVAILABLE,
+                                               0 /* vendorCode */);
+        }
+        failPendingRemoval(FINGERPRINT_ERROR_HW_UNAVAILABLE);
+
+        if (!loadDevice(true /* recovering */)) {
+            mRecovering = false;
+            return;
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - startedAt).count();
+        mRecoveries.fetch_add(1, std::memory_order_relaxed);
+        mLastRecoveryUs.store(elapsed, std::memory_order_relaxed);
+        ALOGI("Fingerprint HAL recovered in %lld us", static_cast<long long>(elapsed));
+        mRecovering = false;
+    });
+}
+
+std::shared_lock<std::shared_mutex> HwFingerprintEngine::lockDevice(std::function<void()> op) {
+    std::shared_lock<std::shared_mutex> deviceLock(mDeviceUse);
+    if (mReady.load(std::memory_order_acquire) || sReplayingOps) {
+        return deviceLock;
+    }
+    deviceLock.unlock();
+
+    std::lock_guard<std::mutex> lock(mDeviceLock);
+    if (mReady.load(std::memory_order_relaxed)) {
+        // Became ready in the meantime
+        deviceLock.lock();
+        return deviceLock;
+    }
+    if (op) {
+        mPendingOps.push_back(std::move(op));
+        ALOGI("Device is not ready yet, %zu operation(s) queued", mPendingOps.size());
+    }
+    return deviceLock;
+}
+
+HwFingerprintEngine::LockedDevice HwFingerprintEngine::getDevice() {
+    // Same order as lockDevice(), a recovery that already closed the device is waited out
+    std::shared_lock<std::shared_mutex> deviceLock(mDeviceUse);
+    std::unique_lock<std::mutex> lock(mDeviceLock);
+    mDeviceOpened.wait(lock, [this] { return mDevice != nullptr; });
+    return {std::move(deviceLock), mDevice};
+}
 
 fingerprint_device_t* HwFingerprintEngine::openHwModule(const char* id_name, const char* class_name) {
     int err;
@@ -101,17 +385,78 @@ void HwFingerprintEngine::setSession(std::shared_ptr<Session> session) {
 }
 
 void HwFingerprintEngine::setActiveGroup(int userId) {
-    mUserId = userId;
+    auto deviceLock = lockDevice([this, userId] { setActiveGroup(userId); });
+    if (!deviceLock) return;
+
+    FP_TRACE_SPAN("HwFingerprintEngine::setActiveGroup");
     char path[256];
     snprintf(path, sizeof(path), "/data/vendor_de/%d/fpdata/", userId);
-    mDevice->set_active_group(mDevice, mUserId, path);
+    if (mActiveGroupSet && mUserId == userId && mActiveGroupPath == path) {
+        // The vendor library reloads its templates on every call, skip it
+        mActiveGroupSkipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mEnrollmentsLock);
+        mEnrolledIds.clear();
+    }
+    mUserId = userId;
+    auto start = std::chrono::steady_clock::now();
+    int err = mDevice->set_active_group(mDevice, mUserId, path);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    mActiveGroupCalls.fetch_add(1, std::memory_order_relaxed);
+    mActiveGroupCostUs.fetch_add(elapsed, std::memory_order_relaxed);
+    ALOGD("set_active_group(%d) took %lld us", userId, static_cast<long long>(elapsed));
+    if (err) {
+        ALOGE("set_active_group failed: %d", err);
+        mActiveGroupSet = false;
+        return;
+    }
+    mActiveGroupPath = path;
+    mActiveGroupSet = true;
+}
+
+void HwFingerprintEngine::onContextChangedImpl(const common::OperationContext& context) {
+    auto deviceLock = lockDevice([this, context] { onContextChangedImpl(context); });
+    if (!deviceLock) return;
+
+    SensorPowerState state = SensorPowerState::ACTIVE;
+    if (context.displayState == common::DisplayState::AOD || context.isAod) {
+        // Keep the sensor warm, the finger usually lands on the AOD icon
+        state = SensorPowerState::WARM;
+    } else if (context.displayState == common::DisplayState::NO_UI) {
+        state = SensorPowerState::SUSPENDED;
+    }
+
+    if (state == mPowerState) {
+        return;
+    }
+    ALOGD("Sensor power state %d -> %d (display state %s)", static_cast<int>(mPowerState),
+          static_cast<int>(state), ::android::internal::ToString(context.displayState).c_str());
+    mPowerState = state;
+    setSensorPowerState(state);
 }
 
 FingerprintSensorType HwFingerprintEngine::getSensorType() const {
+    // The sensor type depends on which module could be opened
+    std::unique_lock<std::mutex> lock(mDeviceLock);
+    mDeviceOpened.wait(lock, [this] { return mDevice != nullptr; });
     return mSensorType;
 }
 
+std::string HwFingerprintEngine::getFirmwareVersion() const {
+    std::unique_lock<std::mutex> lock(mDeviceLock);
+    mDeviceOpened.wait(lock, [this] { return mDevice != nullptr; });
+    return mFirmwareVersion;
+}
+
 void HwFingerprintEngine::generateChallengeImpl() {
+    auto deviceLock = lockDevice([this] { generateChallengeImpl(); });
+    if (!deviceLock) return;
+
+    FP_TRACE_SPAN("HwFingerprintEngine::generateChallengeImpl");
     uint64_t challenge = mDevice->pre_enroll(mDevice);
     ALOGI("generateChallengeImpl: %ld", challenge);
 
@@ -119,6 +464,10 @@ void HwFingerprintEngine::generateChallengeImpl() {
 }
 
 void HwFingerprintEngine::revokeChallengeImpl(int64_t challenge) {
+    auto deviceLock = lockDevice([this, challenge] { revokeChallengeImpl(challenge); });
+    if (!deviceLock) return;
+
+    FP_TRACE_SPAN("HwFingerprintEngine::revokeChallengeImpl");
     ALOGI("revokeChallengeImpl: %ld", challenge);
 
     mDevice->post_enroll(mDevice);
@@ -126,11 +475,21 @@ void HwFingerprintEngine::revokeChallengeImpl(int64_t challenge) {
 }
 
 void HwFingerprintEngine::enrollImpl(const keymaster::HardwareAuthToken& hat) {
+    auto deviceLock = lockDevice([this, hat] { enrollImpl(hat); });
+    if (!deviceLock) return;
+
+    FP_TRACE_SPAN("HwFingerprintEngine::enrollImpl");
     ALOGI("enrollImpl");
 
     hw_auth_token_t authToken;
-    translate(hat, authToken);
+    if (!translate(hat, authToken)) {
+        ALOGE("enroll: invalid auth token mac size: %zu", hat.mac.size());
+        WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onError, Error::UNABLE_TO_PROCESS, 0 /* vendorCode */);
+        return;
+    }
+    mOperationGeneration.fetch_add(1, std::memory_order_relaxed);
     int error = mDevice->enroll(mDevice, &authToken, mUserId, 60);
+    mOperationInFlight = error == 0;
     if (error) {
         ALOGE("enroll failed: %d", error);
         WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onError, Error::UNABLE_TO_PROCESS, error);
@@ -138,9 +497,16 @@ void HwFingerprintEngine::enrollImpl(const keymaster::HardwareAuthToken& hat) {
 }
 
 void HwFingerprintEngine::authenticateImpl(int64_t operationId) {
+    auto deviceLock = lockDevice([this, operationId] { authenticateImpl(operationId); });
+    if (!deviceLock) return;
+
+    FP_TRACE_SPAN("HwFingerprintEngine::authenticateImpl");
+    FP_TRACE_ATTEMPT(beginAttempt);
     ALOGI("authenticateImpl(%lu)", operationId);
 
+    mOperationGeneration.fetch_add(1, std::memory_order_relaxed);
     int error = mDevice->authenticate(mDevice, operationId, mUserId);
+    mOperationInFlight = error == 0;
     if (error) {
         ALOGE("authenticate failed: %d", error);
         WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onError, Error::UNABLE_TO_PROCESS, error);
@@ -148,12 +514,112 @@ void HwFingerprintEngine::authenticateImpl(int64_t operationId) {
 }
 
 void HwFingerprintEngine::detectInteractionImpl() {
-    ALOGE("detectInteractionImpl: not supported");
+    auto deviceLock = lockDevice([this] { detectInteractionImpl(); });
+    if (!deviceLock) return;
+
+    FP_TRACE_SPAN("HwFingerprintEngine::detectInteractionImpl");
+    ALOGI("detectInteractionImpl");
+
+    // The legacy HAL has no detect-only mode: run an authentication and cancel
+    // it as soon as a finger is seen, before the vendor library starts matching
+    mDetectStartedAt = std::chrono::steady_clock::now();
+    mDetecting = true;
+    mOperationGeneration.fetch_add(1, std::memory_order_relaxed);
+    int error = mDevice->authenticate(mDevice, 0 /* operationId */, mUserId);
+    mOperationInFlight = error == 0;
+    if (error) {
+        ALOGE("detectInteraction failed: %d", error);
+        mDetecting = false;
+        WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onError, Error::UNABLE_TO_PROCESS, error);
+    }
+}
 
-    WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onError, Error::UNABLE_TO_PROCESS, 0 /* vendorCode */);
+bool HwFingerprintEngine::handleDetectMessage(const fingerprint_msg_t* msg,
+                                              const std::shared_ptr<ISessionCallback>& cb) {
+    switch (msg->type) {
+        case FINGERPRINT_ACQUIRED: {
+            if (!mDetecting) return false;
+            if (msg->data.acquired.acquired_info != FINGERPRINT_ACQUIRED_GOOD) {
+                // A detection only ends with onInteractionDetected or onError, image
+                // quality hints are for the operations that match
+                ALOGD("detectInteraction: dropping acquired %d",
+                      msg->data.acquired.acquired_info);
+                return true;
+            }
+            mDetecting = false;
+            // The framework starts its next operation as soon as it hears about the
+            // finger, so the vendor authentication is stopped before reporting it. That
+            // happens on the sensor worker, never call back into the vendor library from
+            // its own notify thread. The session owns the engine and keeps it alive.
+            uint64_t generation = mOperationGeneration.load(std::memory_order_relaxed);
+            mDetectCancelGeneration = generation;
+            auto session = mSession.lock();
+            if (!session || !session->post([this, session, generation, cb] {
+                    finishDetect(generation, cb);
+                })) {
+                ALOGE("Can't schedule the end of detectInteraction");
+                onInteractionDetected(cb);
+            }
+            return true;
+        }
+        case FINGERPRINT_AUTHENTICATED: {
+            // The vendor library finished matching first, a finger was there either way
+            if (mDetecting.exchange(false)) {
+                onInteractionDetected(cb);
+                return true;
+            }
+            // Matched before the cancel got through, the detection is already on its way
+            uint64_t generation = mDetectCancelGeneration.load();
+            return generation != 0 &&
+                   generation == mOperationGeneration.load(std::memory_order_relaxed);
+        }
+        case FINGERPRINT_ERROR: {
+            uint64_t generation = mDetectCancelGeneration.exchange(0);
+            if (generation != 0 &&
+                generation == mOperationGeneration.load(std::memory_order_relaxed) &&
+                msg->data.error == FINGERPRINT_ERROR_CANCELED) {
+                // Caused by our own cancel, the operation already completed
+                return true;
+            }
+            mDetecting = false;
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+void HwFingerprintEngine::finishDetect(uint64_t generation,
+                                       const std::shared_ptr<ISessionCallback>& cb) {
+    {
+        auto deviceLock = lockDevice(nullptr);
+        // Unless a recovery or another operation got there first
+        if (deviceLock && mOperationGeneration.load(std::memory_order_relaxed) == generation) {
+            int ret = mDevice->cancel(mDevice);
+            if (ret) {
+                ALOGE("Can't stop detectInteraction: %d", ret);
+                mDetectCancelGeneration = 0;
+            }
+        }
+    }
+    onInteractionDetected(cb);
+}
+
+void HwFingerprintEngine::onInteractionDetected(const std::shared_ptr<ISessionCallback>& cb) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - mDetectStartedAt).count();
+    mOperationInFlight = false;
+    mDetections.fetch_add(1, std::memory_order_relaxed);
+    mDetectLatencyUs.fetch_add(elapsed, std::memory_order_relaxed);
+    ALOGD("onInteractionDetected after %lld us", static_cast<long long>(elapsed));
+    cb->onInteractionDetected();
 }
 
 void HwFingerprintEngine::enumerateEnrollmentsImpl() {
+    auto deviceLock = lockDevice([this] { enumerateEnrollmentsImpl(); });
+    if (!deviceLock) return;
+
+    FP_TRACE_SPAN("HwFingerprintEngine::enumerateEnrollmentsImpl");
     ALOGI("enumerateEnrollmentsImpl");
 
     int error = mDevice->enumerate(mDevice);
@@ -163,17 +629,144 @@ void HwFingerprintEngine::enumerateEnrollmentsImpl() {
 }
 
 void HwFingerprintEngine::removeEnrollmentsImpl(const std::vector<int32_t>& enrollmentIds) {
+    auto deviceLock = lockDevice([this, enrollmentIds] { removeEnrollmentsImpl(enrollmentIds); });
+    if (!deviceLock) return;
+
+    FP_TRACE_SPAN("HwFingerprintEngine::removeEnrollmentsImpl");
     ALOGI("removeEnrollmentsImpl, size: %zu", enrollmentIds.size());
 
+    std::unique_lock<std::mutex> lock(mEnrollmentsLock);
+    if (mRemoval.active) {
+        // The previous batch still waits for the vendor library, its callback must not be lost
+        ALOGW("removeEnrollments: %zu removal(s) of the previous batch never reported",
+              mRemoval.pending.size());
+        failRemovalLocked(lock, FINGERPRINT_ERROR_UNABLE_TO_REMOVE);
+        lock.lock();
+    }
+    mRemoval = PendingRemoval();
+    mRemoval.active = true;
+    uint64_t batch = mRemoval.batch = ++mRemovalBatches;
+    mRemoval.pending.insert(enrollmentIds.begin(), enrollmentIds.end());
+    // The vendor library may call notify() from within remove(), so don't hold the lock
+    lock.unlock();
+
     for (int32_t fid : enrollmentIds) {
         int error = mDevice->remove(mDevice, mUserId, fid);
         if (error) {
-            ALOGE("remove failed: %d", error);
+            ALOGE("remove(%d) failed: %d", fid, error);
+            lock.lock();
+            if (mRemoval.active && mRemoval.batch == batch && mRemoval.pending.erase(fid)) {
+                mRemoval.failed++;
+                mRemoval.lastError = error;
+            }
+            lock.unlock();
         }
     }
+
+    lock.lock();
+    if (!mRemoval.active || mRemoval.batch != batch) {
+        // Already completed by a vendor error
+        return;
+    }
+    mRemoval.issued = true;
+    if (mRemoval.pending.empty()) {
+        finishRemovalLocked(lock);
+        return;
+    }
+    lock.unlock();
+    startRemovalTimer(batch);
+}
+
+void HwFingerprintEngine::startRemovalTimer(uint64_t batch) {
+    std::weak_ptr<Session> weakSession = mSession;
+    // Like the lockout timer, the deadline is handled on the sensor worker. The
+    // session owns the engine, so this stays valid while it can be locked.
+    std::thread([this, batch, weakSession] {
+        std::this_thread::sleep_for(kRemovalTimeout);
+        if (auto session = weakSession.lock()) {
+            if (!session->post([this, session, batch] { expireRemoval(batch); })) {
+                expireRemoval(batch);
+            }
+        }
+    }).detach();
+}
+
+void HwFingerprintEngine::expireRemoval(uint64_t batch) {
+    std::unique_lock<std::mutex> lock(mEnrollmentsLock);
+    if (!mRemoval.active || mRemoval.batch != batch) return;
+    ALOGW("removeEnrollments timed out, %zu removal(s) never reported",
+          mRemoval.pending.size());
+    failRemovalLocked(lock, FINGERPRINT_ERROR_TIMEOUT);
+}
+
+void HwFingerprintEngine::onTemplateRemoved(int32_t fid, uint32_t remaining) {
+    std::unique_lock<std::mutex> lock(mEnrollmentsLock);
+    if (fid != 0) {
+        mEnrolledIds.erase(fid);
+    }
+
+    if (!mRemoval.active) {
+        // Removal not requested through removeEnrollmentsImpl, report it as is
+        lock.unlock();
+        std::vector<int32_t> enrollments = {fid};
+        WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onEnrollmentsRemoved, enrollments);
+        return;
+    }
+
+    if (fid != 0 && mRemoval.pending.erase(fid)) {
+        mRemoval.removed.push_back(fid);
+    }
+    if (remaining == 0) {
+        // Nothing is left in the group, whatever is still pending is gone as well
+        for (int32_t id : mRemoval.pending) {
+            mRemoval.removed.push_back(id);
+        }
+        mRemoval.pending.clear();
+    }
+
+    if (mRemoval.issued && mRemoval.pending.empty()) {
+        finishRemovalLocked(lock);
+    }
+}
+
+bool HwFingerprintEngine::failPendingRemoval(int32_t error) {
+    std::unique_lock<std::mutex> lock(mEnrollmentsLock);
+    if (!mRemoval.active) {
+        return false;
+    }
+
+    failRemovalLocked(lock, error);
+    return true;
+}
+
+void HwFingerprintEngine::failRemovalLocked(std::unique_lock<std::mutex>& lock, int32_t error) {
+    mRemoval.failed += static_cast<int32_t>(mRemoval.pending.size());
+    mRemoval.lastError = error;
+    mRemoval.pending.clear();
+    finishRemovalLocked(lock);
+}
+
+void HwFingerprintEngine::finishRemovalLocked(std::unique_lock<std::mutex>& lock) {
+    PendingRemoval result = std::move(mRemoval);
+    mRemoval = PendingRemoval();
+    lock.unlock();
+
+    ALOGI("removeEnrollments done, removed: %zu, failed: %d", result.removed.size(), result.failed);
+    if (!result.removed.empty() || result.failed == 0) {
+        WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onEnrollmentsRemoved, result.removed);
+    }
+    if (result.failed > 0) {
+        ALOGE("removeEnrollments: last error %d", result.lastError);
+        WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onError, Error::UNABLE_TO_REMOVE,
+                                           0 /* vendorCode */);
+    }
 }
 
 void HwFingerprintEngine::getAuthenticatorIdImpl() {
+    auto deviceLock = lockDevice([this] { getAuthenticatorIdImpl(); });
+    if (!deviceLock) return;
+
+    FP_TRACE_SPAN("HwFingerprintEngine::getAuthenticatorIdImpl");
     mAuthId = mDevice->get_authenticator_id(mDevice);
     ALOGI("getAuthenticatorIdImpl: %ld", mAuthId);
 
@@ -181,6 +774,10 @@ void HwFingerprintEngine::getAuthenticatorIdImpl() {
 }
 
 void HwFingerprintEngine::invalidateAuthenticatorIdImpl() {
+    auto deviceLock = lockDevice([this] { invalidateAuthenticatorIdImpl(); });
+    if (!deviceLock) return;
+
+    FP_TRACE_SPAN("HwFingerprintEngine::invalidateAuthenticatorIdImpl");
     ALOGI("invalidateAuthenticatorIdImpl: %ld", mAuthId);
 
     WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onAuthenticatorIdInvalidated, mAuthId);
@@ -188,11 +785,17 @@ void HwFingerprintEngine::invalidateAuthenticatorIdImpl() {
 }
 
 ndk::ScopedAStatus HwFingerprintEngine::cancelImpl() {
+    auto deviceLock = lockDevice([this] { cancelImpl(); });
+    if (!deviceLock) return ndk::ScopedAStatus::ok();
+
+    FP_TRACE_SPAN("HwFingerprintEngine::cancelImpl");
     ALOGI("cancelImpl");
 
+    mDetecting = false;
     int ret = mDevice->cancel(mDevice);
 
     if (ret == 0) {
+        mOperationInFlight = false;
         WEAK_SESSION_CALLBACK_OR_LOG_ERROR(mSession, onError, Error::CANCELED, 0 /* vendorCode */);
         return ndk::ScopedAStatus::ok();
     } else {
@@ -202,85 +805,126 @@ ndk::ScopedAStatus HwFingerprintEngine::cancelImpl() {
 
 // Translate from errors returned by traditional HAL (see fingerprint.h) to AIDL-compliant Error
 Error HwFingerprintEngine::VendorErrorFilter(int32_t error, int32_t* vendorCode) {
-    *vendorCode = 0;
+    mErrorCounts.count(error, FINGERPRINT_ERROR_VENDOR_BASE);
 
-    switch (error) {
-        case FINGERPRINT_ERROR_HW_UNAVAILABLE:
-            return Error::HW_UNAVAILABLE;
-        case FINGERPRINT_ERROR_UNABLE_TO_PROCESS:
-            return Error::UNABLE_TO_PROCESS;
-        case FINGERPRINT_ERROR_TIMEOUT:
-            return Error::TIMEOUT;
-        case FINGERPRINT_ERROR_NO_SPACE:
-            return Error::NO_SPACE;
-        case FINGERPRINT_ERROR_CANCELED:
-            return Error::CANCELED;
-        case FINGERPRINT_ERROR_UNABLE_TO_REMOVE:
-            return Error::UNABLE_TO_REMOVE;
-        case FINGERPRINT_ERROR_LOCKOUT: {
-            *vendorCode = FINGERPRINT_ERROR_LOCKOUT;
-            return Error::VENDOR;
-        }
-        default:
-            if (error >= FINGERPRINT_ERROR_VENDOR_BASE) {
-                // vendor specific code.
-                *vendorCode = error - FINGERPRINT_ERROR_VENDOR_BASE;
-                return Error::VENDOR;
-            }
+    Error result;
+    if (mVendorCodes->errors.translate(error, &result, vendorCode)) {
+        return result;
     }
+    *vendorCode = 0;
     ALOGE("Unknown error from fingerprint vendor library: %d", error);
     return Error::UNABLE_TO_PROCESS;
 }
 
 // Translate acquired messages returned by traditional HAL (see fingerprint.h) to AIDL-compliant AcquiredInfo
 AcquiredInfo HwFingerprintEngine::VendorAcquiredFilter(int32_t info, int32_t* vendorCode) {
-    *vendorCode = 0;
+    mAcquiredCounts.count(info, FINGERPRINT_ACQUIRED_VENDOR_BASE);
 
-    switch (info) {
-        case FINGERPRINT_ACQUIRED_GOOD:
-            return AcquiredInfo::GOOD;
-        case FINGERPRINT_ACQUIRED_PARTIAL:
-            return AcquiredInfo::PARTIAL;
-        case FINGERPRINT_ACQUIRED_INSUFFICIENT:
-            return AcquiredInfo::INSUFFICIENT;
-        case FINGERPRINT_ACQUIRED_IMAGER_DIRTY:
-            return AcquiredInfo::SENSOR_DIRTY;
-        case FINGERPRINT_ACQUIRED_TOO_SLOW:
-            return AcquiredInfo::TOO_SLOW;
-        case FINGERPRINT_ACQUIRED_TOO_FAST:
-            return AcquiredInfo::TOO_FAST;
-        default:
-            if (info >= FINGERPRINT_ACQUIRED_VENDOR_BASE) {
-                // vendor specific code.
-                *vendorCode = info - FINGERPRINT_ACQUIRED_VENDOR_BASE;
-                return AcquiredInfo::VENDOR;
-            }
+    AcquiredInfo result;
+    if (!mVendorCodes->acquired.translate(info, &result, vendorCode)) {
+        *vendorCode = 0;
+        ALOGE("Unknown acquired message from fingerprint vendor library: %d", info);
+        result = AcquiredInfo::INSUFFICIENT;
     }
-    ALOGE("Unknown acquired message from fingerprint vendor library: %d", info);
-    return AcquiredInfo::INSUFFICIENT;
+    size_t index = static_cast<size_t>(result);
+    if (index < kAcquiredInfoCount) {
+        mAttemptAcquired[index]++;
+    }
+    return result;
 }
 
-void HwFingerprintEngine::notify(const fingerprint_msg_t* msg) {
-    HwFingerprintEngine* thisPtr = sInstance;
+void HwFingerprintEngine::dump(int fd) {
+    auto dumpCounters = [fd](const char* name, const VendorCodeCounters& counters) {
+        dprintf(fd, "  %s:", name);
+        for (int32_t code = 0; code < kDenseCodes; code++) {
+            uint32_t count = counters.legacy[code].load(std::memory_order_relaxed);
+            if (count) dprintf(fd, " %d=%u", code, count);
+        }
+        for (int32_t code = 0; code < kDenseCodes; code++) {
+            uint32_t count = counters.vendor[code].load(std::memory_order_relaxed);
+            if (count) dprintf(fd, " vendor+%d=%u", code, count);
+        }
+        uint32_t other = counters.other.load(std::memory_order_relaxed);
+        if (other) dprintf(fd, " other=%u", other);
+        dprintf(fd, "\n");
+    };
+
+    dprintf(fd, "Vendor codes (legacy values):\n");
+    dumpCounters("errors", mErrorCounts);
+    dumpCounters("acquired", mAcquiredCounts);
+
+    uint32_t matches = mMatches.load(std::memory_order_relaxed);
+    dprintf(fd, "  acquired before %u matches:", matches);
+    for (size_t i = 0; i < kAcquiredInfoCount; i++) {
+        uint32_t count = mAcquiredBeforeMatch[i].load(std::memory_order_relaxed);
+        if (count == 0) continue;
+        dprintf(fd, " %s=%u (%.2f/match)",
+                ::android::internal::ToString(static_cast<AcquiredInfo>(i)).c_str(), count,
+                matches ? static_cast<double>(count) / matches : 0.0);
+    }
+    dprintf(fd, "\n");
+
+    uint32_t groupCalls = mActiveGroupCalls.load(std::memory_order_relaxed);
+    dprintf(fd, "  set_active_group: %u calls, avg %.2f ms, %u skipped\n", groupCalls,
+            groupCalls ? mActiveGroupCostUs.load(std::memory_order_relaxed) / 1000.0 / groupCalls
+                       : 0.0,
+            mActiveGroupSkipped.load(std::memory_order_relaxed));
+
+    dprintf(fd, "  recoveries: %u (last took %.2f ms), unknown messages: %u\n",
+            mRecoveries.load(std::memory_order_relaxed),
+            mLastRecoveryUs.load(std::memory_order_relaxed) / 1000.0,
+            mUnknownMessages.load(std::memory_order_relaxed));
+
+    uint32_t detections = mDetections.load(std::memory_order_relaxed);
+    dprintf(fd, "  interactions detected: %u, avg latency: %.2f ms\n", detections,
+            detections ? mDetectLatencyUs.load(std::memory_order_relaxed) / 1000.0 / detections
+                       : 0.0);
+}
+
+void HwFingerprintEngine::notify(HwFingerprintEngine* thisPtr, const fingerprint_msg_t* msg) {
+    FP_TRACE_SPAN("HwFingerprintEngine::notify");
 
     if (thisPtr == nullptr) {
         ALOGE("Receiving callbacks before the engine is initialized");
         return;
     }
 
+    if (MessageCapture::get().enabled()) {
+        MessageCapture::get().record(msg);
+    }
+
     if (auto session = thisPtr->mSession.lock()) {
         LockoutTracker& lockoutTracker = session->mLockoutTracker;
         auto cb = session->mCb;
+        if (msg->type == FINGERPRINT_ERROR || msg->type == FINGERPRINT_AUTHENTICATED ||
+            (msg->type == FINGERPRINT_TEMPLATE_ENROLLING &&
+             msg->data.enroll.samples_remaining == 0)) {
+            thisPtr->mOperationInFlight = false;
+        }
+        if (thisPtr->handleDetectMessage(msg, cb)) {
+            return;
+        }
+        std::optional<ScopedLatency> latency;
+        if (auto id = notifyLatency(msg->type)) latency.emplace(*id);
         switch (msg->type) {
             case FINGERPRINT_ERROR: {
                 int32_t vendorCode = 0;
-                Error result = VendorErrorFilter(msg->data.error, &vendorCode);
+                Error result = thisPtr->VendorErrorFilter(msg->data.error, &vendorCode);
                 ALOGD("onError(%d, %d)", result, vendorCode);
+                FingerprintMetrics::get().error(result, vendorCode);
+                FP_TRACE_ATTEMPT(endAttempt, false);
+                thisPtr->mAttemptAcquired.fill(0);
+                if (result == Error::UNABLE_TO_REMOVE &&
+                    thisPtr->failPendingRemoval(msg->data.error)) {
+                    // Reported together with the templates removed so far
+                    break;
+                }
                 cb->onError(result, vendorCode);
             } break;
             case FINGERPRINT_ACQUIRED: {
                 int32_t vendorCode = 0;
-                AcquiredInfo result = VendorAcquiredFilter(msg->data.acquired.acquired_info, &vendorCode);
+                AcquiredInfo result = thisPtr->VendorAcquiredFilter(msg->data.acquired.acquired_info, &vendorCode);
+                FP_TRACE_ATTEMPT(markAttempt, AttemptStage::ACQUIRED);
                 if (result != AcquiredInfo::VENDOR) {
                     ALOGD("onAcquired(%d, %d)", result, vendorCode);
                     cb->onAcquired(result, vendorCode);
@@ -292,44 +936,73 @@ void HwFingerprintEngine::notify(const fingerprint_msg_t* msg) {
             case FINGERPRINT_TEMPLATE_ENROLLING: {
                 ALOGD("onEnrollResult(fid=%d, gid=%d, rem=%d)", msg->data.enroll.finger.fid,
                       msg->data.enroll.finger.gid, msg->data.enroll.samples_remaining);
+                if (msg->data.enroll.samples_remaining == 0) {
+                    std::lock_guard<std::mutex> lock(thisPtr->mEnrollmentsLock);
+                    thisPtr->mEnrolledIds.insert(msg->data.enroll.finger.fid);
+                }
+                FP_METRICS_INCREMENT(ENROLLMENT_STEP);
                 cb->onEnrollmentProgress(msg->data.enroll.finger.fid, msg->data.enroll.samples_remaining);
             } break;
             case FINGERPRINT_TEMPLATE_REMOVED: {
                 ALOGD("onRemove(fid=%d, gid=%d, rem=%d)", msg->data.removed.finger.fid,
                       msg->data.removed.finger.gid, msg->data.removed.remaining_templates);
-                std::vector<int> enrollments;
-                enrollments.push_back(msg->data.removed.finger.fid);
-                cb->onEnrollmentsRemoved(enrollments);
+                thisPtr->onTemplateRemoved(msg->data.removed.finger.fid,
+                                           msg->data.removed.remaining_templates);
             } break;
             case FINGERPRINT_AUTHENTICATED: {
                 ALOGD("onAuthenticated(fid=%d, gid=%d)", msg->data.authenticated.finger.fid,
                     msg->data.authenticated.finger.gid);
+                FP_TRACE_ATTEMPT(markAttempt, AttemptStage::MATCH);
+                if (msg->data.authenticated.finger.fid != 0) {
+                    thisPtr->mMatches.fetch_add(1, std::memory_order_relaxed);
+                    for (size_t i = 0; i < kAcquiredInfoCount; i++) {
+                        thisPtr->mAcquiredBeforeMatch[i].fetch_add(thisPtr->mAttemptAcquired[i],
+                                                                   std::memory_order_relaxed);
+                    }
+                }
+                thisPtr->mAttemptAcquired.fill(0);
                 if (msg->data.authenticated.finger.fid != 0) {
-                    const hw_auth_token_t hat = msg->data.authenticated.hat;
-                    HardwareAuthToken authToken;
-                    translate(hat, authToken);
+                    HardwareAuthToken& authToken = thisPtr->mAuthToken;
+                    translate(msg->data.authenticated.hat, authToken);
                     cb->onAuthenticationSucceeded(msg->data.authenticated.finger.fid, authToken);
+                    FP_TRACE_ATTEMPT(endAttempt, true);
+                    FP_METRICS_INCREMENT(AUTHENTICATION_SUCCEEDED);
                     lockoutTracker.reset(true);
                 } else {
                     cb->onAuthenticationFailed();
+                    FP_TRACE_ATTEMPT(endAttempt, false);
+                    FP_METRICS_INCREMENT(AUTHENTICATION_FAILED);
                     lockoutTracker.addFailedAttempt();
-                    session->checkSensorLockout();
+                    if (session->checkSensorLockout()) {
+                        if (lockoutTracker.getMode() == LockoutMode::PERMANENT) {
+                            FP_METRICS_INCREMENT(LOCKOUT_PERMANENT);
+                        } else {
+                            FP_METRICS_INCREMENT(LOCKOUT_TIMED);
+                        }
+                    }
                 }
             } break;
             case FINGERPRINT_TEMPLATE_ENUMERATING: {
                 ALOGD("onEnumerate(fid=%d, gid=%d, rem=%d)", msg->data.enumerated.finger.fid,
                       msg->data.enumerated.finger.gid, msg->data.enumerated.remaining_templates);
-                static std::vector<int> enrollments;
-                enrollments.push_back(msg->data.enumerated.finger.fid);
-                if (msg->data.enumerated.remaining_templates == 0) {
-                    cb->onEnrollmentsEnumerated(enrollments);
-                    enrollments.clear();
+                std::vector<int32_t> enrollments;
+                {
+                    std::lock_guard<std::mutex> lock(thisPtr->mEnrollmentsLock);
+                    thisPtr->mEnumerated.push_back(msg->data.enumerated.finger.fid);
+                    if (msg->data.enumerated.remaining_templates != 0) break;
+                    enrollments.swap(thisPtr->mEnumerated);
+                    thisPtr->mEnrolledIds.clear();
+                    for (int32_t fid : enrollments) {
+                        if (fid != 0) thisPtr->mEnrolledIds.insert(fid);
+                    }
                 }
+                cb->onEnrollmentsEnumerated(enrollments);
             } break;
 
             default:
                 ALOGE("%s: Unknown message: %u", __func__, msg->type);
-                abort();
+                thisPtr->mUnknownMessages.fetch_add(1, std::memory_order_relaxed);
+                thisPtr->requestRecovery("unknown message");
                 break;
         }
     } else {
@@ -15,7 +15,15 @@ namespace hardware {
 namespace biometrics {
 namespace fingerprint {
 
+LockoutTracker::LockoutTracker(const LockoutTracker& other) : mConfig(other.mConfig) {
+    std::lock_guard<std::mutex> lock(other.mLock);
+    mFailedCount = other.mFailedCount;
+    mLockoutTimedStart = other.mLockoutTimedStart;
+    mCurrentMode = other.mCurrentMode;
+}
+
 void LockoutTracker::reset(bool clearAttemptCounter) {
+    std::lock_guard<std::mutex> lock(mLock);
     if (clearAttemptCounter)
         mFailedCount = 0;
     mLockoutTimedStart = 0;
@@ -23,19 +31,21 @@ void LockoutTracker::reset(bool clearAttemptCounter) {
 }
 
 void LockoutTracker::addFailedAttempt() {
+    std::lock_guard<std::mutex> lock(mLock);
     mFailedCount++;
 
-    if (mFailedCount >= LOCKOUT_PERMANENT_THRESHOLD)
+    if (mFailedCount >= mConfig.permanentThreshold)
         mCurrentMode = LockoutMode::PERMANENT;
-    else if (mFailedCount >= LOCKOUT_TIMED_THRESHOLD) {
+    else if (mFailedCount >= mConfig.timedThreshold) {
         mCurrentMode = LockoutMode::TIMED;
         mLockoutTimedStart = Util::getSystemNanoTime();
     }
 }
 
 LockoutMode LockoutTracker::getMode() {
+    std::lock_guard<std::mutex> lock(mLock);
     if (mCurrentMode == LockoutMode::TIMED) {
-        if (Util::hasElapsed(mLockoutTimedStart, LOCKOUT_TIMED_DURATION)) {
+        if (Util::hasElapsed(mLockoutTimedStart, mConfig.timedDurationMs)) {
             mCurrentMode = LockoutMode::NONE;
             mLockoutTimedStart = 0;
         }
@@ -45,12 +55,13 @@ LockoutMode LockoutTracker::getMode() {
 }
 
 int64_t LockoutTracker::getLockoutTimeLeft() {
+    std::lock_guard<std::mutex> lock(mLock);
     int64_t res = 0;
 
     if (mLockoutTimedStart > 0) {
         auto now = Util::getSystemNanoTime();
         auto elapsed = (now - mLockoutTimedStart) / 1000000LL;
-        res = LOCKOUT_TIMED_DURATION - elapsed;
+        res = mConfig.timedDurationMs - elapsed;
     }
 
     return res;
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "FingerprintCapture"
+
+#include <MessageCapture.h>
+
+#include <android-base/file.h>
+#include <log/log.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <ctime>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+int64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Keeps 0, which means no finger or every finger, and equal ids equal
+int32_t hashId(uint32_t id, uint32_t salt) {
+    if (id == 0) return 0;
+    uint32_t hash = 2166136261u ^ salt;
+    for (int shift = 0; shift < 32; shift += 8) {
+        hash ^= (id >> shift) & 0xff;
+        hash *= 16777619u;
+    }
+    return static_cast<int32_t>((hash & 0x7fffffff) | 1);
+}
+}  // namespace
+
+MessageCapture& MessageCapture::get() {
+    static MessageCapture sInstance;
+    return sInstance;
+}
+
+void MessageCapture::start() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (getrandom(&mSalt, sizeof(mSalt), 0) != sizeof(mSalt)) {
+        mSalt = static_cast<uint32_t>(now());
+    }
+    mStartNs = now();
+    mNext = 0;
+    mEnabled.store(true, std::memory_order_relaxed);
+}
+
+void MessageCapture::stop() {
+    mEnabled.store(false, std::memory_order_relaxed);
+}
+
+void MessageCapture::record(const fingerprint_msg_t* msg) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!enabled()) return;
+    mMessages[mNext++ % kMaxMessages] = encode(*msg, now() - mStartNs, mSalt);
+}
+
+CapturedMessage MessageCapture::encode(const fingerprint_msg_t& msg, uint64_t timeNs,
+                                       uint32_t salt) {
+    CapturedMessage captured = {timeNs, msg.type, {0, 0, 0}};
+    int32_t* args = captured.args;
+    switch (msg.type) {
+        case FINGERPRINT_ERROR:
+            args[0] = msg.data.error;
+            break;
+        case FINGERPRINT_ACQUIRED:
+            args[0] = msg.data.acquired.acquired_info;
+            break;
+        case FINGERPRINT_TEMPLATE_ENROLLING:
+            args[0] = hashId(msg.data.enroll.finger.fid, salt);
+            args[1] = hashId(msg.data.enroll.finger.gid, salt);
+            args[2] = static_cast<int32_t>(msg.data.enroll.samples_remaining);
+            break;
+        case FINGERPRINT_TEMPLATE_REMOVED:
+            args[0] = hashId(msg.data.removed.finger.fid, salt);
+            args[1] = hashId(msg.data.removed.finger.gid, salt);
+            args[2] = static_cast<int32_t>(msg.data.removed.remaining_templates);
+            break;
+        case FINGERPRINT_AUTHENTICATED:
+            // The auth token is left out on purpose
+            args[0] = hashId(msg.data.authenticated.finger.fid, salt);
+            args[1] = hashId(msg.data.authenticated.finger.gid, salt);
+            break;
+        case FINGERPRINT_TEMPLATE_ENUMERATING:
+            args[0] = hashId(msg.data.enumerated.finger.fid, salt);
+            args[1] = hashId(msg.data.enumerated.finger.gid, salt);
+            args[2] = static_cast<int32_t>(msg.data.enumerated.remaining_templates);
+            break;
+        default:
+            break;
+    }
+    return captured;
+}
+
+fingerprint_msg_t MessageCapture::decode(const CapturedMessage& captured) {
+    fingerprint_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = static_cast<fingerprint_msg_type_t>(captured.type);
+    const int32_t* args = captured.args;
+    switch (captured.type) {
+        case FINGERPRINT_ERROR:
+            msg.data.error = static_cast<fingerprint_error_t>(args[0]);
+            break;
+        case FINGERPRINT_ACQUIRED:
+            msg.data.acquired.acquired_info = static_cast<fingerprint_acquired_info_t>(args[0]);
+            break;
+        case FINGERPRINT_TEMPLATE_ENROLLING:
+            msg.data.enroll.finger = {static_cast<uint32_t>(args[1]),
+                                      static_cast<uint32_t>(args[0])};
+            msg.data.enroll.samples_remaining = static_cast<uint32_t>(args[2]);
+            break;
+        case FINGERPRINT_TEMPLATE_REMOVED:
+            msg.data.removed.finger = {static_cast<uint32_t>(args[1]),
+                                       static_cast<uint32_t>(args[0])};
+            msg.data.removed.remaining_templates = static_cast<uint32_t>(args[2]);
+            break;
+        case FINGERPRINT_AUTHENTICATED:
+            msg.data.authenticated.finger = {static_cast<uint32_t>(args[1]),
+                                             static_cast<uint32_t>(args[0])};
+            break;
+        case FINGERPRINT_TEMPLATE_ENUMERATING:
+            msg.data.enumerated.finger = {static_cast<uint32_t>(args[1]),
+                                          static_cast<uint32_t>(args[0])};
+            msg.data.enumerated.remaining_templates = static_cast<uint32_t>(args[2]);
+            break;
+        default:
+            break;
+    }
+    return msg;
+}
+
+void MessageCapture::dump(int fd) {
+    std::vector<CapturedMessage> messages;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        uint64_t first = mNext > kMaxMessages ? mNext - kMaxMessages : 0;
+        for (uint64_t i = first; i < mNext; i++) {
+            messages.push_back(mMessages[i % kMaxMessages]);
+        }
+    }
+
+    CaptureHeader header = {};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.count = static_cast<uint32_t>(messages.size());
+    if (!::android::base::WriteFully(fd, &header, sizeof(header)) ||
+        !::android::base::WriteFully(fd, messages.data(),
+                                     messages.size() * sizeof(CapturedMessage))) {
+        ALOGE("Can't write the capture: %s", strerror(errno));
+    }
+}
+
+bool MessageCapture::read(int fd, std::vector<CapturedMessage>* messages) {
+    CaptureHeader header;
+    if (!::android::base::ReadFully(fd, &header, sizeof(header)) ||
+        memcmp(header.magic, kMagic, sizeof(kMagic)) || header.version != kVersion) {
+        ALOGE("Not a fingerprint capture");
+        return false;
+    }
+    // dump never writes more than kMaxMessages, and a file has to hold them all.
+    // Checked before allocating, the count comes from whoever made the file.
+    struct stat st;
+    if (header.count > kMaxMessages) {
+        ALOGE("Capture claims %u messages, at most %zu are kept", header.count, kMaxMessages);
+        return false;
+    }
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        if (offset < 0 || st.st_size - offset <
+                                  static_cast<off_t>(header.count * sizeof(CapturedMessage))) {
+            ALOGE("Capture truncated, expected %u messages", header.count);
+            return false;
+        }
+    }
+    messages->resize(header.count);
+    if (!::android::base::ReadFully(fd, messages->data(),
+                                    messages->size() * sizeof(CapturedMessage))) {
+        ALOGE("Capture truncated, expected %u messages", header.count);
+        return false;
+    }
+    return true;
+}
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
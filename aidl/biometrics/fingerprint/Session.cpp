@@ -5,8 +5,14 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <chrono>
+#include <cinttypes>
+#include <future>
 #include <thread>
+#include <utility>
 
+#include <FingerprintMetrics.h>
+#include <FingerprintTrace.h>
 #include <Session.h>
 
 #include "CancellationSignal.h"
@@ -17,115 +23,176 @@ namespace hardware {
 namespace biometrics {
 namespace fingerprint {
 
+using Latency = FingerprintMetrics::Latency;
+
 FingerprintEngine::~FingerprintEngine() {}
 
+namespace {
+struct DeathCookie {
+    std::weak_ptr<Session> session;
+};
+}  // namespace
+
 void onClientDeath(void* cookie) {
     ALOGI("FingerprintService has died");
-    Session* session = static_cast<Session*>(cookie);
+    auto session = static_cast<DeathCookie*>(cookie)->session.lock();
     if (session && !session->isClosed()) {
         session->close();
     }
 }
 
-Session::Session(std::shared_ptr<FingerprintEngine> engine,
+void onClientDeathUnlinked(void* cookie) {
+    delete static_cast<DeathCookie*>(cookie);
+}
+
+Session::Session(std::shared_ptr<FingerprintEngine> engine, std::shared_ptr<WorkerThread> worker,
             std::shared_ptr<ISessionCallback> cb, LockoutTracker lockoutTracker)
-            : mEngine(engine), mCb(cb),
-              mLockoutTracker(lockoutTracker) {
+            : mLockoutTracker(lockoutTracker), mEngine(engine), mWorker(worker) {
+    mOperations = SharedRefBase::make<OperationCallback>(cb);
+    mCb = mOperations;
     mDeathRecipient = AIBinder_DeathRecipient_new(onClientDeath);
+    AIBinder_DeathRecipient_setOnUnlinked(mDeathRecipient, onClientDeathUnlinked);
+}
+
+Session::~Session() {
+    mOperations->abortAll();
+    // Unlinks from every binder, which frees the cookies
+    AIBinder_DeathRecipient_delete(mDeathRecipient);
 }
 
 ndk::ScopedAStatus Session::generateChallenge() {
-    mEngine->generateChallengeImpl();
+    FP_TRACE_SPAN("Session::generateChallenge");
+    generateChallengeAsync();
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::revokeChallenge(int64_t challenge) {
-    mEngine->revokeChallengeImpl(challenge);
+    FP_TRACE_SPAN("Session::revokeChallenge");
+    revokeChallengeAsync(challenge);
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::enroll(const HardwareAuthToken& hat,
                                    std::shared_ptr<ICancellationSignal>* out) {
-    mEngine->enrollImpl(hat);
-    *out = SharedRefBase::make<CancellationSignal>(this);
+    FP_TRACE_SPAN("Session::enroll");
+    *out = SharedRefBase::make<CancellationSignal>(ref<Session>(), enrollAsync(hat)->id());
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::authenticate(int64_t operationId,
                                          std::shared_ptr<ICancellationSignal>* out) {
-    mEngine->authenticateImpl(operationId);
-    *out = SharedRefBase::make<CancellationSignal>(this);
+    FP_TRACE_SPAN("Session::authenticate");
+    *out = SharedRefBase::make<CancellationSignal>(ref<Session>(),
+                                                   authenticateAsync(operationId)->id());
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::detectInteraction(std::shared_ptr<ICancellationSignal>* out) {
-    mEngine->detectInteractionImpl();
-    *out = SharedRefBase::make<CancellationSignal>(this);
+    FP_TRACE_SPAN("Session::detectInteraction");
+    *out = SharedRefBase::make<CancellationSignal>(ref<Session>(), detectInteractionAsync()->id());
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::enumerateEnrollments() {
-    mEngine->enumerateEnrollmentsImpl();
+    FP_TRACE_SPAN("Session::enumerateEnrollments");
+    enumerateEnrollmentsAsync();
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::removeEnrollments(const std::vector<int32_t>& enrollmentIds) {
-    mEngine->removeEnrollmentsImpl(enrollmentIds);
+    FP_TRACE_SPAN("Session::removeEnrollments");
+    removeEnrollmentsAsync(enrollmentIds);
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::getAuthenticatorId() {
-    mEngine->getAuthenticatorIdImpl();
+    FP_TRACE_SPAN("Session::getAuthenticatorId");
+    getAuthenticatorIdAsync();
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::invalidateAuthenticatorId() {
-    mEngine->invalidateAuthenticatorIdImpl();
+    FP_TRACE_SPAN("Session::invalidateAuthenticatorId");
+    invalidateAuthenticatorIdAsync();
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::resetLockout(const HardwareAuthToken& /*hat*/) {
+    FP_TRACE_SPAN("Session::resetLockout");
     ALOGI("resetLockout");
 
-    clearLockout(true);
-    mIsLockoutTimerAborted = true;
+    // onLockoutCleared goes out from the worker, like every other callback
+    auto reset = [session = ref<Session>()] {
+        session->clearLockout(true);
+        session->mIsLockoutTimerAborted = true;
+    };
+    if (!post(reset)) {
+        ALOGE("resetLockout: worker queue is full, resetting on the binder thread");
+        reset();
+    }
 
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::onPointerDown(int32_t pointerId, int32_t x, int32_t y, float minor, float major) {
-    mEngine->onPointerDownImpl(pointerId, x, y, minor, major);
-    checkSensorLockout();
+    FP_TRACE_SPAN("Session::onPointerDown");
+    FP_TRACE_ATTEMPT(markAttempt, AttemptStage::POINTER_DOWN);
+    schedule(Latency::POINTER_DOWN, [session = ref<Session>(), pointerId, x, y, minor, major] {
+        // Don't wake the sensor for a capture that would be rejected anyway. The rest of
+        // the touch follows the same decision, so the engine sees either all or none of
+        // it. Checked here so the lockout callbacks stay in order with the engine's.
+        session->mTouchGated = session->checkSensorLockout();
+        if (session->mTouchGated) return;
+        session->mEngine->pointerDown(pointerId, x, y, minor, major);
+    });
 
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::onPointerUp(int32_t pointerId) {
-    mEngine->onPointerUpImpl(pointerId);
+    FP_TRACE_SPAN("Session::onPointerUp");
+    schedule(Latency::POINTER_UP, [session = ref<Session>(), pointerId] {
+        if (std::exchange(session->mTouchGated, false)) return;
+        session->mEngine->pointerUp(pointerId);
+    });
 
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::onUiReady() {
-    mEngine->onUiReadyImpl();
+    FP_TRACE_SPAN("Session::onUiReady");
+    FP_TRACE_ATTEMPT(markAttempt, AttemptStage::UI_READY);
+    schedule(Latency::UI_READY, [session = ref<Session>()] {
+        if (session->mTouchGated) return;
+        session->mEngine->uiReady();
+    });
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Session::authenticateWithContext(
-        int64_t operationId, const common::OperationContext& /*context*/,
+        int64_t operationId, const common::OperationContext& context,
         std::shared_ptr<common::ICancellationSignal>* out) {
+    schedule(Latency::CONTEXT_CHANGED, [engine = mEngine, context] {
+        engine->onContextChangedImpl(context);
+    });
     return authenticate(operationId, out);
 }
 
 ndk::ScopedAStatus Session::enrollWithContext(const keymaster::HardwareAuthToken& hat,
-                                              const common::OperationContext& /*context*/,
+                                              const common::OperationContext& context,
                                               std::shared_ptr<common::ICancellationSignal>* out) {
+    schedule(Latency::CONTEXT_CHANGED, [engine = mEngine, context] {
+        engine->onContextChangedImpl(context);
+    });
     return enroll(hat, out);
 }
 
 ndk::ScopedAStatus Session::detectInteractionWithContext(
-        const common::OperationContext& /*context*/,
+        const common::OperationContext& context,
         std::shared_ptr<common::ICancellationSignal>* out) {
+    schedule(Latency::CONTEXT_CHANGED, [engine = mEngine, context] {
+        engine->onContextChangedImpl(context);
+    });
     return detectInteraction(out);
 }
 
@@ -137,7 +204,11 @@ ndk::ScopedAStatus Session::onPointerUpWithContext(const PointerContext& context
     return onPointerUp(context.pointerId);
 }
 
-ndk::ScopedAStatus Session::onContextChanged(const common::OperationContext& /*context*/) {
+ndk::ScopedAStatus Session::onContextChanged(const common::OperationContext& context) {
+    FP_TRACE_SPAN("Session::onContextChanged");
+    schedule(Latency::CONTEXT_CHANGED, [engine = mEngine, context] {
+        engine->onContextChangedImpl(context);
+    });
     return ndk::ScopedAStatus::ok();
 }
 
@@ -149,26 +220,153 @@ ndk::ScopedAStatus Session::setIgnoreDisplayTouches(bool /*shouldIgnore*/) {
     return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Session::cancel() {
-    return mEngine->cancelImpl();
+std::shared_ptr<Operation> Session::generateChallengeAsync() {
+    return start(OperationType::GENERATE_CHALLENGE, Latency::GENERATE_CHALLENGE,
+                 [engine = mEngine] { engine->generateChallengeImpl(); });
+}
+
+std::shared_ptr<Operation> Session::revokeChallengeAsync(int64_t challenge) {
+    return start(OperationType::REVOKE_CHALLENGE, Latency::REVOKE_CHALLENGE,
+                 [engine = mEngine, challenge] { engine->revokeChallengeImpl(challenge); });
+}
+
+std::shared_ptr<Operation> Session::enrollAsync(const HardwareAuthToken& hat) {
+    return start(OperationType::ENROLL, Latency::ENROLL,
+                 [engine = mEngine, hat] { engine->enrollImpl(hat); });
+}
+
+std::shared_ptr<Operation> Session::authenticateAsync(int64_t operationId) {
+    FP_METRICS_INCREMENT(AUTHENTICATE);
+    return start(OperationType::AUTHENTICATE, Latency::AUTHENTICATE,
+                 [engine = mEngine, operationId] { engine->authenticateImpl(operationId); });
+}
+
+std::shared_ptr<Operation> Session::detectInteractionAsync() {
+    return start(OperationType::DETECT_INTERACTION, Latency::DETECT_INTERACTION,
+                 [engine = mEngine] { engine->detectInteractionImpl(); });
+}
+
+std::shared_ptr<Operation> Session::enumerateEnrollmentsAsync() {
+    return start(OperationType::ENUMERATE_ENROLLMENTS, Latency::ENUMERATE_ENROLLMENTS,
+                 [engine = mEngine] { engine->enumerateEnrollmentsImpl(); });
+}
+
+std::shared_ptr<Operation> Session::removeEnrollmentsAsync(
+        const std::vector<int32_t>& enrollmentIds) {
+    return start(OperationType::REMOVE_ENROLLMENTS, Latency::REMOVE_ENROLLMENTS,
+                 [engine = mEngine, enrollmentIds] {
+                     engine->removeEnrollmentsImpl(enrollmentIds);
+                 });
+}
+
+std::shared_ptr<Operation> Session::getAuthenticatorIdAsync() {
+    return start(OperationType::GET_AUTHENTICATOR_ID, Latency::GET_AUTHENTICATOR_ID,
+                 [engine = mEngine] { engine->getAuthenticatorIdImpl(); });
+}
+
+std::shared_ptr<Operation> Session::invalidateAuthenticatorIdAsync() {
+    return start(OperationType::INVALIDATE_AUTHENTICATOR_ID, Latency::INVALIDATE_AUTHENTICATOR_ID,
+                 [engine = mEngine] { engine->invalidateAuthenticatorIdImpl(); });
+}
+
+ndk::ScopedAStatus Session::cancel(int64_t operationId) {
+    FP_TRACE_SPAN("Session::cancel");
+    std::future<ndk::ScopedAStatus> future = cancelAsync(operationId);
+    // The signal is oneway, so don't hold the binder thread until the worker gets to it
+    if (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        return future.get();
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+std::future<ndk::ScopedAStatus> Session::cancelAsync(int64_t operationId) {
+    std::promise<ndk::ScopedAStatus> done;
+    std::future<ndk::ScopedAStatus> future = done.get_future();
+    // A late signal must not stop the operation that came after
+    if (!mOperations->find(operationId)) {
+        ALOGI("cancel: operation %" PRId64 " already finished", operationId);
+        done.set_value(ndk::ScopedAStatus::ok());
+        return future;
+    }
+
+    FP_METRICS_INCREMENT(CANCEL);
+    // Must run after the operation it cancels, the worker gets to them in order
+    auto result = std::make_shared<std::promise<ndk::ScopedAStatus>>(std::move(done));
+    if (!schedule(Latency::CANCEL, [engine = mEngine, operations = mOperations, operationId,
+                                    result] {
+            // It may have finished, or never started, while the cancel was queued
+            std::shared_ptr<Operation> operation = operations->find(operationId);
+            if (!operation || !operation->started()) {
+                ALOGI("cancel: operation %" PRId64 " no longer running", operationId);
+                result->set_value(ndk::ScopedAStatus::ok());
+                return;
+            }
+            result->set_value(engine->cancelImpl());
+        })) {
+        result->set_value(ndk::ScopedAStatus::fromServiceSpecificError(
+                static_cast<int32_t>(Error::UNABLE_TO_PROCESS)));
+    }
+    return future;
+}
+
+bool Session::schedule(Latency latency, std::function<void()> task) {
+    auto timed = [latency, task = std::move(task)] {
+        FP_METRICS_LATENCY(latency);
+        task();
+    };
+    if (!mWorker->schedule(Callable::from(std::move(timed)))) {
+        ALOGE("Worker queue is full, dropping task");
+        return false;
+    }
+    return true;
+}
+
+bool Session::post(std::function<void()> task) {
+    return mWorker->schedule(Callable::from(std::move(task)));
+}
+
+std::shared_ptr<Operation> Session::start(OperationType type, Latency latency,
+                                          std::function<void()> task) {
+    std::weak_ptr<Session> weakSession = ref<Session>();
+    std::shared_ptr<Operation> operation = mOperations->begin(type, [weakSession](int64_t id) {
+        if (auto session = weakSession.lock()) {
+            session->cancelAsync(id);
+        }
+    });
+    if (!schedule(latency, [operations = mOperations, operation, task = std::move(task)] {
+            operations->start(operation);
+            task();
+        })) {
+        mOperations->abort(operation);
+    }
+    return operation;
 }
 
 ndk::ScopedAStatus Session::close() {
+    FP_TRACE_SPAN("Session::close");
     ALOGI("close");
     mClosed = true;
     mCb->onSessionClosed();
-    AIBinder_DeathRecipient_delete(mDeathRecipient);
     return ndk::ScopedAStatus::ok();
 }
 
 binder_status_t Session::linkToDeath(AIBinder* binder) {
-    return AIBinder_linkToDeath(binder, mDeathRecipient, this);
+    auto cookie = new DeathCookie{ref<Session>()};
+    binder_status_t status = AIBinder_linkToDeath(binder, mDeathRecipient, cookie);
+    if (status != STATUS_OK) {
+        delete cookie;
+    }
+    return status;
 }
 
 bool Session::isClosed() {
     return mClosed;
 }
 
+void Session::dump(int fd) {
+    mOperations->dump(fd);
+}
+
 bool Session::checkSensorLockout() {
     LockoutMode lockoutMode = mLockoutTracker.getMode();
     if (lockoutMode == LockoutMode::PERMANENT) {
@@ -180,7 +378,7 @@ bool Session::checkSensorLockout() {
         int64_t timeLeft = mLockoutTracker.getLockoutTimeLeft();
         ALOGE("Fail: lockout timed: %ld", timeLeft);
         mCb->onLockoutTimed(timeLeft);
-        if (!mIsLockoutTimerStarted) startLockoutTimer(timeLeft);
+        startLockoutTimer(timeLeft);
         return true;
     }
     return false;
@@ -192,23 +390,28 @@ void Session::clearLockout(bool clearAttemptCounter) {
 }
 
 void Session::startLockoutTimer(int64_t timeout) {
+    bool started = false;
+    if (!mIsLockoutTimerStarted.compare_exchange_strong(started, true)) {
+        return;
+    }
     mIsLockoutTimerAborted = false;
-    std::function<void()> action =
-            std::bind(&Session::lockoutTimerExpired, this);
-    std::thread([timeout, action]() {
+    std::weak_ptr<Session> weakSession = ref<Session>();
+    std::thread([timeout, weakSession]() {
         std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
-        action();
+        if (auto session = weakSession.lock()) {
+            if (!session->post([session] { session->lockoutTimerExpired(); })) {
+                session->lockoutTimerExpired();
+            }
+        }
     }).detach();
-
-    mIsLockoutTimerStarted = true;
 }
 
 void Session::lockoutTimerExpired() {
     if (!mIsLockoutTimerAborted)
         clearLockout(false);
 
-    mIsLockoutTimerStarted = false;
     mIsLockoutTimerAborted = false;
+    mIsLockoutTimerStarted = false;
 }
 
 } // namespace fingerprint
@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "FingerprintOperations"
+
+#include <SessionOperations.h>
+
+#include <log/log.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <iterator>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+using Status = OperationResult::Status;
+
+namespace {
+constexpr const char* kTypeNames[] = {
+        "generateChallenge",    "revokeChallenge",   "enroll",
+        "authenticate",         "detectInteraction", "enumerateEnrollments",
+        "removeEnrollments",    "getAuthenticatorId", "invalidateAuthenticatorId",
+};
+static_assert(std::size(kTypeNames) == static_cast<size_t>(OperationType::COUNT));
+
+constexpr const char* kStatusNames[] = {
+        "succeeded", "error", "locked out", "canceled", "timed out", "aborted",
+};
+static_assert(std::size(kStatusNames) == static_cast<size_t>(Status::COUNT));
+
+// How long wait() blocks by default. Operations waiting for a finger have none,
+// the others are answered by the vendor HAL straight away.
+constexpr std::chrono::milliseconds kDefaultTimeouts[] = {
+        std::chrono::seconds(2), std::chrono::seconds(2), std::chrono::milliseconds(0),
+        std::chrono::milliseconds(0), std::chrono::milliseconds(0), std::chrono::seconds(2),
+        std::chrono::seconds(2), std::chrono::seconds(2), std::chrono::seconds(2),
+};
+static_assert(std::size(kDefaultTimeouts) == static_cast<size_t>(OperationType::COUNT));
+
+// Operations the framework never saw the end of, e.g. because the vendor HAL
+// dropped a callback. Past this the oldest ones are aborted.
+constexpr size_t kMaxPending = 16;
+
+OperationResult result(Status status, int64_t value = 0) {
+    OperationResult result;
+    result.status = status;
+    result.value = value;
+    return result;
+}
+}  // namespace
+
+const char* toString(OperationType type) {
+    return kTypeNames[static_cast<size_t>(type)];
+}
+
+const char* toString(Status status) {
+    return kStatusNames[static_cast<size_t>(status)];
+}
+
+bool CancellationToken::cancel() const {
+    std::shared_ptr<Operation> operation = mOperation.lock();
+    if (!operation || (operation->done() && !operation->settled())) return false;
+    operation->cancel();
+    return true;
+}
+
+Operation::Operation(int64_t id, OperationType type, std::chrono::milliseconds timeout,
+                     std::function<void(int64_t)> cancel)
+    : mId(id),
+      mType(type),
+      mTimeout(timeout),
+      mCreatedAt(Clock::now()),
+      mCancel(std::move(cancel)),
+      mResult(mPromise.get_future().share()) {}
+
+OperationResult Operation::wait() const {
+    if (mTimeout.count() == 0) {
+        return mResult.get();
+    }
+    if (mResult.wait_until(mCreatedAt + mTimeout) != std::future_status::ready) {
+        return result(Status::TIMED_OUT);
+    }
+    return mResult.get();
+}
+
+OperationResult Operation::waitFor(std::chrono::milliseconds timeout) const {
+    if (mResult.wait_for(timeout) != std::future_status::ready) {
+        return result(Status::TIMED_OUT);
+    }
+    return mResult.get();
+}
+
+void Operation::cancel() {
+    if ((done() && !settled()) || mCancelRequested.exchange(true)) return;
+    if (mCancel) mCancel(mId);
+}
+
+bool Operation::complete(OperationResult result) {
+    if (mDone.exchange(true, std::memory_order_acq_rel)) return false;
+    mPromise.set_value(std::move(result));
+    return true;
+}
+
+OperationCallback::OperationCallback(std::shared_ptr<ISessionCallback> cb) : mCb(std::move(cb)) {}
+
+std::shared_ptr<Operation> OperationCallback::begin(OperationType type,
+                                                    std::function<void(int64_t)> cancel) {
+    auto operation = std::make_shared<Operation>(
+            mNextId.fetch_add(1, std::memory_order_relaxed), type,
+            kDefaultTimeouts[static_cast<size_t>(type)], std::move(cancel));
+
+    std::shared_ptr<Operation> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mPending.size() == kMaxPending) {
+            dropped = std::move(mPending.front());
+            mPending.pop_front();
+            if (dropped->id() == mActive.load(std::memory_order_relaxed)) {
+                mActive.store(0, std::memory_order_relaxed);
+            }
+        }
+        mPending.push_back(operation);
+    }
+    if (dropped) {
+        ALOGW("Operation %" PRId64 " (%s) never finished, aborting it", dropped->id(),
+              toString(dropped->type()));
+        if (dropped->complete(result(Status::ABORTED))) {
+            mResults[static_cast<size_t>(Status::ABORTED)].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return operation;
+}
+
+void OperationCallback::start(const std::shared_ptr<Operation>& operation) {
+    std::shared_ptr<Operation> superseded;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        // Aborted while it was queued
+        if (std::find(mPending.begin(), mPending.end(), operation) == mPending.end()) return;
+        int64_t active = mActive.load(std::memory_order_relaxed);
+        auto it = std::find_if(mPending.begin(), mPending.end(),
+                               [active](const auto& pending) { return pending->id() == active; });
+        if (it != mPending.end()) {
+            // A settled one already has its result
+            if (!(*it)->done()) superseded = *it;
+            mPending.erase(it);
+        }
+        operation->mStarted.store(true, std::memory_order_release);
+        mActive.store(operation->id(), std::memory_order_relaxed);
+    }
+    if (superseded) {
+        ALOGW("Operation %" PRId64 " (%s) never finished before the next one, aborting it",
+              superseded->id(), toString(superseded->type()));
+        if (superseded->complete(result(Status::ABORTED))) {
+            mResults[static_cast<size_t>(Status::ABORTED)].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void OperationCallback::abort(const std::shared_ptr<Operation>& operation) {
+    finish(operation, result(Status::ABORTED));
+}
+
+void OperationCallback::abortAll() {
+    std::deque<std::shared_ptr<Operation>> pending;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        pending.swap(mPending);
+        mActive.store(0, std::memory_order_relaxed);
+    }
+    for (const auto& operation : pending) {
+        if (operation->complete(result(Status::ABORTED))) {
+            mResults[static_cast<size_t>(Status::ABORTED)].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::shared_ptr<Operation> OperationCallback::find(int64_t id) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (const auto& operation : mPending) {
+        if (operation->id() == id) return operation;
+    }
+    return nullptr;
+}
+
+void OperationCallback::finish(const std::shared_ptr<Operation>& operation,
+                               OperationResult result) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = std::find(mPending.begin(), mPending.end(), operation);
+        if (it == mPending.end()) return;
+        if (operation->id() == mActive.load(std::memory_order_relaxed)) {
+            mActive.store(0, std::memory_order_relaxed);
+        }
+        mPending.erase(it);
+    }
+    Status status = result.status;
+    if (operation->complete(std::move(result))) {
+        mResults[static_cast<size_t>(status)].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool OperationCallback::complete(std::initializer_list<OperationType> types,
+                                 OperationResult result, bool settle) {
+    if (mActive.load(std::memory_order_relaxed) == 0) return false;
+
+    std::shared_ptr<Operation> operation;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        int64_t active = mActive.load(std::memory_order_relaxed);
+        auto it = std::find_if(mPending.begin(), mPending.end(),
+                               [active](const auto& pending) { return pending->id() == active; });
+        if (it == mPending.end()) return false;
+        if (types.size() != 0 &&
+            std::find(types.begin(), types.end(), (*it)->type()) == types.end()) {
+            return false;
+        }
+        operation = *it;
+        if (settle) {
+            operation->mSettled.store(true, std::memory_order_release);
+        } else {
+            mPending.erase(it);
+            mActive.store(0, std::memory_order_relaxed);
+        }
+    }
+    Status status = result.status;
+    if (operation->complete(std::move(result))) {
+        mResults[static_cast<size_t>(status)].fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void OperationCallback::dump(int fd) {
+    auto now = Operation::Clock::now();
+    dprintf(fd, "Operations:\n");
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (const auto& operation : mPending) {
+            dprintf(fd, "  #%" PRId64 " %s, %s for %.1f ms\n", operation->id(),
+                    toString(operation->type()),
+                    operation->settled()   ? "settled"
+                    : operation->started() ? "active"
+                                           : "queued",
+                    std::chrono::duration<double, std::milli>(now - operation->createdAt())
+                            .count());
+        }
+    }
+    dprintf(fd, "  results:");
+    for (size_t i = 0; i < mResults.size(); i++) {
+        dprintf(fd, " %s=%u", kStatusNames[i], mResults[i].load(std::memory_order_relaxed));
+    }
+    dprintf(fd, "\n");
+}
+
+ndk::ScopedAStatus OperationCallback::onChallengeGenerated(int64_t challenge) {
+    ndk::ScopedAStatus status = mCb->onChallengeGenerated(challenge);
+    complete({OperationType::GENERATE_CHALLENGE}, result(Status::SUCCEEDED, challenge));
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onChallengeRevoked(int64_t challenge) {
+    ndk::ScopedAStatus status = mCb->onChallengeRevoked(challenge);
+    complete({OperationType::REVOKE_CHALLENGE}, result(Status::SUCCEEDED, challenge));
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onAcquired(AcquiredInfo info, int32_t vendorCode) {
+    return mCb->onAcquired(info, vendorCode);
+}
+
+ndk::ScopedAStatus OperationCallback::onError(Error error, int32_t vendorCode) {
+    ndk::ScopedAStatus status = mCb->onError(error, vendorCode);
+
+    OperationResult failed = result(error == Error::CANCELED ? Status::CANCELED : Status::ERROR);
+    failed.error = error;
+    failed.vendorCode = vendorCode;
+    // An error ends whatever the engine is working on. The vendor library may still
+    // be busy with it though, so keep it cancelable unless the error is the engine
+    // confirming a cancel.
+    complete({}, std::move(failed), error != Error::CANCELED /* settle */);
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onEnrollmentProgress(int32_t enrollmentId,
+                                                           int32_t remaining) {
+    ndk::ScopedAStatus status = mCb->onEnrollmentProgress(enrollmentId, remaining);
+    if (remaining == 0) {
+        complete({OperationType::ENROLL}, result(Status::SUCCEEDED, enrollmentId));
+    }
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onAuthenticationSucceeded(
+        int32_t enrollmentId, const keymaster::HardwareAuthToken& hat) {
+    ndk::ScopedAStatus status = mCb->onAuthenticationSucceeded(enrollmentId, hat);
+    complete({OperationType::AUTHENTICATE}, result(Status::SUCCEEDED, enrollmentId));
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onAuthenticationFailed() {
+    // Not the end, authentication goes on until a match, an error or a lockout
+    return mCb->onAuthenticationFailed();
+}
+
+ndk::ScopedAStatus OperationCallback::onLockoutTimed(int64_t durationMillis) {
+    ndk::ScopedAStatus status = mCb->onLockoutTimed(durationMillis);
+    // Also sent for a touch while locked out, the vendor may still be authenticating
+    complete({OperationType::AUTHENTICATE}, result(Status::LOCKED_OUT, durationMillis),
+             true /* settle */);
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onLockoutPermanent() {
+    ndk::ScopedAStatus status = mCb->onLockoutPermanent();
+    complete({OperationType::AUTHENTICATE}, result(Status::LOCKED_OUT), true /* settle */);
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onLockoutCleared() {
+    return mCb->onLockoutCleared();
+}
+
+ndk::ScopedAStatus OperationCallback::onInteractionDetected() {
+    ndk::ScopedAStatus status = mCb->onInteractionDetected();
+    complete({OperationType::DETECT_INTERACTION}, result(Status::SUCCEEDED));
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onEnrollmentsEnumerated(
+        const std::vector<int32_t>& enrollmentIds) {
+    ndk::ScopedAStatus status = mCb->onEnrollmentsEnumerated(enrollmentIds);
+    OperationResult enumerated = result(Status::SUCCEEDED);
+    enumerated.enrollmentIds = enrollmentIds;
+    complete({OperationType::ENUMERATE_ENROLLMENTS}, std::move(enumerated));
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onEnrollmentsRemoved(
+        const std::vector<int32_t>& enrollmentIds) {
+    ndk::ScopedAStatus status = mCb->onEnrollmentsRemoved(enrollmentIds);
+    OperationResult removed = result(Status::SUCCEEDED);
+    removed.enrollmentIds = enrollmentIds;
+    complete({OperationType::REMOVE_ENROLLMENTS}, std::move(removed));
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onAuthenticatorIdRetrieved(int64_t authenticatorId) {
+    ndk::ScopedAStatus status = mCb->onAuthenticatorIdRetrieved(authenticatorId);
+    complete({OperationType::GET_AUTHENTICATOR_ID}, result(Status::SUCCEEDED, authenticatorId));
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onAuthenticatorIdInvalidated(int64_t authenticatorId) {
+    ndk::ScopedAStatus status = mCb->onAuthenticatorIdInvalidated(authenticatorId);
+    complete({OperationType::INVALIDATE_AUTHENTICATOR_ID},
+             result(Status::SUCCEEDED, authenticatorId));
+    return status;
+}
+
+ndk::ScopedAStatus OperationCallback::onSessionClosed() {
+    ndk::ScopedAStatus status = mCb->onSessionClosed();
+    abortAll();
+    return status;
+}
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
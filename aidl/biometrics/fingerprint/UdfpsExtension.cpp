@@ -1,10 +1,14 @@
 /*
  * Copyright (C) 2022 The LineageOS Project
+ *               2024 Paranoid Android
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 
 #include <compositionengine/UdfpsExtension.h>
+#include <hardware/gralloc.h>
+
+#include <cstdint>
 
 #if __has_include(<display/drm/sde_drm.h>)
 #include <display/drm/sde_drm.h>
@@ -12,17 +16,63 @@
 #include <drm/sde_drm.h>
 #endif
 
-uint32_t getUdfpsZOrder(uint32_t z, bool touched) {
-    if (touched) {
+namespace {
+
+// How the UDFPS layer's z-order and usage are rewritten, indexed by touched.
+// Each value becomes (value & keep) | set, so the per-frame lookup has no branches.
+struct UdfpsBits {
+    uint64_t keep;
+    uint64_t set;
+};
+
+struct UdfpsPanel {
+    UdfpsBits zOrder[2];
+    UdfpsBits usage[2];
+};
+
+constexpr UdfpsBits kUnchanged = {~0ULL, 0};
+
 #ifdef FOD_PRESSED_LAYER_ZORDER
-        z |= FOD_PRESSED_LAYER_ZORDER;
+constexpr UdfpsBits kPressedZOrder = {~0ULL, FOD_PRESSED_LAYER_ZORDER};
 #else
-        z = 0x41000033;
+constexpr UdfpsBits kPressedZOrder = {0, 0x41000033};
 #endif
-    }
-    return z;
+
+// Panels by the name set with SOONG_CONFIG_nubia_udfps_panel, only one of them is used
+namespace panels {
+
+[[maybe_unused]] constexpr UdfpsPanel sde = {
+        .zOrder = {kUnchanged, kPressedZOrder},
+        .usage = {kUnchanged, kUnchanged},
+};
+
+// Panels that only scan out the pressed layer from protected buffers
+[[maybe_unused]] constexpr UdfpsPanel sde_protected = {
+        .zOrder = {kUnchanged, kPressedZOrder},
+        .usage = {kUnchanged, {~0ULL, GRALLOC_USAGE_PROTECTED}},
+};
+
+}  // namespace panels
+
+#ifndef UDFPS_PANEL
+#define UDFPS_PANEL sde
+#endif
+
+constexpr const UdfpsPanel& kPanel = panels::UDFPS_PANEL;
+
+constexpr uint64_t apply(const UdfpsBits& bits, uint64_t value) {
+    return (value & bits.keep) | bits.set;
+}
+
+static_assert(apply(kPanel.zOrder[false], 0x1234) == 0x1234);
+static_assert(apply(kPanel.usage[false], 0x1234) == 0x1234);
+
+}  // namespace
+
+uint32_t getUdfpsZOrder(uint32_t z, bool touched) {
+    return static_cast<uint32_t>(apply(kPanel.zOrder[touched], z));
 }
 
-uint64_t getUdfpsUsageBits(uint64_t usageBits, bool /* touched */) {
-    return usageBits;
+uint64_t getUdfpsUsageBits(uint64_t usageBits, bool touched) {
+    return apply(kPanel.usage[touched], usageBits);
 }
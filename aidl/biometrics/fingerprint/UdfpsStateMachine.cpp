@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <FingerprintEngine.h>
+#include <FingerprintTrace.h>
+#include <UdfpsStateMachine.h>
+
+#include <unistd.h>
+
+#include <iterator>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+constexpr const char* kStateNames[] = {"idle", "finger_down", "ui_ready", "capturing"};
+static_assert(std::size(kStateNames) == static_cast<size_t>(UdfpsState::COUNT));
+}  // namespace
+
+void UdfpsStateMachine::add(Stats& stats, uint64_t us) {
+    stats.count.fetch_add(1, std::memory_order_relaxed);
+    stats.totalUs.fetch_add(us, std::memory_order_relaxed);
+    if (us > stats.maxUs.load(std::memory_order_relaxed)) {
+        stats.maxUs.store(us, std::memory_order_relaxed);
+    }
+}
+
+void UdfpsStateMachine::transition(UdfpsState to) {
+    auto now = Clock::now();
+    auto us = [](Clock::duration d) {
+        return static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    };
+
+    add(mTransitions[static_cast<size_t>(to)], mState == UdfpsState::IDLE ? 0 : us(now - mEnteredAt));
+    if (to == UdfpsState::FINGER_DOWN) {
+        mFingerDownAt = now;
+    } else if (to == UdfpsState::CAPTURING) {
+        add(mPointerToCapture, us(now - mFingerDownAt));
+    } else if (to == UdfpsState::IDLE) {
+        mUiReadyHeld = false;
+    }
+    mState = to;
+    mEnteredAt = now;
+}
+
+void UdfpsStateMachine::holdUiReady() {
+    mUiReadyEarly.fetch_add(1, std::memory_order_relaxed);
+    mUiReadyHeld = true;
+    mUiReadyHeldAt = Clock::now();
+}
+
+bool UdfpsStateMachine::takeHeldUiReady() {
+    if (!mUiReadyHeld) return false;
+    mUiReadyHeld = false;
+    if (Clock::now() - mUiReadyHeldAt > kUiReadyHoldTimeout) {
+        mUiReadyExpired.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void UdfpsStateMachine::dump(int fd) const {
+    dprintf(fd, "  udfps transitions:\n");
+    for (size_t i = 0; i < mTransitions.size(); i++) {
+        const Stats& stats = mTransitions[i];
+        uint32_t count = stats.count.load(std::memory_order_relaxed);
+        dprintf(fd, "    -> %s: %u, avg %.2f ms, max %.2f ms\n", kStateNames[i], count,
+                count ? stats.totalUs.load(std::memory_order_relaxed) / 1000.0 / count : 0.0,
+                stats.maxUs.load(std::memory_order_relaxed) / 1000.0);
+    }
+    uint32_t captures = mPointerToCapture.count.load(std::memory_order_relaxed);
+    dprintf(fd, "  pointer to capture: %u, avg %.2f ms, max %.2f ms\n", captures,
+            captures ? mPointerToCapture.totalUs.load(std::memory_order_relaxed) / 1000.0 / captures
+                     : 0.0,
+            mPointerToCapture.maxUs.load(std::memory_order_relaxed) / 1000.0);
+    dprintf(fd, "  ui ready before pointer down: %u (expired: %u), repeated: %u, ignored events: %u\n",
+            mUiReadyEarly.load(std::memory_order_relaxed),
+            mUiReadyExpired.load(std::memory_order_relaxed),
+            mUiReadyRepeated.load(std::memory_order_relaxed),
+            mIgnored.load(std::memory_order_relaxed));
+}
+
+void FingerprintEngine::pointerDown(int32_t pointerId, int32_t x, int32_t y, float minor,
+                                    float major) {
+    FP_TRACE_SPAN("FingerprintEngine::pointerDown");
+    // Wake the sensor first, SystemUI turns the illumination on meanwhile
+    onPointerDownImpl(pointerId, x, y, minor, major);
+    if (mUdfps.state() != UdfpsState::IDLE) {
+        // Missed pointer up, start over with this touch
+        mUdfps.countIgnored();
+    }
+    mUdfps.transition(UdfpsState::FINGER_DOWN);
+    if (mUdfps.takeHeldUiReady()) {
+        startCapture();
+    }
+}
+
+void FingerprintEngine::uiReady() {
+    FP_TRACE_SPAN("FingerprintEngine::uiReady");
+    switch (mUdfps.state()) {
+        case UdfpsState::IDLE:
+            mUdfps.holdUiReady();
+            break;
+        case UdfpsState::FINGER_DOWN:
+            startCapture();
+            break;
+        default:
+            // Already capturing, the vendor library retries the capture on a repeat
+            mUdfps.countRepeated();
+            onUiReadyImpl();
+            break;
+    }
+}
+
+void FingerprintEngine::pointerUp(int32_t pointerId) {
+    FP_TRACE_SPAN("FingerprintEngine::pointerUp");
+    onPointerUpImpl(pointerId);
+    mUdfps.transition(UdfpsState::IDLE);
+}
+
+void FingerprintEngine::startCapture() {
+    mUdfps.transition(UdfpsState::UI_READY);
+    onUiReadyImpl();
+    mUdfps.transition(UdfpsState::CAPTURING);
+}
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
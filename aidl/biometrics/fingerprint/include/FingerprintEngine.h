@@ -7,11 +7,15 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
 
+#include <aidl/android/hardware/biometrics/common/OperationContext.h>
 #include <aidl/android/hardware/biometrics/fingerprint/FingerprintSensorType.h>
 #include <aidl/android/hardware/biometrics/fingerprint/ISessionCallback.h>
 
 #include <LockoutTracker.h>
+#include <UdfpsStateMachine.h>
 
 using ::aidl::android::hardware::biometrics::fingerprint::FingerprintSensorType;
 using namespace ::aidl::android::hardware::biometrics::common;
@@ -45,13 +49,20 @@ class FingerprintEngine {
   public:
     virtual ~FingerprintEngine();
 
+    // Called once the engine is fully constructed, before anything else
+    virtual void start() {}
+
     virtual void setSession(std::shared_ptr<Session> session) = 0;
     virtual void setActiveGroup(int userId) = 0;
+    // Display, AOD and fold state of the device for the operations that follow
+    virtual void onContextChangedImpl(const common::OperationContext& /*context*/) {}
 
     virtual FingerprintSensorType getSensorType() const = 0;
     virtual int32_t getCenterPositionR() const = 0;
     virtual int32_t getCenterPositionX() const = 0;
     virtual int32_t getCenterPositionY() const = 0;
+    // Reported in SensorProps, empty when the engine doesn't know it
+    virtual std::string getFirmwareVersion() const { return ""; }
 
     virtual void generateChallengeImpl() = 0;
     virtual void revokeChallengeImpl(int64_t challenge) = 0;
@@ -67,9 +78,26 @@ class FingerprintEngine {
     virtual void onUiReadyImpl() = 0;
     virtual ndk::ScopedAStatus cancelImpl() = 0;
 
+    // UDFPS entry points, they order the events through mUdfps and call the *Impl
+    // methods above. Must run on the sensor worker.
+    void pointerDown(int32_t pointerId, int32_t x, int32_t y, float minor, float major);
+    void uiReady();
+    void pointerUp(int32_t pointerId);
+    const UdfpsStateMachine& udfps() const { return mUdfps; }
+
+    // Engine state for dumpsys
+    virtual void dump(int /*fd*/) {}
+
 protected:
     std::weak_ptr<Session> mSession;
+
+private:
+    void startCapture();
+
+    UdfpsStateMachine mUdfps;
 };
 
 extern std::shared_ptr<FingerprintEngine> makeFingerprintEngine();
+// One engine per sensor, the index is the sensor id. Defaults to makeFingerprintEngine() only.
+extern std::vector<std::shared_ptr<FingerprintEngine>> makeFingerprintEngines();
 }
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/biometrics/fingerprint/Error.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+// Process wide counters and latency histograms, dumped by Fingerprint::dump.
+// Updates are relaxed atomics on one of kShards striped shards, picked per thread
+// round robin, so threads may share one once there are more than kShards. Shards
+// are only summed up when dumping.
+class FingerprintMetrics {
+  public:
+    enum class Counter : uint8_t {
+        AUTHENTICATE,
+        AUTHENTICATION_SUCCEEDED,
+        AUTHENTICATION_FAILED,
+        LOCKOUT_TIMED,
+        LOCKOUT_PERMANENT,
+        CANCEL,
+        ENROLLMENT_STEP,
+        COUNT
+    };
+
+    enum class Latency : uint8_t {
+        // Time spent in each *Impl on the sensor worker
+        GENERATE_CHALLENGE,
+        REVOKE_CHALLENGE,
+        ENROLL,
+        AUTHENTICATE,
+        DETECT_INTERACTION,
+        ENUMERATE_ENROLLMENTS,
+        REMOVE_ENROLLMENTS,
+        GET_AUTHENTICATOR_ID,
+        INVALIDATE_AUTHENTICATOR_ID,
+        POINTER_DOWN,
+        POINTER_UP,
+        UI_READY,
+        CONTEXT_CHANGED,
+        CANCEL,
+        // From the vendor library's notify to the session callback returning
+        NOTIFY_ERROR,
+        NOTIFY_ACQUIRED,
+        NOTIFY_ENROLLING,
+        NOTIFY_REMOVED,
+        NOTIFY_AUTHENTICATED,
+        NOTIFY_ENUMERATING,
+        COUNT
+    };
+
+    static constexpr size_t kShards = 8;
+    // Bucket 0 is under 1 us, bucket i is [2^(i-1), 2^i) us, the last one is open ended
+    static constexpr size_t kBuckets = 24;
+    static constexpr size_t kErrors = 16;
+    static constexpr int32_t kVendorErrors = 64;
+
+    static FingerprintMetrics& get();
+
+    static int64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    void increment(Counter counter) {
+        shard().counters[static_cast<size_t>(counter)].fetch_add(1, std::memory_order_relaxed);
+    }
+    // vendorCode is only kept for Error::VENDOR
+    void error(Error error, int32_t vendorCode);
+    void recordLatency(Latency latency, int64_t durationNs);
+
+    void dump(int fd);
+    void dumpJson(int fd);
+
+  private:
+    static constexpr size_t kCounters = static_cast<size_t>(Counter::COUNT);
+    static constexpr size_t kLatencies = static_cast<size_t>(Latency::COUNT);
+
+    struct Histogram {
+        std::array<std::atomic<uint64_t>, kBuckets> buckets = {};
+        std::atomic<uint64_t> totalUs = 0;
+        std::atomic<uint64_t> maxUs = 0;
+    };
+
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, kCounters> counters = {};
+        std::array<std::atomic<uint64_t>, kErrors> errors = {};
+        // The last slot counts vendor codes out of range
+        std::array<std::atomic<uint64_t>, kVendorErrors + 1> vendorErrors = {};
+        std::array<Histogram, kLatencies> latencies;
+    };
+
+    struct HistogramSnapshot {
+        std::array<uint64_t, kBuckets> buckets = {};
+        uint64_t count = 0;
+        uint64_t totalUs = 0;
+        uint64_t maxUs = 0;
+
+        // Upper bound of the bucket holding the given percentile
+        uint64_t percentileUs(uint32_t percentile) const;
+    };
+
+    struct Snapshot {
+        std::array<uint64_t, kCounters> counters = {};
+        std::array<uint64_t, kErrors> errors = {};
+        std::array<uint64_t, kVendorErrors + 1> vendorErrors = {};
+        std::array<HistogramSnapshot, kLatencies> latencies;
+    };
+
+    FingerprintMetrics() = default;
+
+    Shard& shard();
+    Snapshot snapshot() const;
+
+    std::atomic<size_t> mNextShard{0};
+    std::array<Shard, kShards> mShards;
+};
+
+class ScopedLatency {
+  public:
+    explicit ScopedLatency(FingerprintMetrics::Latency latency)
+        : mLatency(latency), mBeginNs(FingerprintMetrics::now()) {}
+
+    ~ScopedLatency() {
+        FingerprintMetrics::get().recordLatency(mLatency, FingerprintMetrics::now() - mBeginNs);
+    }
+
+  private:
+    FingerprintMetrics::Latency mLatency;
+    int64_t mBeginNs;
+};
+
+#define FP_METRICS_CONCAT_(a, b) a##b
+#define FP_METRICS_CONCAT(a, b) FP_METRICS_CONCAT_(a, b)
+
+#define FP_METRICS_LATENCY(latency)                                                 \
+    ::aidl::android::hardware::biometrics::fingerprint::ScopedLatency               \
+            FP_METRICS_CONCAT(fpMetricsLatency_, __LINE__)(latency)
+
+#define FP_METRICS_INCREMENT(counter)                                               \
+    do {                                                                            \
+        using FpMetrics_ = ::aidl::android::hardware::biometrics::fingerprint::     \
+                FingerprintMetrics;                                                 \
+        FpMetrics_::get().increment(FpMetrics_::Counter::counter);                  \
+    } while (0)
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifndef ATRACE_TAG
+#define ATRACE_TAG ATRACE_TAG_HAL
+#endif
+
+#include <cutils/trace.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+// Stages of a single authentication attempt, in the order they normally happen
+enum class AttemptStage : uint8_t {
+    START,          // authenticateImpl
+    POINTER_DOWN,   // onPointerDown
+    UI_READY,       // onUiReady, illumination is on
+    ACQUIRED,       // first onAcquired from the vendor library
+    MATCH,          // FINGERPRINT_AUTHENTICATED received
+    CALLBACK,       // onAuthenticationSucceeded/Failed returned
+    COUNT
+};
+
+// Fixed-size in-memory timeline of spans. Recording is lock free; when
+// tracing is disabled every entry point costs a single relaxed load.
+class FingerprintTrace {
+  public:
+    static constexpr size_t kMaxEvents = 1024;
+    static constexpr size_t kMaxAttempts = 16;
+
+    static FingerprintTrace& get();
+
+    static int64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    bool enabled() const { return mEnabled.load(std::memory_order_relaxed); }
+    void setEnabled(bool enabled) { mEnabled.store(enabled, std::memory_order_relaxed); }
+
+    void record(const char* name, int64_t beginNs, int64_t endNs);
+
+    void beginAttempt();
+    void markAttempt(AttemptStage stage);
+    void endAttempt(bool matched);
+
+    // Per-attempt breakdown, human readable
+    void dumpAttempts(int fd);
+    // Systrace text format, loadable by Perfetto UI and catapult
+    void dumpSystrace(int fd);
+
+  private:
+    FingerprintTrace();
+
+    // A seqlock slot. Readers race with the writer by design, so the fields are
+    // relaxed atomics and only what was read under an unchanged even seq is kept.
+    struct Event {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<int64_t> beginNs{0};
+        std::atomic<int64_t> endNs{0};
+        std::atomic<int32_t> tid{0};
+    };
+
+    struct Attempt {
+        int32_t id = 0;
+        int64_t stages[static_cast<size_t>(AttemptStage::COUNT)] = {};
+        int32_t acquiredCount = 0;
+        bool matched = false;
+        bool done = false;
+    };
+
+    std::atomic<bool> mEnabled;
+    std::atomic<uint64_t> mNextEvent{0};
+    std::array<Event, kMaxEvents> mEvents;
+
+    std::mutex mAttemptLock;
+    std::atomic<int32_t> mCurrentAttempt{0};
+    std::array<Attempt, kMaxAttempts> mAttempts;
+};
+
+class ScopedTraceSpan {
+  public:
+    explicit ScopedTraceSpan(const char* name) : mName(nullptr) {
+        if (FingerprintTrace::get().enabled() || ATRACE_ENABLED()) {
+            mName = name;
+            mBeginNs = FingerprintTrace::now();
+            ATRACE_BEGIN(name);
+        }
+    }
+
+    ~ScopedTraceSpan() {
+        if (mName) {
+            ATRACE_END();
+            FingerprintTrace::get().record(mName, mBeginNs, FingerprintTrace::now());
+        }
+    }
+
+  private:
+    const char* mName;
+    int64_t mBeginNs;
+};
+
+#define FP_TRACE_CONCAT_(a, b) a##b
+#define FP_TRACE_CONCAT(a, b) FP_TRACE_CONCAT_(a, b)
+
+// name must be a string literal
+#define FP_TRACE_SPAN(name) \
+    ::aidl::android::hardware::biometrics::fingerprint::ScopedTraceSpan \
+            FP_TRACE_CONCAT(fpTraceSpan_, __LINE__)(name)
+
+#define FP_TRACE_ATTEMPT(method, ...)                                               \
+    do {                                                                            \
+        auto& fpTrace_ = ::aidl::android::hardware::biometrics::fingerprint::       \
+                FingerprintTrace::get();                                            \
+        if (fpTrace_.enabled()) {                                                   \
+            fpTrace_.method(__VA_ARGS__);                                           \
+        }                                                                           \
+    } while (0)
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
@@ -9,7 +9,20 @@
 #include <hardware/fingerprint.h>
 #include <hardware/hardware.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <FingerprintEngine.h>
+#include <Legacy2Aidl.h>
+#include <VendorCodes.h>
 
 namespace aidl {
 namespace android {
@@ -17,24 +30,42 @@ namespace hardware {
 namespace biometrics {
 namespace fingerprint {
 
+enum class SensorPowerState {
+    ACTIVE,     // display on
+    WARM,       // AOD, keep the sensor ready for a touch on the icon
+    SUSPENDED,  // display off
+};
+
 struct HwFingerprintModule {
     const char *id_name;
     const char *class_name;
     FingerprintSensorType sensor_type;
+    // Opens the device instead of hw_get_module, for engines without a vendor library
+    fingerprint_device_t* (*open)() = nullptr;
 };
 
 class HwFingerprintEngine : public FingerprintEngine {
   public:
-    HwFingerprintEngine(const std::vector<HwFingerprintModule> &modules, bool setNotifyCallback = true);
+    // Engines that can be alive at the same time, one per sensor
+    static constexpr size_t kMaxInstances = 4;
+
+    // Device engines translate vendor codes with kVendorCodeLuts<Engine>, see VendorCodes.h
+    HwFingerprintEngine(const std::vector<HwFingerprintModule> &modules, bool setNotifyCallback = true,
+                        const VendorCodeLuts& vendorCodes = kVendorCodeLuts<void>);
     virtual ~HwFingerprintEngine();
 
+    // Starts opening the vendor module, the derived engine has to be complete by then
+    void start() override;
+
     virtual FingerprintSensorType getSensorType() const;
+    std::string getFirmwareVersion() const override;
     virtual int32_t getCenterPositionR() const = 0;
     virtual int32_t getCenterPositionX() const = 0;
     virtual int32_t getCenterPositionY() const = 0;
 
     virtual void setSession(std::shared_ptr<Session> session);
     virtual void setActiveGroup(int userId);
+    virtual void onContextChangedImpl(const common::OperationContext& context);
 
     virtual void generateChallengeImpl();
     virtual void revokeChallengeImpl(int64_t challenge);
@@ -50,21 +81,143 @@ class HwFingerprintEngine : public FingerprintEngine {
     virtual void onUiReadyImpl() = 0;
     virtual ndk::ScopedAStatus cancelImpl();
 
+    virtual void dump(int fd);
+
+    // Notify callback handed to the vendor library of the engine in Slot
+    template <size_t Slot>
+    static void notifySlot(const fingerprint_msg_t* msg);
+
 protected:
     static fingerprint_device_t* openHwModule(const char* id_name, const char* class_name);
-    fingerprint_device_t *getDevice() { return mDevice; }
+    // The device with the shared lock that keeps recovery from closing it
+    struct LockedDevice {
+        std::shared_lock<std::shared_mutex> lock;
+        fingerprint_device_t* device = nullptr;
+
+        fingerprint_device_t* operator->() const { return device; }
+        explicit operator bool() const { return device != nullptr; }
+    };
+    // Blocks until the vendor module has been opened
+    LockedDevice getDevice();
+
+    // Returns a shared lock that keeps the device open while held. When the device is
+    // being opened or reopened, op (if any) is queued and the returned lock is not owned.
+    std::shared_lock<std::shared_mutex> lockDevice(std::function<void()> op);
+
+    // Closes and reopens the vendor device off the calling thread. Operations in
+    // flight fail with HW_UNAVAILABLE, new ones are replayed on the new device.
+    void requestRecovery(const char* reason);
+
+    // Called on display state transitions, devices with vendor power controls hook in here
+    virtual void setSensorPowerState(SensorPowerState /*state*/) {}
 
     int32_t mUserId;
     uint64_t mAuthId;
     uint64_t mChallengeId;
 
 private:
-    static Error VendorErrorFilter(int32_t error, int32_t* vendorCode);
-    static AcquiredInfo VendorAcquiredFilter(int32_t info, int32_t* vendorCode);
-    static void notify(const fingerprint_msg_t* msg);
+    Error VendorErrorFilter(int32_t error, int32_t* vendorCode);
+    AcquiredInfo VendorAcquiredFilter(int32_t info, int32_t* vendorCode);
+    static void notify(HwFingerprintEngine* thisPtr, const fingerprint_msg_t* msg);
+
+    // Batched removal: removed ids are collected and reported in a single callback
+    struct PendingRemoval {
+        bool active = false;
+        bool issued = false;
+        std::set<int32_t> pending;
+        std::vector<int32_t> removed;
+        int32_t failed = 0;
+        int32_t lastError = 0;
+        // Tells a late deadline apart from the batch that replaced it
+        uint64_t batch = 0;
+    };
+
+    fingerprint_device_t* probeModules();
+    // False when the engine went away before a device could be opened
+    bool loadDevice(bool recovering);
+
+    bool handleDetectMessage(const fingerprint_msg_t* msg, const std::shared_ptr<ISessionCallback>& cb);
+    void onInteractionDetected(const std::shared_ptr<ISessionCallback>& cb);
+    // Stops the vendor authentication behind a detect, on the sensor worker
+    void finishDetect(uint64_t generation, const std::shared_ptr<ISessionCallback>& cb);
+
+    void onTemplateRemoved(int32_t fid, uint32_t remaining);
+    // Fails the batch if the vendor library hasn't reported it within kRemovalTimeout
+    void startRemovalTimer(uint64_t batch);
+    void expireRemoval(uint64_t batch);
+    bool failPendingRemoval(int32_t error);
+    // Fails whatever the vendor library never reported and sends the callbacks of the batch
+    void failRemovalLocked(std::unique_lock<std::mutex>& lock, int32_t error);
+    void finishRemovalLocked(std::unique_lock<std::mutex>& lock);
+
+    size_t mSlot;
+    std::vector<HwFingerprintModule> mModules;
+    bool mSetNotifyCallback;
 
     FingerprintSensorType mSensorType;
+    // Name and version of the vendor module that was opened
+    std::string mFirmwareVersion;
     fingerprint_device_t *mDevice;
+
+    // Asynchronous device loading, mLoader is only swapped under mLoaderLock
+    std::mutex mLoaderLock;
+    // Wakes a loader backing off between attempts when the engine goes away
+    std::condition_variable mLoaderCv;
+    std::thread mLoader;
+    bool mStopping = false;
+    mutable std::mutex mDeviceLock;
+    mutable std::condition_variable mDeviceOpened;
+    std::atomic<bool> mReady;
+    std::vector<std::function<void()>> mPendingOps;
+    std::chrono::steady_clock::time_point mCreatedAt;
+
+    // Held shared by every vendor call, exclusively while the device is reopened
+    std::shared_mutex mDeviceUse;
+    std::atomic<bool> mRecovering = false;
+    std::atomic<bool> mOperationInFlight = false;
+    std::atomic<uint32_t> mRecoveries = 0;
+    std::atomic<uint32_t> mUnknownMessages = 0;
+    std::atomic<uint64_t> mLastRecoveryUs = 0;
+
+    std::mutex mEnrollmentsLock;
+    std::set<int32_t> mEnrolledIds;
+    // Templates reported so far by the enumeration in progress
+    std::vector<int32_t> mEnumerated;
+    PendingRemoval mRemoval;
+    uint64_t mRemovalBatches = 0;
+
+    // Only touched from the vendor notify thread
+    HardwareAuthToken mAuthToken;
+
+    // Last set_active_group call, mUserId holds the group
+    bool mActiveGroupSet = false;
+    std::string mActiveGroupPath;
+    std::atomic<uint32_t> mActiveGroupCalls = 0;
+    std::atomic<uint32_t> mActiveGroupSkipped = 0;
+    std::atomic<uint64_t> mActiveGroupCostUs = 0;
+
+    SensorPowerState mPowerState = SensorPowerState::ACTIVE;
+
+    // detectInteraction on top of authenticate
+    std::atomic<bool> mDetecting = false;
+    // Bumped by every enroll, authenticate and detect sent to the vendor library
+    std::atomic<uint64_t> mOperationGeneration = 0;
+    // Generation of the detect whose own cancel is in flight, its CANCELED is swallowed
+    std::atomic<uint64_t> mDetectCancelGeneration = 0;
+    std::chrono::steady_clock::time_point mDetectStartedAt;
+    std::atomic<uint32_t> mDetections = 0;
+    std::atomic<uint64_t> mDetectLatencyUs = 0;
+
+    const VendorCodeLuts* const mVendorCodes;
+
+    // Vendor code statistics
+    static constexpr size_t kAcquiredInfoCount = 16;
+    VendorCodeCounters mErrorCounts;
+    VendorCodeCounters mAcquiredCounts;
+    std::atomic<uint32_t> mMatches = 0;
+    std::array<std::atomic<uint32_t>, kAcquiredInfoCount> mAcquiredBeforeMatch = {};
+    // Acquisitions of the current attempt, only touched from the vendor notify thread
+    std::array<uint32_t, kAcquiredInfoCount> mAttemptAcquired = {};
 };
 
 } // namespace fingerprint
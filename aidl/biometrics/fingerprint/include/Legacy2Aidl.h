@@ -12,6 +12,10 @@
 
 #include <endian.h>
 
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
 using aidl::android::hardware::keymaster::HardwareAuthToken;
 
 namespace aidl {
@@ -20,7 +24,27 @@ namespace hardware {
 namespace biometrics {
 namespace fingerprint {
 
-inline void translate(const HardwareAuthToken& authToken, hw_auth_token_t& hat) {
+// hw_auth_token_t is a packed wire format shared with the TEE, make sure the
+// fields translated below sit where the trusted side expects them
+static_assert(sizeof(hw_auth_token_t) == 69, "hw_auth_token_t must be packed");
+static_assert(offsetof(hw_auth_token_t, challenge) == 1);
+static_assert(offsetof(hw_auth_token_t, user_id) == 9);
+static_assert(offsetof(hw_auth_token_t, authenticator_id) == 17);
+static_assert(offsetof(hw_auth_token_t, authenticator_type) == 25);
+static_assert(offsetof(hw_auth_token_t, timestamp) == 29);
+static_assert(offsetof(hw_auth_token_t, hmac) == 37);
+// authenticator_type and timestamp are byte-swapped with be32/be64
+static_assert(sizeof(hw_auth_token_t::authenticator_type) == sizeof(uint32_t));
+static_assert(sizeof(hw_auth_token_t::timestamp) == sizeof(uint64_t));
+
+constexpr size_t kHwAuthTokenHmacSize = sizeof(hw_auth_token_t::hmac);
+
+inline bool translate(const HardwareAuthToken& authToken, hw_auth_token_t& hat) {
+    if (authToken.mac.size() != kHwAuthTokenHmacSize) {
+        return false;
+    }
+
+    hat.version = HW_AUTH_TOKEN_VERSION;
     hat.challenge = authToken.challenge;
     hat.user_id = authToken.userId;
     hat.authenticator_id = authToken.authenticatorId;
@@ -28,8 +52,11 @@ inline void translate(const HardwareAuthToken& authToken, hw_auth_token_t& hat)
     hat.authenticator_type = htobe32(static_cast<uint32_t>(authToken.authenticatorType));
     hat.timestamp = htobe64(authToken.timestamp.milliSeconds);
     std::copy(authToken.mac.begin(), authToken.mac.end(), hat.hmac);
+    return true;
 }
 
+// Overwrites authToken in place. Reusing the same object keeps the mac buffer,
+// so this does not allocate after the first call.
 inline void translate(const hw_auth_token_t& hat, HardwareAuthToken& authToken) {
     authToken.challenge = hat.challenge;
     authToken.userId = hat.user_id;
@@ -39,8 +66,8 @@ inline void translate(const hw_auth_token_t& hat, HardwareAuthToken& authToken)
             static_cast<keymaster::HardwareAuthenticatorType>(
                     be32toh(hat.authenticator_type));
     authToken.timestamp.milliSeconds = be64toh(hat.timestamp);
-    authToken.mac.insert(authToken.mac.begin(), std::begin(hat.hmac),
-                         std::end(hat.hmac));
+    authToken.mac.resize(kHwAuthTokenHmacSize);
+    std::copy(std::begin(hat.hmac), std::end(hat.hmac), authToken.mac.begin());
 }
 
 } // namespace fingerprint
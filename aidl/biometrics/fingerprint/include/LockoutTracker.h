@@ -6,12 +6,16 @@
 
 #pragma once
 
+#include <cstdint>
+#include <mutex>
+
 namespace aidl {
 namespace android {
 namespace hardware {
 namespace biometrics {
 namespace fingerprint {
 
+// Defaults, see LockoutConfig
 #define LOCKOUT_TIMED_THRESHOLD 5
 #define LOCKOUT_TIMED_DURATION 30 * 1000
 #define LOCKOUT_PERMANENT_THRESHOLD 20
@@ -22,17 +26,32 @@ enum class LockoutMode {
     PERMANENT
 };
 
+struct LockoutConfig {
+    int32_t timedThreshold = LOCKOUT_TIMED_THRESHOLD;
+    int64_t timedDurationMs = LOCKOUT_TIMED_DURATION;
+    int32_t permanentThreshold = LOCKOUT_PERMANENT_THRESHOLD;
+};
+
+// Updated from the vendor notify thread and read from binder and timer threads,
+// every method is safe to call concurrently.
 class LockoutTracker {
 public:
+    LockoutTracker() = default;
+    explicit LockoutTracker(const LockoutConfig& config) : mConfig(config) {}
+    LockoutTracker(const LockoutTracker& other);
+    LockoutTracker& operator=(const LockoutTracker& other) = delete;
+
     void reset(bool clearAttemptCounter);
     LockoutMode getMode();
     void addFailedAttempt();
     int64_t getLockoutTimeLeft();
 
 private:
+    const LockoutConfig mConfig;
+    mutable std::mutex mLock;
     int32_t mFailedCount = 0;
-    int64_t mLockoutTimedStart;
-    LockoutMode mCurrentMode;
+    int64_t mLockoutTimedStart = 0;
+    LockoutMode mCurrentMode = LockoutMode::NONE;
 };
 
 } // namespace fingerprint
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <hardware/fingerprint.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+// One vendor message in a capture, little endian on disk. What args hold depends
+// on the type, see MessageCapture::encode.
+struct CapturedMessage {
+    uint64_t timeNs;  // since the capture started
+    int32_t type;
+    int32_t args[3];
+};
+static_assert(sizeof(CapturedMessage) == 24);
+
+struct CaptureHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+};
+static_assert(sizeof(CaptureHeader) == 16);
+
+// Records the messages the vendor library sends to notify, for replaying them
+// later. Finger and group ids are hashed with a salt that is never written out
+// and auth tokens are dropped, so captures from the field can be shared.
+class MessageCapture {
+  public:
+    static constexpr size_t kMaxMessages = 4096;
+    static constexpr char kMagic[4] = {'F', 'P', 'M', 'C'};
+    static constexpr uint32_t kVersion = 1;
+
+    static MessageCapture& get();
+
+    bool enabled() const { return mEnabled.load(std::memory_order_relaxed); }
+    // Starts a new capture, dropping the previous one
+    void start();
+    void stop();
+
+    void record(const fingerprint_msg_t* msg);
+    // The header and the captured messages, oldest first
+    void dump(int fd);
+
+    static CapturedMessage encode(const fingerprint_msg_t& msg, uint64_t timeNs, uint32_t salt);
+    static fingerprint_msg_t decode(const CapturedMessage& captured);
+    static bool read(int fd, std::vector<CapturedMessage>* messages);
+
+  private:
+    MessageCapture() = default;
+
+    std::atomic<bool> mEnabled{false};
+
+    std::mutex mLock;
+    uint32_t mSalt = 0;
+    int64_t mStartNs = 0;
+    // The most recent kMaxMessages, mNext wraps around
+    std::array<CapturedMessage, kMaxMessages> mMessages;
+    uint64_t mNext = 0;
+};
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
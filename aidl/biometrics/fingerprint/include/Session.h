@@ -14,9 +14,15 @@
 #include <aidl/android/hardware/biometrics/fingerprint/BnSession.h>
 #include <aidl/android/hardware/biometrics/fingerprint/ISessionCallback.h>
 #include <log/log.h>
+#include <thread/WorkerThread.h>
+
+#include <atomic>
+#include <future>
 
 #include <LockoutTracker.h>
 #include <FingerprintEngine.h>
+#include <FingerprintMetrics.h>
+#include <SessionOperations.h>
 
 using ::aidl::android::hardware::biometrics::common::ICancellationSignal;
 using ::aidl::android::hardware::biometrics::common::OperationContext;
@@ -30,11 +36,21 @@ namespace biometrics {
 namespace fingerprint {
 
 void onClientDeath(void* cookie);
+void onClientDeathUnlinked(void* cookie);
 
+// Threading: binder calls only schedule work on the sensor worker, which is the
+// single owner of the engine. State shared with the vendor notify thread and the
+// lockout timer thread is either atomic (the flags below) or guarded by its own
+// lock (LockoutTracker).
+//
+// Every operation goes through the *Async methods below, the binder methods only
+// drop the handle. Callbacks reach the framework through an OperationCallback,
+// which completes the handles.
 class Session : public BnSession {
 public:
-    Session(std::shared_ptr<FingerprintEngine> engine,
+    Session(std::shared_ptr<FingerprintEngine> engine, std::shared_ptr<WorkerThread> worker,
             std::shared_ptr<ISessionCallback> cb, LockoutTracker lockoutTracker);
+    ~Session();
     ndk::ScopedAStatus generateChallenge() override;
     ndk::ScopedAStatus revokeChallenge(int64_t challenge) override;
     ndk::ScopedAStatus enroll(const HardwareAuthToken& hat,
@@ -68,9 +84,30 @@ public:
     ndk::ScopedAStatus onPointerCancelWithContext(const PointerContext& context) override;
     ndk::ScopedAStatus setIgnoreDisplayTouches(bool shouldIgnore) override;
 
-    ndk::ScopedAStatus cancel();
+    // For callers inside the HAL that need the outcome. Each schedules the operation
+    // exactly like its binder counterpart and returns a handle to await or cancel it.
+    std::shared_ptr<Operation> generateChallengeAsync();
+    std::shared_ptr<Operation> revokeChallengeAsync(int64_t challenge);
+    std::shared_ptr<Operation> enrollAsync(const HardwareAuthToken& hat);
+    std::shared_ptr<Operation> authenticateAsync(int64_t operationId);
+    std::shared_ptr<Operation> detectInteractionAsync();
+    std::shared_ptr<Operation> enumerateEnrollmentsAsync();
+    std::shared_ptr<Operation> removeEnrollmentsAsync(const std::vector<int32_t>& enrollmentIds);
+    std::shared_ptr<Operation> getAuthenticatorIdAsync();
+    std::shared_ptr<Operation> invalidateAuthenticatorIdAsync();
+
+    // Stops the operation if it's still going. cancel only queues it, cancelAsync also
+    // lets the caller wait for the engine to acknowledge it.
+    ndk::ScopedAStatus cancel(int64_t operationId);
+    std::future<ndk::ScopedAStatus> cancelAsync(int64_t operationId);
+
+    // Runs task on the sensor worker after everything already scheduled, for engine
+    // work that must not run on the vendor notify thread
+    bool post(std::function<void()> task);
+
     binder_status_t linkToDeath(AIBinder* binder);
     bool isClosed();
+    void dump(int fd);
 
     // Callback for talking to the framework. This callback must only be called from non-binder
     // threads to prevent nested binder calls and consequently a binder thread exhaustion.
@@ -79,20 +116,36 @@ public:
     bool checkSensorLockout();
     LockoutTracker mLockoutTracker;
 private:
-    bool mClosed = false;
+    std::atomic<bool> mClosed = false;
 
     void clearLockout(bool clearAttemptCounter);
     void startLockoutTimer(int64_t timeout);
     void lockoutTimerExpired();
 
-    // lockout timer
-    bool mIsLockoutTimerStarted = false;
-    bool mIsLockoutTimerAborted = false;
+    // Runs task on the sensor worker thread, in submission order, and records
+    // how long it took under latency. False when the worker queue is full.
+    bool schedule(FingerprintMetrics::Latency latency, std::function<void()> task);
+    // Same for a task that ends with a callback
+    std::shared_ptr<Operation> start(OperationType type, FingerprintMetrics::Latency latency,
+                                     std::function<void()> task);
+
+    // lockout timer, at most one is pending at any time
+    std::atomic<bool> mIsLockoutTimerStarted = false;
+    std::atomic<bool> mIsLockoutTimerAborted = false;
+    // The current touch was dropped on pointer down because of a lockout, only
+    // touched on the worker
+    bool mTouchGated = false;
 
-    // Binder death handler.
+    // Binder death handler. Each link gets its own cookie holding a weak reference,
+    // freed by onClientDeathUnlinked once the binder can no longer fire.
     AIBinder_DeathRecipient* mDeathRecipient;
 
+    // Also what mCb points to
+    std::shared_ptr<OperationCallback> mOperations;
+
     std::shared_ptr<FingerprintEngine> mEngine;
+    // Each sensor has its own worker, so sessions on different sensors run in parallel
+    std::shared_ptr<WorkerThread> mWorker;
 };
 
 } // namespace fingerprint
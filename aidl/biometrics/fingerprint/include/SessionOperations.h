@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/biometrics/fingerprint/BnSessionCallback.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+// Session operations that end with a callback
+enum class OperationType : int32_t {
+    GENERATE_CHALLENGE,
+    REVOKE_CHALLENGE,
+    ENROLL,
+    AUTHENTICATE,
+    DETECT_INTERACTION,
+    ENUMERATE_ENROLLMENTS,
+    REMOVE_ENROLLMENTS,
+    GET_AUTHENTICATOR_ID,
+    INVALIDATE_AUTHENTICATOR_ID,
+    COUNT,
+};
+
+struct OperationResult {
+    enum class Status : int32_t {
+        SUCCEEDED,
+        ERROR,
+        LOCKED_OUT,
+        CANCELED,
+        // The wait ran out, the operation itself may still finish
+        TIMED_OUT,
+        // The session closed or the task never reached the worker
+        ABORTED,
+        COUNT,
+    };
+
+    Status status = Status::ABORTED;
+    Error error = Error::UNKNOWN;
+    int32_t vendorCode = 0;
+    // Challenge, enrollment id, authenticator id or lockout duration, depending on the type
+    int64_t value = 0;
+    // Enumerated or removed enrollments
+    std::vector<int32_t> enrollmentIds;
+};
+
+const char* toString(OperationType type);
+const char* toString(OperationResult::Status status);
+
+class Operation;
+
+// Lets code that didn't start an operation cancel it without keeping it alive
+class CancellationToken {
+  public:
+    CancellationToken() = default;
+    explicit CancellationToken(std::weak_ptr<Operation> operation)
+        : mOperation(std::move(operation)) {}
+
+    // False when the operation already finished
+    bool cancel() const;
+
+  private:
+    std::weak_ptr<Operation> mOperation;
+};
+
+// One session operation, from the binder call to the callback that ends it
+class Operation : public std::enable_shared_from_this<Operation> {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // timeout of zero waits forever, cancel is handed the operation id
+    Operation(int64_t id, OperationType type, std::chrono::milliseconds timeout,
+              std::function<void(int64_t)> cancel);
+
+    int64_t id() const { return mId; }
+    OperationType type() const { return mType; }
+    bool started() const { return mStarted.load(std::memory_order_acquire); }
+    bool done() const { return mDone.load(std::memory_order_acquire); }
+    // Done from a callback that didn't name it, the engine may still be running it
+    bool settled() const { return mSettled.load(std::memory_order_acquire); }
+    Clock::time_point createdAt() const { return mCreatedAt; }
+
+    // Block until the callback that ends the operation arrives, or the timeout runs
+    // out. Must not be called from the sensor worker or the vendor notify thread,
+    // which are the ones completing it.
+    OperationResult wait() const;
+    OperationResult waitFor(std::chrono::milliseconds timeout) const;
+    // Asks the engine to stop, the outcome is still reported through wait()
+    void cancel();
+    CancellationToken token() { return CancellationToken(weak_from_this()); }
+
+  private:
+    friend class OperationCallback;
+
+    // Only the first call counts
+    bool complete(OperationResult result);
+
+    const int64_t mId;
+    const OperationType mType;
+    const std::chrono::milliseconds mTimeout;
+    const Clock::time_point mCreatedAt;
+    const std::function<void(int64_t)> mCancel;
+
+    std::atomic<bool> mStarted = false;
+    std::atomic<bool> mDone = false;
+    std::atomic<bool> mSettled = false;
+    std::atomic<bool> mCancelRequested = false;
+    std::promise<OperationResult> mPromise;
+    std::shared_future<OperationResult> mResult;
+};
+
+// Sits between the engine and the framework callback. Every callback is forwarded
+// as is first, then the one that ends an operation completes it.
+//
+// The worker hands the engine one operation at a time, and start() records its id as
+// the active one. Messages from the legacy HAL carry no operation id, so callbacks
+// only ever complete the active operation, and only when it is of a type the
+// callback can end. An operation still active when the next one starts was dropped
+// by the engine and is aborted.
+class OperationCallback : public BnSessionCallback {
+  public:
+    explicit OperationCallback(std::shared_ptr<ISessionCallback> cb);
+
+    // Registers an operation before its task is scheduled
+    std::shared_ptr<Operation> begin(OperationType type, std::function<void(int64_t)> cancel);
+    // Called on the sensor worker right before the engine gets the operation, which
+    // becomes the active one
+    void start(const std::shared_ptr<Operation>& operation);
+    void abort(const std::shared_ptr<Operation>& operation);
+    // Fails everything still pending, the session is going away
+    void abortAll();
+    // Null once the operation is done, settled ones can still be found and canceled
+    std::shared_ptr<Operation> find(int64_t id);
+
+    void dump(int fd);
+
+    ndk::ScopedAStatus onChallengeGenerated(int64_t challenge) override;
+    ndk::ScopedAStatus onChallengeRevoked(int64_t challenge) override;
+    ndk::ScopedAStatus onAcquired(AcquiredInfo info, int32_t vendorCode) override;
+    ndk::ScopedAStatus onError(Error error, int32_t vendorCode) override;
+    ndk::ScopedAStatus onEnrollmentProgress(int32_t enrollmentId, int32_t remaining) override;
+    ndk::ScopedAStatus onAuthenticationSucceeded(int32_t enrollmentId,
+                                                 const keymaster::HardwareAuthToken& hat) override;
+    ndk::ScopedAStatus onAuthenticationFailed() override;
+    ndk::ScopedAStatus onLockoutTimed(int64_t durationMillis) override;
+    ndk::ScopedAStatus onLockoutPermanent() override;
+    ndk::ScopedAStatus onLockoutCleared() override;
+    ndk::ScopedAStatus onInteractionDetected() override;
+    ndk::ScopedAStatus onEnrollmentsEnumerated(const std::vector<int32_t>& enrollmentIds) override;
+    ndk::ScopedAStatus onEnrollmentsRemoved(const std::vector<int32_t>& enrollmentIds) override;
+    ndk::ScopedAStatus onAuthenticatorIdRetrieved(int64_t authenticatorId) override;
+    ndk::ScopedAStatus onAuthenticatorIdInvalidated(int64_t authenticatorId) override;
+    ndk::ScopedAStatus onSessionClosed() override;
+
+  private:
+    // Completes the active operation if it is of one of types, or of any type when
+    // types is empty. False when there is none. With settle the operation stays active
+    // and cancelable until a later callback ends it or the next operation starts.
+    bool complete(std::initializer_list<OperationType> types, OperationResult result,
+                  bool settle = false);
+    void finish(const std::shared_ptr<Operation>& operation, OperationResult result);
+
+    std::shared_ptr<ISessionCallback> mCb;
+
+    std::mutex mLock;
+    // In submission order, which is also the order the worker starts them in
+    std::deque<std::shared_ptr<Operation>> mPending;
+    // Id of the operation the engine works on, 0 when none. Written under mLock,
+    // read without it to skip the lock when nothing is active.
+    std::atomic<int64_t> mActive = 0;
+
+    std::atomic<int64_t> mNextId = 1;
+    std::array<std::atomic<uint32_t>, static_cast<size_t>(OperationResult::Status::COUNT)>
+            mResults = {};
+};
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
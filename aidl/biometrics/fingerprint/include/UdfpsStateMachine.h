@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+enum class UdfpsState : uint8_t {
+    IDLE,
+    FINGER_DOWN,    // onPointerDownImpl sent, the sensor wakes up while the UI illuminates
+    UI_READY,       // illumination is on
+    CAPTURING,      // onUiReadyImpl sent, the vendor library captures
+    COUNT
+};
+
+// Pointer and illumination events of an under-display sensor, in the order the
+// vendor library expects them. Driven from the sensor worker only, the counters
+// may be read from any thread.
+class UdfpsStateMachine {
+  public:
+    // onUiReady arriving before onPointerDown is held for this long
+    static constexpr auto kUiReadyHoldTimeout = std::chrono::milliseconds(1000);
+
+    UdfpsState state() const { return mState; }
+    void transition(UdfpsState to);
+
+    // Remembers an early onUiReady, consumed by the next pointer down
+    void holdUiReady();
+    bool takeHeldUiReady();
+
+    void countIgnored() { mIgnored.fetch_add(1, std::memory_order_relaxed); }
+    void countRepeated() { mUiReadyRepeated.fetch_add(1, std::memory_order_relaxed); }
+
+    void dump(int fd) const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        std::atomic<uint32_t> count = 0;
+        // Time spent in the previous state
+        std::atomic<uint64_t> totalUs = 0;
+        std::atomic<uint64_t> maxUs = 0;
+    };
+
+    static void add(Stats& stats, uint64_t us);
+
+    UdfpsState mState = UdfpsState::IDLE;
+    Clock::time_point mEnteredAt;
+    Clock::time_point mFingerDownAt;
+    bool mUiReadyHeld = false;
+    Clock::time_point mUiReadyHeldAt;
+
+    std::array<Stats, static_cast<size_t>(UdfpsState::COUNT)> mTransitions;
+    Stats mPointerToCapture;
+    std::atomic<uint32_t> mUiReadyEarly = 0;
+    std::atomic<uint32_t> mUiReadyExpired = 0;
+    std::atomic<uint32_t> mUiReadyRepeated = 0;
+    std::atomic<uint32_t> mIgnored = 0;  // out of order events
+};
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/biometrics/fingerprint/AcquiredInfo.h>
+#include <aidl/android/hardware/biometrics/fingerprint/Error.h>
+#include <hardware/fingerprint.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <span>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+// Translation of a legacy HAL code (see fingerprint.h) to its AIDL counterpart
+template <typename T>
+struct VendorCodeEntry {
+    int32_t legacy;
+    T aidl;
+    int32_t vendorCode;
+};
+
+inline constexpr VendorCodeEntry<Error> kDefaultErrorCodes[] = {
+        {FINGERPRINT_ERROR_HW_UNAVAILABLE, Error::HW_UNAVAILABLE, 0},
+        {FINGERPRINT_ERROR_UNABLE_TO_PROCESS, Error::UNABLE_TO_PROCESS, 0},
+        {FINGERPRINT_ERROR_TIMEOUT, Error::TIMEOUT, 0},
+        {FINGERPRINT_ERROR_NO_SPACE, Error::NO_SPACE, 0},
+        {FINGERPRINT_ERROR_CANCELED, Error::CANCELED, 0},
+        {FINGERPRINT_ERROR_UNABLE_TO_REMOVE, Error::UNABLE_TO_REMOVE, 0},
+        {FINGERPRINT_ERROR_LOCKOUT, Error::VENDOR, FINGERPRINT_ERROR_LOCKOUT},
+};
+
+inline constexpr VendorCodeEntry<AcquiredInfo> kDefaultAcquiredCodes[] = {
+        {FINGERPRINT_ACQUIRED_GOOD, AcquiredInfo::GOOD, 0},
+        {FINGERPRINT_ACQUIRED_PARTIAL, AcquiredInfo::PARTIAL, 0},
+        {FINGERPRINT_ACQUIRED_INSUFFICIENT, AcquiredInfo::INSUFFICIENT, 0},
+        {FINGERPRINT_ACQUIRED_IMAGER_DIRTY, AcquiredInfo::SENSOR_DIRTY, 0},
+        {FINGERPRINT_ACQUIRED_TOO_SLOW, AcquiredInfo::TOO_SLOW, 0},
+        {FINGERPRINT_ACQUIRED_TOO_FAST, AcquiredInfo::TOO_FAST, 0},
+};
+
+// Device engines specialise this to extend or override the default tables, e.g.
+//
+//   template <>
+//   struct VendorCodeTraits<FooFingerprintEngine> : VendorCodeTraits<void> {
+//       static constexpr VendorCodeEntry<AcquiredInfo> kAcquired[] = {
+//               {FINGERPRINT_ACQUIRED_VENDOR_BASE + 2, AcquiredInfo::PARTIAL, 0},
+//       };
+//       static constexpr std::span<const VendorCodeEntry<AcquiredInfo>> extraAcquired = kAcquired;
+//   };
+//
+// and pass kVendorCodeLuts<FooFingerprintEngine> to the HwFingerprintEngine constructor.
+// Entries in the extra tables take precedence over the defaults.
+template <typename Engine>
+struct VendorCodeTraits {
+    static constexpr std::span<const VendorCodeEntry<Error>> errors = kDefaultErrorCodes;
+    static constexpr std::span<const VendorCodeEntry<Error>> extraErrors = {};
+    static constexpr std::span<const VendorCodeEntry<AcquiredInfo>> acquired = kDefaultAcquiredCodes;
+    static constexpr std::span<const VendorCodeEntry<AcquiredInfo>> extraAcquired = {};
+};
+
+// Codes in [0, kDenseCodes) are looked up directly, the rest through a short list
+constexpr int32_t kDenseCodes = 64;
+constexpr size_t kMaxSparseCodes = 16;
+
+// Not constexpr on purpose: reaching it while building a table fails the build
+void vendorCodeTableTooLarge();
+
+template <typename T>
+struct VendorCodeLut {
+    struct Slot {
+        bool known = false;
+        T aidl = T{};
+        int32_t vendorCode = 0;
+    };
+
+    std::array<Slot, kDenseCodes> dense = {};
+    std::array<VendorCodeEntry<T>, kMaxSparseCodes> sparse = {};
+    size_t sparseCount = 0;
+    int32_t vendorBase = 0;
+
+    constexpr void add(const VendorCodeEntry<T>& entry) {
+        if (entry.legacy >= 0 && entry.legacy < kDenseCodes) {
+            dense[entry.legacy] = {true, entry.aidl, entry.vendorCode};
+            return;
+        }
+        for (size_t i = 0; i < sparseCount; i++) {
+            if (sparse[i].legacy == entry.legacy) {
+                sparse[i] = entry;
+                return;
+            }
+        }
+        if (sparseCount == kMaxSparseCodes) vendorCodeTableTooLarge();
+        sparse[sparseCount++] = entry;
+    }
+
+    // Returns false for codes that are neither in the table nor vendor codes
+    constexpr bool translate(int32_t legacy, T* aidl, int32_t* vendorCode) const {
+        if (legacy >= 0 && legacy < kDenseCodes) {
+            const Slot& slot = dense[legacy];
+            if (slot.known) {
+                *aidl = slot.aidl;
+                *vendorCode = slot.vendorCode;
+                return true;
+            }
+        } else {
+            for (size_t i = 0; i < sparseCount; i++) {
+                if (sparse[i].legacy == legacy) {
+                    *aidl = sparse[i].aidl;
+                    *vendorCode = sparse[i].vendorCode;
+                    return true;
+                }
+            }
+        }
+        if (legacy >= vendorBase) {
+            // vendor specific code.
+            *aidl = T::VENDOR;
+            *vendorCode = legacy - vendorBase;
+            return true;
+        }
+        return false;
+    }
+};
+
+template <typename T>
+constexpr VendorCodeLut<T> makeVendorCodeLut(std::span<const VendorCodeEntry<T>> entries,
+                                             std::span<const VendorCodeEntry<T>> extra,
+                                             int32_t vendorBase) {
+    VendorCodeLut<T> lut;
+    lut.vendorBase = vendorBase;
+    for (const auto& entry : entries) lut.add(entry);
+    for (const auto& entry : extra) lut.add(entry);
+    return lut;
+}
+
+struct VendorCodeLuts {
+    VendorCodeLut<Error> errors;
+    VendorCodeLut<AcquiredInfo> acquired;
+};
+
+template <typename Engine>
+inline constexpr VendorCodeLuts kVendorCodeLuts = {
+        makeVendorCodeLut<Error>(VendorCodeTraits<Engine>::errors,
+                                 VendorCodeTraits<Engine>::extraErrors,
+                                 FINGERPRINT_ERROR_VENDOR_BASE),
+        makeVendorCodeLut<AcquiredInfo>(VendorCodeTraits<Engine>::acquired,
+                                        VendorCodeTraits<Engine>::extraAcquired,
+                                        FINGERPRINT_ACQUIRED_VENDOR_BASE),
+};
+
+// How often each legacy code was seen, vendor codes are counted relative to the vendor base
+struct VendorCodeCounters {
+    std::array<std::atomic<uint32_t>, kDenseCodes> legacy = {};
+    std::array<std::atomic<uint32_t>, kDenseCodes> vendor = {};
+    std::atomic<uint32_t> other = 0;
+
+    void count(int32_t code, int32_t vendorBase) {
+        if (code >= 0 && code < kDenseCodes) {
+            legacy[code].fetch_add(1, std::memory_order_relaxed);
+        } else if (code >= vendorBase && code - vendorBase < kDenseCodes) {
+            vendor[code - vendorBase].fetch_add(1, std::memory_order_relaxed);
+        } else {
+            other.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
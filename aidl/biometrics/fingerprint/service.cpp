@@ -9,11 +9,15 @@
 
 #include <android/binder_manager.h>
 #include <android/binder_process.h>
+#include <android-base/chrono_utils.h>
 #include <android-base/logging.h>
 
+#include <chrono>
+
 using ::aidl::android::hardware::biometrics::fingerprint::Fingerprint;
 
 int main() {
+    auto start = std::chrono::steady_clock::now();
     ABinderProcess_setThreadPoolMaxThreadCount(0);
     std::shared_ptr<Fingerprint> fingerprint = ndk::SharedRefBase::make<Fingerprint>();
 
@@ -21,6 +25,15 @@ int main() {
     binder_status_t status = AServiceManager_addService(fingerprint->asBinder().get(), instance.c_str());
     CHECK(status == STATUS_OK);
 
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+    LOG(INFO) << "Registered " << instance << " in "
+              << duration_cast<milliseconds>(std::chrono::steady_clock::now() - start).count()
+              << " ms (boot: "
+              << duration_cast<milliseconds>(
+                         ::android::base::boot_clock::now().time_since_epoch()).count()
+              << " ms)";
+
     ABinderProcess_joinThreadPool();
     return EXIT_FAILURE; // should not reach
 }
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <mutex>
+#include <string>
+
+#include "FakeFingerprintHal.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+class DetectTest : public FingerprintTest {
+  protected:
+    void SetUp() override {
+        FingerprintTest::SetUp();
+        // Like most vendor libraries, report CANCELED from within cancel()
+        FakeDevice::onCancel = [] {
+            FakeDevice::sendError(FINGERPRINT_ERROR_CANCELED);
+            return 0;
+        };
+    }
+};
+
+TEST_F(DetectTest, ReportsInteractionOnce) {
+    std::shared_ptr<common::ICancellationSignal> signal;
+    mSession->detectInteraction(&signal);
+    drain();
+
+    FakeDevice::sendAcquired(FINGERPRINT_ACQUIRED_GOOD);
+    drain();
+    EXPECT_EQ(mCallback->events(), "detected ");
+    // The vendor authenticate behind detect is cancelled, its CANCELED is swallowed
+    EXPECT_EQ(FakeDevice::cancels, 1);
+}
+
+TEST_F(DetectTest, DropsAcquiredHints) {
+    std::shared_ptr<common::ICancellationSignal> signal;
+    mSession->detectInteraction(&signal);
+    drain();
+
+    FakeDevice::sendAcquired(FINGERPRINT_ACQUIRED_PARTIAL);
+    FakeDevice::sendAcquired(FINGERPRINT_ACQUIRED_TOO_FAST);
+    EXPECT_EQ(mCallback->events(), "");
+}
+
+TEST_F(DetectTest, NotReportedBeforeTheCancel) {
+    std::shared_ptr<common::ICancellationSignal> signal;
+    mSession->detectInteraction(&signal);
+    drain();
+
+    // Hold the worker, the way the framework's next authenticate is queued behind
+    // the end of detect
+    std::mutex gate;
+    gate.lock();
+    mWorker->schedule(Callable::from([&gate] { std::lock_guard<std::mutex> lock(gate); }));
+    FakeDevice::sendAcquired(FINGERPRINT_ACQUIRED_GOOD);
+    EXPECT_EQ(mCallback->events(), "");
+    gate.unlock();
+    drain();
+    EXPECT_EQ(mCallback->events(), "detected ");
+}
+
+TEST_F(DetectTest, NextAuthenticateCanBeCancelled) {
+    std::shared_ptr<common::ICancellationSignal> signal;
+    mSession->detectInteraction(&signal);
+    drain();
+    FakeDevice::sendAcquired(FINGERPRINT_ACQUIRED_GOOD);
+    drain();
+    mCallback->clear();
+
+    FakeDevice::onCancel = [] { return 0; };
+    mSession->authenticate(1, &signal);
+    drain();
+    signal->cancel();
+    drain();
+    EXPECT_EQ(mCallback->events(),
+              "err" + std::to_string(static_cast<int32_t>(Error::CANCELED)) + "/0 ");
+}
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/biometrics/fingerprint/BnSessionCallback.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <HwFingerprintEngine.h>
+#include <Session.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+// Vendor device whose calls go through the hooks below. The legacy HAL keeps one
+// notify callback per process, so the hooks are process wide as well.
+struct FakeDevice {
+    static inline std::atomic<fingerprint_notify_t> notify = nullptr;
+    static inline std::function<int(uint32_t fid)> onRemove;
+    static inline std::function<int()> onCancel;
+    static inline std::function<int()> onAuthenticate;
+    static inline std::atomic<int> cancels = 0;
+    static inline std::atomic<int> authenticates = 0;
+    static inline std::atomic<int> activeGroups = 0;
+    // Makes opening the module fail, as if the vendor library didn't load
+    static inline std::atomic<bool> failOpen = false;
+
+    static void reset() {
+        notify = nullptr;
+        onRemove = [](uint32_t) { return 0; };
+        onCancel = [] { return 0; };
+        onAuthenticate = [] { return 0; };
+        cancels = 0;
+        authenticates = 0;
+        activeGroups = 0;
+        failOpen = false;
+    }
+
+    static fingerprint_device_t* open();
+
+    static void send(const fingerprint_msg_t& msg) { notify.load()(&msg); }
+    static void sendAcquired(int32_t info);
+    // A fid of 0 is a failed attempt
+    static void sendAuthenticated(uint32_t fid);
+    static void sendError(int32_t error);
+    static void sendRemoved(uint32_t fid, uint32_t remaining);
+};
+
+inline fingerprint_device_t* FakeDevice::open() {
+    static hw_module_t sModule = {
+            .tag = HARDWARE_MODULE_TAG,
+            .module_api_version = FINGERPRINT_MODULE_API_VERSION_2_1,
+            .hal_api_version = HARDWARE_HAL_API_VERSION,
+            .id = "fake",
+            .name = "Fake fingerprint",
+            .author = "Paranoid Android",
+    };
+    static fingerprint_device_t sDevice = [] {
+        fingerprint_device_t device = {};
+        device.common.tag = HARDWARE_DEVICE_TAG;
+        device.common.version = FINGERPRINT_MODULE_API_VERSION_2_1;
+        device.common.module = &sModule;
+        device.common.close = [](hw_device_t*) { return 0; };
+        device.set_notify = [](fingerprint_device_t*, fingerprint_notify_t notify) {
+            FakeDevice::notify = notify;
+            return 0;
+        };
+        device.pre_enroll = [](fingerprint_device_t*) -> uint64_t { return 1; };
+        device.enroll = [](fingerprint_device_t*, const hw_auth_token_t*, uint32_t, uint32_t) {
+            return 0;
+        };
+        device.post_enroll = [](fingerprint_device_t*) { return 0; };
+        device.get_authenticator_id = [](fingerprint_device_t*) -> uint64_t { return 1; };
+        device.cancel = [](fingerprint_device_t*) {
+            FakeDevice::cancels++;
+            return FakeDevice::onCancel();
+        };
+        device.enumerate = [](fingerprint_device_t*) { return 0; };
+        device.remove = [](fingerprint_device_t*, uint32_t, uint32_t fid) {
+            return FakeDevice::onRemove(fid);
+        };
+        device.set_active_group = [](fingerprint_device_t*, uint32_t, const char*) {
+            FakeDevice::activeGroups++;
+            return 0;
+        };
+        device.authenticate = [](fingerprint_device_t*, uint64_t, uint32_t) {
+            FakeDevice::authenticates++;
+            return FakeDevice::onAuthenticate();
+        };
+        return device;
+    }();
+    return failOpen ? nullptr : &sDevice;
+}
+
+inline void FakeDevice::sendAcquired(int32_t info) {
+    fingerprint_msg_t msg = {};
+    msg.type = FINGERPRINT_ACQUIRED;
+    msg.data.acquired.acquired_info = static_cast<fingerprint_acquired_info_t>(info);
+    send(msg);
+}
+
+inline void FakeDevice::sendAuthenticated(uint32_t fid) {
+    fingerprint_msg_t msg = {};
+    msg.type = FINGERPRINT_AUTHENTICATED;
+    msg.data.authenticated.finger.fid = fid;
+    send(msg);
+}
+
+inline void FakeDevice::sendError(int32_t error) {
+    fingerprint_msg_t msg = {};
+    msg.type = FINGERPRINT_ERROR;
+    msg.data.error = static_cast<fingerprint_error_t>(error);
+    send(msg);
+}
+
+inline void FakeDevice::sendRemoved(uint32_t fid, uint32_t remaining) {
+    fingerprint_msg_t msg = {};
+    msg.type = FINGERPRINT_TEMPLATE_REMOVED;
+    msg.data.removed.finger.fid = fid;
+    msg.data.removed.remaining_templates = remaining;
+    send(msg);
+}
+
+class FakeEngine : public HwFingerprintEngine {
+  public:
+    FakeEngine()
+        : HwFingerprintEngine({{"fake", nullptr, FingerprintSensorType::UNDER_DISPLAY_OPTICAL,
+                                FakeDevice::open}}) {}
+
+    int32_t getCenterPositionR() const override { return 0; }
+    int32_t getCenterPositionX() const override { return 0; }
+    int32_t getCenterPositionY() const override { return 0; }
+    void onPointerDownImpl(int32_t, int32_t, int32_t, float, float) override {}
+    void onPointerUpImpl(int32_t) override {}
+    void onUiReadyImpl() override {}
+
+    using HwFingerprintEngine::getDevice;
+    using HwFingerprintEngine::lockDevice;
+    using HwFingerprintEngine::requestRecovery;
+};
+
+// Records every callback as a short token, e.g. "removed[1,]" or "err6/0"
+class RecordingCallback : public BnSessionCallback {
+  public:
+    std::string events() {
+        std::lock_guard<std::mutex> lock(mLock);
+        std::string all;
+        for (const auto& event : mEvents) all += event + " ";
+        return all;
+    }
+    void clear() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEvents.clear();
+    }
+
+    ndk::ScopedAStatus onChallengeGenerated(int64_t challenge) override {
+        return record("challenge" + std::to_string(challenge));
+    }
+    ndk::ScopedAStatus onChallengeRevoked(int64_t) override { return record("revoked"); }
+    ndk::ScopedAStatus onAcquired(AcquiredInfo info, int32_t) override {
+        return record("acquired" + std::to_string(static_cast<int32_t>(info)));
+    }
+    ndk::ScopedAStatus onError(Error error, int32_t vendorCode) override {
+        return record("err" + std::to_string(static_cast<int32_t>(error)) + "/" +
+                      std::to_string(vendorCode));
+    }
+    ndk::ScopedAStatus onEnrollmentProgress(int32_t, int32_t remaining) override {
+        return record("progress" + std::to_string(remaining));
+    }
+    ndk::ScopedAStatus onAuthenticationSucceeded(int32_t,
+                                                 const keymaster::HardwareAuthToken&) override {
+        return record("succeeded");
+    }
+    ndk::ScopedAStatus onAuthenticationFailed() override { return record("failed"); }
+    ndk::ScopedAStatus onLockoutTimed(int64_t) override { return record("lockoutTimed"); }
+    ndk::ScopedAStatus onLockoutPermanent() override { return record("lockoutPermanent"); }
+    ndk::ScopedAStatus onLockoutCleared() override { return record("lockoutCleared"); }
+    ndk::ScopedAStatus onInteractionDetected() override { return record("detected"); }
+    ndk::ScopedAStatus onEnrollmentsEnumerated(const std::vector<int32_t>& ids) override {
+        return record("enumerated" + join(ids));
+    }
+    ndk::ScopedAStatus onEnrollmentsRemoved(const std::vector<int32_t>& ids) override {
+        return record("removed" + join(ids));
+    }
+    ndk::ScopedAStatus onAuthenticatorIdRetrieved(int64_t) override { return record("authId"); }
+    ndk::ScopedAStatus onAuthenticatorIdInvalidated(int64_t) override {
+        return record("invalidated");
+    }
+    ndk::ScopedAStatus onSessionClosed() override { return record("closed"); }
+
+  private:
+    static std::string join(const std::vector<int32_t>& ids) {
+        std::string joined = "[";
+        for (int32_t id : ids) joined += std::to_string(id) + ",";
+        return joined + "]";
+    }
+    ndk::ScopedAStatus record(std::string event) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEvents.push_back(std::move(event));
+        return ndk::ScopedAStatus::ok();
+    }
+
+    std::mutex mLock;
+    std::vector<std::string> mEvents;
+};
+
+// A session on top of FakeEngine with the vendor device opened and group 0 active
+class FingerprintTest : public testing::Test {
+  protected:
+    static constexpr size_t kWorkerQueueSize = 16;
+
+    void SetUp() override {
+        FakeDevice::reset();
+        mEngine = std::make_shared<FakeEngine>();
+        mWorker = std::make_shared<WorkerThread>(kWorkerQueueSize);
+        mCallback = ndk::SharedRefBase::make<RecordingCallback>();
+        mSession = ndk::SharedRefBase::make<Session>(mEngine, mWorker, mCallback, LockoutTracker());
+        mEngine->setSession(mSession);
+        mEngine->start();
+        // Blocks until the loader has opened the device and set the notify callback
+        mEngine->getDevice();
+        mWorker->schedule(Callable::from([engine = mEngine] { engine->setActiveGroup(0); }));
+        drain();
+    }
+
+    void TearDown() override {
+        if (mSession) {
+            mSession->close();
+            drain();
+        }
+    }
+
+    // Waits for everything queued on the session worker so far
+    void drain() {
+        std::promise<void> done;
+        // The queue is bounded, wait for room when a test filled it up
+        while (!mWorker->schedule(Callable::from([&done] { done.set_value(); }))) {
+            std::this_thread::yield();
+        }
+        done.get_future().wait();
+    }
+
+    std::shared_ptr<FakeEngine> mEngine;
+    std::shared_ptr<WorkerThread> mWorker;
+    std::shared_ptr<RecordingCallback> mCallback;
+    std::shared_ptr<Session> mSession;
+};
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <Legacy2Aidl.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+hw_auth_token_t makeHat() {
+    hw_auth_token_t hat = {};
+    hat.version = HW_AUTH_TOKEN_VERSION;
+    hat.authenticator_type = htobe32(HW_AUTH_FINGERPRINT);
+    return hat;
+}
+
+// The notify path: one token owned by the engine, translated into on every success
+void BM_TranslateReused(benchmark::State& state) {
+    hw_auth_token_t hat = makeHat();
+    HardwareAuthToken authToken;
+    for (auto _ : state) {
+        hat.challenge++;
+        translate(hat, authToken);
+        benchmark::DoNotOptimize(authToken.mac.data());
+    }
+}
+BENCHMARK(BM_TranslateReused);
+
+// A fresh token every time, for comparison
+void BM_TranslateFresh(benchmark::State& state) {
+    hw_auth_token_t hat = makeHat();
+    for (auto _ : state) {
+        hat.challenge++;
+        HardwareAuthToken authToken;
+        translate(hat, authToken);
+        benchmark::DoNotOptimize(authToken.mac.data());
+    }
+}
+BENCHMARK(BM_TranslateFresh);
+
+void BM_TranslateToLegacy(benchmark::State& state) {
+    HardwareAuthToken authToken;
+    translate(makeHat(), authToken);
+    hw_auth_token_t hat;
+    for (auto _ : state) {
+        authToken.challenge++;
+        benchmark::DoNotOptimize(translate(authToken, hat));
+        benchmark::DoNotOptimize(&hat);
+    }
+}
+BENCHMARK(BM_TranslateToLegacy);
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
+
+BENCHMARK_MAIN();
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include <Legacy2Aidl.h>
+
+using namespace ::aidl::android::hardware::biometrics::fingerprint;
+
+// The input is a raw hw_auth_token_t as the vendor library would hand it over,
+// followed by the length of the mac of an AIDL token to translate back
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < sizeof(hw_auth_token_t)) return 0;
+
+    hw_auth_token_t hat;
+    memcpy(&hat, data, sizeof(hat));
+    hat.version = HW_AUTH_TOKEN_VERSION;
+
+    HardwareAuthToken authToken;
+    translate(hat, authToken);
+    hw_auth_token_t back;
+    if (!translate(authToken, back) || memcmp(&hat, &back, sizeof(hat)) != 0) abort();
+
+    if (size > sizeof(hw_auth_token_t)) {
+        authToken.mac.resize(data[sizeof(hw_auth_token_t)]);
+        if (translate(authToken, back) != (authToken.mac.size() == kHwAuthTokenHmacSize)) {
+            abort();
+        }
+    }
+    return 0;
+}
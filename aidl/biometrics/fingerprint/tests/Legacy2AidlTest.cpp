@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include <Legacy2Aidl.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+hw_auth_token_t makeHat() {
+    hw_auth_token_t hat = {};
+    hat.version = HW_AUTH_TOKEN_VERSION;
+    hat.challenge = 0x0102030405060708;
+    hat.user_id = 10;
+    hat.authenticator_id = 0x1122334455667788;
+    hat.authenticator_type = htobe32(HW_AUTH_FINGERPRINT);
+    hat.timestamp = htobe64(123456789);
+    for (size_t i = 0; i < kHwAuthTokenHmacSize; i++) hat.hmac[i] = i + 1;
+    return hat;
+}
+
+TEST(Legacy2AidlTest, TranslatesToHostOrder) {
+    HardwareAuthToken authToken;
+    translate(makeHat(), authToken);
+
+    EXPECT_EQ(authToken.challenge, 0x0102030405060708);
+    EXPECT_EQ(authToken.userId, 10);
+    EXPECT_EQ(authToken.authenticatorId, 0x1122334455667788);
+    EXPECT_EQ(authToken.authenticatorType, keymaster::HardwareAuthenticatorType::FINGERPRINT);
+    EXPECT_EQ(authToken.timestamp.milliSeconds, 123456789);
+    ASSERT_EQ(authToken.mac.size(), kHwAuthTokenHmacSize);
+    EXPECT_EQ(authToken.mac.front(), 1);
+    EXPECT_EQ(authToken.mac.back(), kHwAuthTokenHmacSize);
+}
+
+TEST(Legacy2AidlTest, RoundTrips) {
+    hw_auth_token_t hat = makeHat();
+    HardwareAuthToken authToken;
+    translate(hat, authToken);
+
+    hw_auth_token_t back = {};
+    ASSERT_TRUE(translate(authToken, back));
+    EXPECT_EQ(memcmp(&hat, &back, sizeof(hat)), 0);
+}
+
+TEST(Legacy2AidlTest, ReusedTokenKeepsItsMac) {
+    HardwareAuthToken authToken;
+    translate(makeHat(), authToken);
+    // A stale, longer mac must not survive either
+    authToken.mac.push_back(0);
+    const uint8_t* mac = authToken.mac.data();
+
+    translate(makeHat(), authToken);
+    EXPECT_EQ(authToken.mac.size(), kHwAuthTokenHmacSize);
+    EXPECT_EQ(authToken.mac.data(), mac);
+}
+
+TEST(Legacy2AidlTest, RejectsMalformedMac) {
+    HardwareAuthToken authToken;
+    translate(makeHat(), authToken);
+    hw_auth_token_t hat = {};
+
+    authToken.mac.push_back(0);
+    EXPECT_FALSE(translate(authToken, hat));
+    authToken.mac.resize(kHwAuthTokenHmacSize - 1);
+    EXPECT_FALSE(translate(authToken, hat));
+    authToken.mac.clear();
+    EXPECT_FALSE(translate(authToken, hat));
+}
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
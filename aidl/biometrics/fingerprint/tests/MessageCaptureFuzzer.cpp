@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/unique_fd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include <MessageCapture.h>
+
+using namespace ::aidl::android::hardware::biometrics::fingerprint;
+
+// The input is a capture file as fingerprint-replay.nubia would be handed one
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    ::android::base::unique_fd fd(memfd_create("capture", 0));
+    if (fd.get() < 0 || write(fd.get(), data, size) != static_cast<ssize_t>(size)) return 0;
+    lseek(fd.get(), 0, SEEK_SET);
+
+    std::vector<CapturedMessage> messages;
+    if (!MessageCapture::read(fd.get(), &messages)) return 0;
+    if (messages.size() > MessageCapture::kMaxMessages ||
+        sizeof(CaptureHeader) + messages.size() * sizeof(CapturedMessage) > size) {
+        abort();
+    }
+    for (const auto& message : messages) {
+        // Whatever the file holds decodes to something encode accepts as is
+        fingerprint_msg_t msg = MessageCapture::decode(message);
+        CapturedMessage again = MessageCapture::encode(msg, message.timeNs, 0);
+        if (again.type != message.type) abort();
+    }
+    return 0;
+}
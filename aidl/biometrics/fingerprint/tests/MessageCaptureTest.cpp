@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/unique_fd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#include <MessageCapture.h>
+
+#include "FakeFingerprintHal.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+using ::android::base::unique_fd;
+
+constexpr uint32_t kSalt = 0x5eed;
+
+fingerprint_msg_t message(fingerprint_msg_type_t type) {
+    fingerprint_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = type;
+    return msg;
+}
+
+unique_fd captureFile(const void* data, size_t size) {
+    unique_fd fd(memfd_create("capture", 0));
+    EXPECT_EQ(write(fd.get(), data, size), static_cast<ssize_t>(size));
+    lseek(fd.get(), 0, SEEK_SET);
+    return fd;
+}
+
+std::vector<uint8_t> captureBytes(uint32_t count, uint32_t version = MessageCapture::kVersion) {
+    CaptureHeader header = {};
+    memcpy(header.magic, MessageCapture::kMagic, sizeof(header.magic));
+    header.version = version;
+    header.count = count;
+    std::vector<uint8_t> bytes(sizeof(header) + count * sizeof(CapturedMessage));
+    memcpy(bytes.data(), &header, sizeof(header));
+    return bytes;
+}
+
+bool readCapture(const std::vector<uint8_t>& bytes, std::vector<CapturedMessage>* messages) {
+    return MessageCapture::read(captureFile(bytes.data(), bytes.size()).get(), messages);
+}
+
+TEST(MessageCaptureTest, RoundTripsEveryField) {
+    auto acquired = message(FINGERPRINT_ACQUIRED);
+    acquired.data.acquired.acquired_info = FINGERPRINT_ACQUIRED_PARTIAL;
+    auto decoded = MessageCapture::decode(MessageCapture::encode(acquired, 7, kSalt));
+    EXPECT_EQ(decoded.type, FINGERPRINT_ACQUIRED);
+    EXPECT_EQ(decoded.data.acquired.acquired_info, FINGERPRINT_ACQUIRED_PARTIAL);
+
+    auto error = message(FINGERPRINT_ERROR);
+    error.data.error = FINGERPRINT_ERROR_LOCKOUT;
+    EXPECT_EQ(MessageCapture::decode(MessageCapture::encode(error, 0, kSalt)).data.error,
+              FINGERPRINT_ERROR_LOCKOUT);
+
+    auto removed = message(FINGERPRINT_TEMPLATE_REMOVED);
+    removed.data.removed.finger = {0, 3};
+    removed.data.removed.remaining_templates = 2;
+    auto captured = MessageCapture::encode(removed, 42, kSalt);
+    EXPECT_EQ(captured.timeNs, 42);
+    decoded = MessageCapture::decode(captured);
+    EXPECT_EQ(decoded.data.removed.remaining_templates, 2);
+    // Group 0 means every group, it is kept as is
+    EXPECT_EQ(decoded.data.removed.finger.gid, 0);
+}
+
+TEST(MessageCaptureTest, HashesIdsAndDropsTokens) {
+    auto authenticated = message(FINGERPRINT_AUTHENTICATED);
+    authenticated.data.authenticated.finger = {0, 42};
+    authenticated.data.authenticated.hat.challenge = 123;
+    authenticated.data.authenticated.hat.user_id = 456;
+
+    auto decoded = MessageCapture::decode(MessageCapture::encode(authenticated, 0, kSalt));
+    EXPECT_NE(decoded.data.authenticated.finger.fid, 42);
+    // Still a match, failed attempts are fid 0
+    EXPECT_NE(decoded.data.authenticated.finger.fid, 0);
+    EXPECT_EQ(decoded.data.authenticated.hat.challenge, 0);
+    EXPECT_EQ(decoded.data.authenticated.hat.user_id, 0);
+
+    // The same finger hashes the same within a capture, not across captures
+    EXPECT_EQ(MessageCapture::encode(authenticated, 0, kSalt).args[0],
+              MessageCapture::encode(authenticated, 9, kSalt).args[0]);
+    EXPECT_NE(MessageCapture::encode(authenticated, 0, kSalt).args[0],
+              MessageCapture::encode(authenticated, 0, kSalt + 1).args[0]);
+}
+
+TEST(MessageCaptureTest, KeepsTheMostRecentMessages) {
+    constexpr int kRecorded = MessageCapture::kMaxMessages + 1000;
+    auto& capture = MessageCapture::get();
+    capture.start();
+    for (int i = 0; i < kRecorded; i++) {
+        auto error = message(FINGERPRINT_ERROR);
+        error.data.error = static_cast<fingerprint_error_t>(i);
+        capture.record(&error);
+    }
+    capture.stop();
+    auto ignored = message(FINGERPRINT_ACQUIRED);
+    capture.record(&ignored);
+
+    unique_fd fd(memfd_create("capture", 0));
+    capture.dump(fd.get());
+    lseek(fd.get(), 0, SEEK_SET);
+    std::vector<CapturedMessage> messages;
+    ASSERT_TRUE(MessageCapture::read(fd.get(), &messages));
+    ASSERT_EQ(messages.size(), MessageCapture::kMaxMessages);
+    EXPECT_EQ(messages.front().args[0], kRecorded - MessageCapture::kMaxMessages);
+    EXPECT_EQ(messages.back().args[0], kRecorded - 1);
+    EXPECT_EQ(messages.back().type, FINGERPRINT_ERROR);
+    for (size_t i = 1; i < messages.size(); i++) {
+        ASSERT_GE(messages[i].timeNs, messages[i - 1].timeNs);
+    }
+}
+
+TEST(MessageCaptureTest, ReadRejectsBadFiles) {
+    std::vector<CapturedMessage> messages;
+    EXPECT_TRUE(readCapture(captureBytes(3), &messages));
+    EXPECT_EQ(messages.size(), 3);
+
+    auto badMagic = captureBytes(1);
+    badMagic[0] = 'X';
+    EXPECT_FALSE(readCapture(badMagic, &messages));
+    EXPECT_FALSE(readCapture(captureBytes(1, MessageCapture::kVersion + 1), &messages));
+
+    // More messages than a capture ever holds, rejected before allocating them
+    auto huge = captureBytes(0);
+    reinterpret_cast<CaptureHeader*>(huge.data())->count = UINT32_MAX;
+    EXPECT_FALSE(readCapture(huge, &messages));
+
+    auto truncated = captureBytes(3);
+    truncated.resize(truncated.size() - 1);
+    EXPECT_FALSE(readCapture(truncated, &messages));
+    EXPECT_FALSE(readCapture({}, &messages));
+}
+
+class MessageReplayTest : public FingerprintTest {
+  protected:
+    // An unlock with a few partial touches and a failed attempt first
+    void unlock() {
+        std::shared_ptr<common::ICancellationSignal> signal;
+        mSession->authenticate(1, &signal);
+        drain();
+        for (int i = 0; i < 5; i++) FakeDevice::sendAcquired(FINGERPRINT_ACQUIRED_PARTIAL);
+        FakeDevice::sendAcquired(FINGERPRINT_ACQUIRED_GOOD);
+        FakeDevice::sendAuthenticated(0);
+        FakeDevice::sendAcquired(FINGERPRINT_ACQUIRED_GOOD);
+        FakeDevice::sendAuthenticated(1);
+        drain();
+    }
+};
+
+TEST_F(MessageReplayTest, ReplayMatchesTheCapturedSession) {
+    auto& capture = MessageCapture::get();
+    capture.start();
+    unlock();
+    capture.stop();
+    std::string captured = mCallback->events();
+    ASSERT_NE(captured.find("succeeded"), std::string::npos) << captured;
+
+    unique_fd fd(memfd_create("capture", 0));
+    capture.dump(fd.get());
+    lseek(fd.get(), 0, SEEK_SET);
+    std::vector<CapturedMessage> messages;
+    ASSERT_TRUE(MessageCapture::read(fd.get(), &messages));
+    ASSERT_EQ(messages.size(), 9);
+
+    // The same request, with the vendor messages coming from the capture
+    mCallback->clear();
+    std::shared_ptr<common::ICancellationSignal> signal;
+    mSession->authenticate(1, &signal);
+    drain();
+    for (const auto& message : messages) FakeDevice::send(MessageCapture::decode(message));
+    drain();
+    EXPECT_EQ(mCallback->events(), captured);
+}
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "FakeFingerprintHal.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+// Covers the whole open backoff (100 ms doubling to 2 s) and some slack
+constexpr auto kRecoveryTimeout = std::chrono::seconds(8);
+
+const std::string kHwUnavailable =
+        "err" + std::to_string(static_cast<int32_t>(Error::HW_UNAVAILABLE)) + "/0 ";
+
+bool waitFor(std::function<bool()> done, std::chrono::milliseconds timeout = kRecoveryTimeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+class RecoveryTest : public FingerprintTest {};
+
+TEST_F(RecoveryTest, RestoresTheActiveGroup) {
+    int groups = FakeDevice::activeGroups;
+    mEngine->requestRecovery("test");
+    ASSERT_TRUE(waitFor([&] { return FakeDevice::activeGroups == groups + 1; }));
+
+    std::shared_ptr<common::ICancellationSignal> signal;
+    mSession->authenticate(1, &signal);
+    drain();
+    EXPECT_TRUE(waitFor([] { return FakeDevice::authenticates == 1; }));
+}
+
+TEST_F(RecoveryTest, UnknownMessageRecovers) {
+    int groups = FakeDevice::activeGroups;
+    fingerprint_msg_t msg = {};
+    msg.type = static_cast<fingerprint_msg_type_t>(0x7fff);
+    FakeDevice::send(msg);
+    EXPECT_TRUE(waitFor([&] { return FakeDevice::activeGroups == groups + 1; }));
+}
+
+TEST_F(RecoveryTest, FailsTheOperationInFlight) {
+    std::shared_ptr<common::ICancellationSignal> signal;
+    mSession->authenticate(1, &signal);
+    drain();
+    mEngine->requestRecovery("test");
+    EXPECT_TRUE(waitFor([&] { return mCallback->events() == kHwUnavailable; }));
+}
+
+TEST_F(RecoveryTest, KeepsTryingWhenTheModuleWontOpen) {
+    int groups = FakeDevice::activeGroups;
+    FakeDevice::failOpen = true;
+    mEngine->requestRecovery("test");
+    ASSERT_TRUE(waitFor([&] { return mCallback->events() == kHwUnavailable; }));
+
+    FakeDevice::failOpen = false;
+    EXPECT_TRUE(waitFor([&] { return FakeDevice::activeGroups == groups + 1; }));
+}
+
+TEST_F(RecoveryTest, DestroyedWhileReopening) {
+    FakeDevice::failOpen = true;
+    mEngine->requestRecovery("test");
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    // The backoff wait is interrupted, the engine doesn't linger for the rest of it
+    auto startedAt = std::chrono::steady_clock::now();
+    mEngine->setSession(nullptr);
+    mSession.reset();
+    mEngine.reset();
+    EXPECT_LT(std::chrono::steady_clock::now() - startedAt, std::chrono::milliseconds(500));
+}
+
+TEST(RecoveryNoGroupTest, NothingToRestore) {
+    FakeDevice::reset();
+    auto engine = std::make_shared<FakeEngine>();
+    engine->start();
+    engine->getDevice();
+
+    engine->requestRecovery("test");
+    ASSERT_TRUE(engine->getDevice());
+    // The group is restored before the queued calls, give it the chance to show up
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(FakeDevice::activeGroups, 0);
+}
+
+TEST(RecoveryNoGroupTest, RacesTheDestructor) {
+    FakeDevice::reset();
+    for (int i = 0; i < 50; i++) {
+        auto engine = std::make_shared<FakeEngine>();
+        engine->start();
+        engine->getDevice();
+        std::thread recovery([engine] { engine->requestRecovery("race"); });
+        std::this_thread::sleep_for(std::chrono::microseconds(100 * (i % 5)));
+        // Whichever of the two lets go last destroys the engine
+        engine.reset();
+        recovery.join();
+    }
+}
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
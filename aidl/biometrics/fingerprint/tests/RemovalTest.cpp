@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "FakeFingerprintHal.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+// A little past the engine's removal timeout
+constexpr auto kRemovalDeadline = std::chrono::milliseconds(5500);
+
+// How a batch that didn't finish is failed
+const std::string kUnableToRemove =
+        "err" + std::to_string(static_cast<int32_t>(Error::UNABLE_TO_REMOVE)) + "/0 ";
+
+class RemovalTest : public FingerprintTest {};
+
+TEST_F(RemovalTest, ReportsOnceTheBatchIsDone) {
+    mSession->removeEnrollments({1, 2});
+    drain();
+    FakeDevice::sendRemoved(1, 1);
+    EXPECT_EQ(mCallback->events(), "");
+    FakeDevice::sendRemoved(2, 0);
+    EXPECT_EQ(mCallback->events(), "removed[1,2,] ");
+}
+
+TEST_F(RemovalTest, NextBatchFailsTheUnfinishedOne) {
+    // The vendor library never reports fid 2
+    mSession->removeEnrollments({1, 2});
+    drain();
+    FakeDevice::sendRemoved(1, 5);
+    EXPECT_EQ(mCallback->events(), "");
+
+    mSession->removeEnrollments({3});
+    drain();
+    EXPECT_EQ(mCallback->events(), "removed[1,] " + kUnableToRemove);
+    mCallback->clear();
+
+    FakeDevice::sendRemoved(3, 4);
+    EXPECT_EQ(mCallback->events(), "removed[3,] ");
+}
+
+TEST_F(RemovalTest, UnsolicitedRemovalIsReported) {
+    FakeDevice::sendRemoved(8, 3);
+    EXPECT_EQ(mCallback->events(), "removed[8,] ");
+}
+
+TEST_F(RemovalTest, DeadlineFailsTheBatch) {
+    mSession->removeEnrollments({5, 6});
+    drain();
+    FakeDevice::sendRemoved(5, 2);
+
+    // Nothing else arrives, the batch fails on its own
+    std::this_thread::sleep_for(kRemovalDeadline);
+    drain();
+    EXPECT_EQ(mCallback->events(), "removed[5,] " + kUnableToRemove);
+    mCallback->clear();
+
+    // A late report is passed through as is
+    FakeDevice::sendRemoved(6, 1);
+    EXPECT_EQ(mCallback->events(), "removed[6,] ");
+}
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Built with AddressSanitizer: anything still pointing at a session after it is
+// gone shows up as a use-after-free, a death cookie that is never freed as a leak.
+
+#include <chrono>
+#include <thread>
+
+#include "FakeFingerprintHal.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+// Keyguard retries open a new session for every attempt
+constexpr int kSessions = 2000;
+
+class SessionChurnTest : public FingerprintTest {
+  protected:
+    std::shared_ptr<Session> newSession() {
+        LockoutConfig config;
+        // Every failed attempt starts a lockout timer that may outlive the session
+        config.timedThreshold = 1;
+        config.timedDurationMs = 1;
+        auto session = ndk::SharedRefBase::make<Session>(mEngine, mWorker, mCallback,
+                                                         LockoutTracker(config));
+        mEngine->setSession(session);
+        // Fails for a local binder on a device, the cookie must not leak either way
+        session->linkToDeath(mCallback->asBinder().get());
+        return session;
+    }
+};
+
+TEST_F(SessionChurnTest, SignalsOutliveTheSession) {
+    for (int i = 0; i < kSessions; i++) {
+        auto session = newSession();
+        std::shared_ptr<common::ICancellationSignal> signal;
+        session->authenticate(i, &signal);
+        drain();
+        session->close();
+        drain();
+        session.reset();
+
+        // The session is gone, the cancel has nothing to reach
+        signal->cancel();
+    }
+}
+
+TEST_F(SessionChurnTest, TimersOutliveTheSession) {
+    for (int i = 0; i < kSessions; i++) {
+        auto session = newSession();
+        std::shared_ptr<common::ICancellationSignal> signal;
+        session->authenticate(i, &signal);
+        drain();
+        FakeDevice::sendAuthenticated(0);
+        session->close();
+        session.reset();
+        drain();
+    }
+    // Let the last timers fire into sessions that no longer exist
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+TEST_F(SessionChurnTest, ClosedWithOperationsQueued) {
+    for (int i = 0; i < kSessions; i++) {
+        auto session = newSession();
+        std::shared_ptr<common::ICancellationSignal> signal;
+        session->enumerateEnrollments();
+        session->getAuthenticatorId();
+        session->authenticate(i, &signal);
+        session->close();
+        session.reset();
+        signal->cancel();
+    }
+    drain();
+}
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
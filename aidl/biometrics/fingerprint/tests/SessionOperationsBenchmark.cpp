@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <SessionOperations.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+// The framework end, doing nothing so only the layering is measured
+class NullCallback : public BnSessionCallback {
+  public:
+    ndk::ScopedAStatus onChallengeGenerated(int64_t) override { return ok(); }
+    ndk::ScopedAStatus onChallengeRevoked(int64_t) override { return ok(); }
+    ndk::ScopedAStatus onAcquired(AcquiredInfo, int32_t) override { return ok(); }
+    ndk::ScopedAStatus onError(Error, int32_t) override { return ok(); }
+    ndk::ScopedAStatus onEnrollmentProgress(int32_t, int32_t) override { return ok(); }
+    ndk::ScopedAStatus onAuthenticationSucceeded(int32_t,
+                                                 const keymaster::HardwareAuthToken&) override {
+        return ok();
+    }
+    ndk::ScopedAStatus onAuthenticationFailed() override { return ok(); }
+    ndk::ScopedAStatus onLockoutTimed(int64_t) override { return ok(); }
+    ndk::ScopedAStatus onLockoutPermanent() override { return ok(); }
+    ndk::ScopedAStatus onLockoutCleared() override { return ok(); }
+    ndk::ScopedAStatus onInteractionDetected() override { return ok(); }
+    ndk::ScopedAStatus onEnrollmentsEnumerated(const std::vector<int32_t>&) override {
+        return ok();
+    }
+    ndk::ScopedAStatus onEnrollmentsRemoved(const std::vector<int32_t>&) override { return ok(); }
+    ndk::ScopedAStatus onAuthenticatorIdRetrieved(int64_t) override { return ok(); }
+    ndk::ScopedAStatus onAuthenticatorIdInvalidated(int64_t) override { return ok(); }
+    ndk::ScopedAStatus onSessionClosed() override { return ok(); }
+
+  private:
+    static ndk::ScopedAStatus ok() { return ndk::ScopedAStatus::ok(); }
+};
+
+// range(0) picks the path: 0 calls the framework callback directly, 1 goes through
+// OperationCallback with an authenticate running, as the engine does
+std::shared_ptr<ISessionCallback> callbackFor(const benchmark::State& state,
+                                              std::shared_ptr<Operation>* operation) {
+    auto null = ndk::SharedRefBase::make<NullCallback>();
+    if (state.range(0) == 0) return null;
+    auto layered = ndk::SharedRefBase::make<OperationCallback>(null);
+    *operation = layered->begin(OperationType::AUTHENTICATE, nullptr);
+    layered->start(*operation);
+    return layered;
+}
+
+// The per-touch messages, which don't end the operation
+void BM_Acquired(benchmark::State& state) {
+    std::shared_ptr<Operation> operation;
+    auto callback = callbackFor(state, &operation);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(callback->onAcquired(AcquiredInfo::GOOD, 0));
+    }
+}
+BENCHMARK(BM_Acquired)->Arg(0)->Arg(1);
+
+void BM_AuthenticationFailed(benchmark::State& state) {
+    std::shared_ptr<Operation> operation;
+    auto callback = callbackFor(state, &operation);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(callback->onAuthenticationFailed());
+    }
+}
+BENCHMARK(BM_AuthenticationFailed)->Arg(0)->Arg(1);
+
+// A whole operation: registered on the binder thread, started on the worker and
+// completed by the callback that ends it
+void BM_OperationLifecycle(benchmark::State& state) {
+    auto callback = ndk::SharedRefBase::make<OperationCallback>(
+            ndk::SharedRefBase::make<NullCallback>());
+    int64_t id = 0;
+    for (auto _ : state) {
+        auto operation = callback->begin(OperationType::GET_AUTHENTICATOR_ID, nullptr);
+        callback->start(operation);
+        callback->onAuthenticatorIdRetrieved(++id);
+        benchmark::DoNotOptimize(operation->wait());
+    }
+}
+BENCHMARK(BM_OperationLifecycle);
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
+
+BENCHMARK_MAIN();
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <future>
+#include <thread>
+
+#include <SessionOperations.h>
+
+#include "FakeFingerprintHal.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+using Status = OperationResult::Status;
+using std::chrono::milliseconds;
+
+class OperationCallbackTest : public testing::Test {
+  protected:
+    std::shared_ptr<RecordingCallback> mRecorder = ndk::SharedRefBase::make<RecordingCallback>();
+    std::shared_ptr<OperationCallback> mCallback =
+            ndk::SharedRefBase::make<OperationCallback>(mRecorder);
+    int mCancels = 0;
+    std::function<void(int64_t)> mCancel = [this](int64_t) { mCancels++; };
+};
+
+TEST_F(OperationCallbackTest, ForwardsEverything) {
+    auto authenticate = mCallback->begin(OperationType::AUTHENTICATE, nullptr);
+    mCallback->start(authenticate);
+    mCallback->onAcquired(AcquiredInfo::GOOD, 0);
+    mCallback->onAuthenticationFailed();
+    mCallback->onLockoutCleared();
+    EXPECT_EQ(mRecorder->events(), "acquired1 failed lockoutCleared ");
+    EXPECT_FALSE(authenticate->done());
+}
+
+TEST_F(OperationCallbackTest, OnlyTheActiveOperationCompletes) {
+    auto enumerate = mCallback->begin(OperationType::ENUMERATE_ENROLLMENTS, nullptr);
+    // Not started yet
+    mCallback->onEnrollmentsEnumerated({1});
+    EXPECT_FALSE(enumerate->done());
+
+    mCallback->start(enumerate);
+    // Not a callback that ends an enumeration
+    mCallback->onAuthenticationFailed();
+    EXPECT_FALSE(enumerate->done());
+    EXPECT_EQ(enumerate->waitFor(milliseconds(1)).status, Status::TIMED_OUT);
+
+    std::thread engine([this] { mCallback->onEnrollmentsEnumerated({3, 4}); });
+    auto result = enumerate->wait();
+    engine.join();
+    EXPECT_EQ(result.status, Status::SUCCEEDED);
+    EXPECT_EQ(result.enrollmentIds, (std::vector<int32_t>{3, 4}));
+    EXPECT_EQ(mCallback->find(enumerate->id()), nullptr);
+}
+
+TEST_F(OperationCallbackTest, ResultsCarryTheirValue) {
+    auto challenge = mCallback->begin(OperationType::GENERATE_CHALLENGE, nullptr);
+    mCallback->start(challenge);
+    mCallback->onChallengeGenerated(42);
+    EXPECT_EQ(challenge->wait().value, 42);
+
+    auto authenticate = mCallback->begin(OperationType::AUTHENTICATE, nullptr);
+    mCallback->start(authenticate);
+    mCallback->onError(Error::HW_UNAVAILABLE, 7);
+    auto result = authenticate->wait();
+    EXPECT_EQ(result.status, Status::ERROR);
+    EXPECT_EQ(result.error, Error::HW_UNAVAILABLE);
+    EXPECT_EQ(result.vendorCode, 7);
+}
+
+TEST_F(OperationCallbackTest, CancelReachesTheEngineOnce) {
+    auto authenticate = mCallback->begin(OperationType::AUTHENTICATE, mCancel);
+    mCallback->start(authenticate);
+    auto token = authenticate->token();
+    EXPECT_TRUE(token.cancel());
+    authenticate->cancel();
+    EXPECT_EQ(mCancels, 1);
+
+    mCallback->onError(Error::CANCELED, 0);
+    EXPECT_EQ(authenticate->wait().status, Status::CANCELED);
+    // The confirmation is definitive, nothing is left to cancel
+    EXPECT_FALSE(authenticate->settled());
+    EXPECT_FALSE(token.cancel());
+    EXPECT_EQ(mCancels, 1);
+}
+
+TEST_F(OperationCallbackTest, TokensDontKeepOperationsAlive) {
+    CancellationToken token;
+    {
+        auto authenticate = mCallback->begin(OperationType::AUTHENTICATE, mCancel);
+        token = authenticate->token();
+        mCallback->abortAll();
+    }
+    EXPECT_FALSE(token.cancel());
+    EXPECT_EQ(mCancels, 0);
+}
+
+TEST_F(OperationCallbackTest, LockoutSettlesButStaysCancelable) {
+    auto authenticate = mCallback->begin(OperationType::AUTHENTICATE, mCancel);
+    mCallback->start(authenticate);
+    mCallback->onLockoutTimed(100);
+    EXPECT_TRUE(authenticate->done());
+    EXPECT_TRUE(authenticate->settled());
+    EXPECT_EQ(authenticate->wait().status, Status::LOCKED_OUT);
+    EXPECT_EQ(authenticate->wait().value, 100);
+
+    // The vendor may still be waiting for a finger
+    ASSERT_NE(mCallback->find(authenticate->id()), nullptr);
+    EXPECT_TRUE(authenticate->token().cancel());
+    EXPECT_EQ(mCancels, 1);
+    mCallback->onError(Error::CANCELED, 0);
+    EXPECT_EQ(mCallback->find(authenticate->id()), nullptr);
+    // The first result stands
+    EXPECT_EQ(authenticate->wait().status, Status::LOCKED_OUT);
+}
+
+TEST_F(OperationCallbackTest, NextOperationEndsTheStaleOne) {
+    auto stale = mCallback->begin(OperationType::GET_AUTHENTICATOR_ID, nullptr);
+    auto next = mCallback->begin(OperationType::REVOKE_CHALLENGE, nullptr);
+    mCallback->start(stale);
+    mCallback->start(next);
+    EXPECT_EQ(stale->wait().status, Status::ABORTED);
+    EXPECT_FALSE(next->done());
+
+    // A settled one is dropped the same way
+    mCallback->onError(Error::HW_UNAVAILABLE, 0);
+    ASSERT_TRUE(next->settled());
+    auto enumerate = mCallback->begin(OperationType::ENUMERATE_ENROLLMENTS, nullptr);
+    mCallback->start(enumerate);
+    EXPECT_EQ(mCallback->find(next->id()), nullptr);
+    EXPECT_EQ(next->wait().status, Status::ERROR);
+}
+
+TEST_F(OperationCallbackTest, AbortAllFailsWhatIsQueued) {
+    auto enroll = mCallback->begin(OperationType::ENROLL, nullptr);
+    mCallback->abortAll();
+    EXPECT_EQ(enroll->wait().status, Status::ABORTED);
+    // Started by a worker task that was already running
+    mCallback->start(enroll);
+    EXPECT_EQ(enroll->wait().status, Status::ABORTED);
+}
+
+TEST_F(OperationCallbackTest, WaitTimesOut) {
+    auto enumerate = mCallback->begin(OperationType::ENUMERATE_ENROLLMENTS, nullptr);
+    mCallback->start(enumerate);
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(enumerate->waitFor(milliseconds(20)).status, Status::TIMED_OUT);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, milliseconds(20));
+    // And the operation can still finish
+    mCallback->onEnrollmentsEnumerated({});
+    EXPECT_EQ(enumerate->wait().status, Status::SUCCEEDED);
+}
+
+using SessionOperationsTest = FingerprintTest;
+
+TEST_F(SessionOperationsTest, CancelAfterTheOperationEndedIsDropped) {
+    std::shared_ptr<common::ICancellationSignal> signal;
+    mSession->authenticate(1, &signal);
+    drain();
+
+    // Hold the worker, so the cancel is queued behind a match that ends the operation
+    std::promise<void> gate;
+    mWorker->schedule(Callable::from([done = gate.get_future().share()] { done.wait(); }));
+    signal->cancel();
+    FakeDevice::sendAuthenticated(3);
+    gate.set_value();
+    drain();
+    EXPECT_EQ(FakeDevice::cancels, 0);
+    EXPECT_EQ(mCallback->events(), "succeeded ");
+}
+
+TEST_F(SessionOperationsTest, CancelReachesTheVendor) {
+    std::shared_ptr<common::ICancellationSignal> signal;
+    mSession->authenticate(1, &signal);
+    drain();
+    signal->cancel();
+    drain();
+    EXPECT_EQ(FakeDevice::cancels, 1);
+}
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Drives a session from a binder thread, the vendor notify thread and a second
+// binder thread at once, with lockout timers running underneath. Meant to be run
+// under ThreadSanitizer, where any unsynchronized session or lockout state shows
+// up as a data race.
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "FakeFingerprintHal.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+constexpr int kIterations = 2000;
+
+class SessionRaceTest : public FingerprintTest {
+  protected:
+    void SetUp() override {
+        FingerprintTest::SetUp();
+        LockoutConfig config;
+        // Lock out after every other failure, for long enough to race the reset
+        config.timedThreshold = 2;
+        config.timedDurationMs = 1;
+        // Never permanent, that would stop the timers
+        config.permanentThreshold = INT32_MAX;
+        mSession = ndk::SharedRefBase::make<Session>(mEngine, mWorker, mCallback,
+                                                     LockoutTracker(config));
+        mEngine->setSession(mSession);
+    }
+};
+
+TEST_F(SessionRaceTest, AuthenticateFailResetCancel) {
+    std::atomic<bool> done = false;
+
+    // The framework: authenticate, then cancel it
+    std::thread framework([&] {
+        for (int i = 0; i < kIterations; i++) {
+            std::shared_ptr<common::ICancellationSignal> signal;
+            mSession->authenticate(i, &signal);
+            if (signal) signal->cancel();
+        }
+        done = true;
+    });
+    // The vendor library: mostly failed attempts, now and then a match
+    std::thread vendor([&] {
+        for (uint32_t i = 0; !done; i++) {
+            FakeDevice::sendAuthenticated(i % 8 == 0 ? 1 : 0);
+            std::this_thread::yield();
+        }
+    });
+    // Keyguard: a successful PIN entry resets the lockout
+    std::thread keyguard([&] {
+        keymaster::HardwareAuthToken hat;
+        while (!done) {
+            mSession->resetLockout(hat);
+            mSession->isClosed();
+            std::this_thread::yield();
+        }
+    });
+
+    framework.join();
+    vendor.join();
+    keyguard.join();
+    drain();
+}
+
+TEST_F(SessionRaceTest, CloseWhileNotified) {
+    std::thread vendor([&] {
+        for (int i = 0; i < kIterations; i++) {
+            FakeDevice::sendAuthenticated(0);
+            FakeDevice::sendError(FINGERPRINT_ERROR_CANCELED);
+        }
+    });
+    std::shared_ptr<common::ICancellationSignal> signal;
+    mSession->authenticate(1, &signal);
+    mSession->close();
+
+    vendor.join();
+    drain();
+    EXPECT_TRUE(mSession->isClosed());
+}
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace android
+} // namespace aidl
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+#include <compositionengine/UdfpsExtension.h>
+
+#include <random>
+#include <vector>
+
+namespace {
+
+// Touch states for a few seconds of frames, range(0) selects the pattern
+std::vector<bool> touchPattern(int pattern) {
+    std::vector<bool> touched(4096);
+    std::mt19937 random(1);
+    for (size_t i = 0; i < touched.size(); i++) {
+        switch (pattern) {
+            case 0:  // Held down
+                touched[i] = true;
+                break;
+            case 1:  // Random, a branch on it would mispredict half the time
+                touched[i] = random() & 1;
+                break;
+        }
+    }
+    return touched;
+}
+
+// Both patterns cost the same when the lookup doesn't branch on touched
+void BM_GetUdfpsZOrder(benchmark::State& state) {
+    auto touched = touchPattern(state.range(0));
+    for (auto _ : state) {
+        for (size_t i = 0; i < touched.size(); i++) {
+            benchmark::DoNotOptimize(getUdfpsZOrder(static_cast<uint32_t>(i), touched[i]));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * touched.size());
+}
+BENCHMARK(BM_GetUdfpsZOrder)->Arg(0)->Arg(1);
+
+void BM_GetUdfpsUsageBits(benchmark::State& state) {
+    auto touched = touchPattern(state.range(0));
+    for (auto _ : state) {
+        for (size_t i = 0; i < touched.size(); i++) {
+            benchmark::DoNotOptimize(getUdfpsUsageBits(i, touched[i]));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * touched.size());
+}
+BENCHMARK(BM_GetUdfpsUsageBits)->Arg(0)->Arg(1);
+
+}  // namespace
+
+BENCHMARK_MAIN();
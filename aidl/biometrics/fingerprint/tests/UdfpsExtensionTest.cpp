@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <compositionengine/UdfpsExtension.h>
+#include <gtest/gtest.h>
+
+#if __has_include(<display/drm/sde_drm.h>)
+#include <display/drm/sde_drm.h>
+#elif __has_include(<drm/sde_drm.h>)
+#include <drm/sde_drm.h>
+#endif
+
+namespace {
+
+constexpr uint32_t kZOrders[] = {0, 1, 0x1234, 0x40000000, UINT32_MAX};
+constexpr uint64_t kUsages[] = {0, 0x3, 0x20000, UINT64_MAX};
+
+TEST(UdfpsExtensionTest, UntouchedIsUnchanged) {
+    for (uint32_t z : kZOrders) EXPECT_EQ(getUdfpsZOrder(z, false), z);
+    for (uint64_t usage : kUsages) EXPECT_EQ(getUdfpsUsageBits(usage, false), usage);
+}
+
+TEST(UdfpsExtensionTest, TouchedRaisesTheLayer) {
+    for (uint32_t z : kZOrders) {
+#ifdef FOD_PRESSED_LAYER_ZORDER
+        EXPECT_EQ(getUdfpsZOrder(z, true), z | FOD_PRESSED_LAYER_ZORDER);
+#else
+        EXPECT_EQ(getUdfpsZOrder(z, true), 0x41000033u);
+#endif
+    }
+}
+
+TEST(UdfpsExtensionTest, TouchedKeepsTheUsage) {
+    // Panels may add bits, never drop the ones SurfaceFlinger asked for
+    for (uint64_t usage : kUsages) {
+        EXPECT_EQ(getUdfpsUsageBits(usage, true) & usage, usage);
+    }
+}
+
+TEST(UdfpsExtensionTest, NoStateAcrossFrames) {
+    uint32_t pressed = getUdfpsZOrder(0x1234, true);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(getUdfpsZOrder(0x1234, false), 0x1234u);
+        EXPECT_EQ(getUdfpsZOrder(0x1234, true), pressed);
+    }
+}
+
+}  // namespace
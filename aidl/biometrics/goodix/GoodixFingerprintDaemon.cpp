@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.goodix.hardware.biometrics.fingerprint-service.nubia"
+
+#include "GoodixFingerprintDaemon.h"
+
+#include <android-base/logging.h>
+#include <log/log.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+using ::android::sp;
+using ::android::hardware::hidl_death_recipient;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hidl::base::V1_0::IBase;
+
+namespace aidl {
+namespace vendor {
+namespace goodix {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+// Inside DaemonCallback the name of its HIDL base class hides the AIDL one
+using AidlDaemonCallback = IGoodixFingerprintDaemonCallback;
+
+// Only daemon messages have an AIDL counterpart, the rest are handled by the fingerprint HAL
+class GoodixFingerprintDaemon::DaemonCallback : public V2_1::IGoodixFingerprintDaemonCallback {
+  public:
+    explicit DaemonCallback(std::shared_ptr<AidlDaemonCallback> callback)
+        : mCallback(std::move(callback)) {}
+
+    Return<void> onEnrollResult(uint64_t, uint32_t, uint32_t, uint32_t) override { return Void(); }
+    Return<void> onAcquired(uint64_t, uint32_t) override { return Void(); }
+    Return<void> onAuthenticated(uint64_t, uint32_t, uint32_t, const hidl_vec<uint8_t>&) override {
+        return Void();
+    }
+    Return<void> onError(uint64_t, uint32_t) override { return Void(); }
+    Return<void> onRemoved(uint64_t, uint32_t, uint32_t) override { return Void(); }
+    Return<void> onTestCmd(uint64_t, uint32_t, const hidl_vec<uint8_t>&) override { return Void(); }
+
+    Return<void> onDaemonMessage(uint64_t devId, uint32_t msgId, uint32_t cmdId,
+                                 const hidl_vec<uint8_t>& msgData) override {
+        // The NDK backend takes a std::vector, this is the only copy on the way up
+        std::vector<uint8_t> data(msgData.begin(), msgData.end());
+        auto status = mCallback->onDaemonMessage(static_cast<int64_t>(devId),
+                                                 static_cast<int32_t>(msgId),
+                                                 static_cast<int32_t>(cmdId), data);
+        if (!status.isOk()) {
+            ALOGE("onDaemonMessage failed: %s", status.getDescription().c_str());
+        }
+        return Void();
+    }
+
+  private:
+    std::shared_ptr<AidlDaemonCallback> mCallback;
+};
+
+class GoodixFingerprintDaemon::DaemonDeathRecipient : public hidl_death_recipient {
+  public:
+    explicit DaemonDeathRecipient(GoodixFingerprintDaemon* daemon) : mDaemon(daemon) {}
+
+    void serviceDied(uint64_t /*cookie*/, const ::android::wp<IBase>& /*who*/) override {
+        mDaemon->onDaemonDied();
+    }
+
+  private:
+    // The bridge lives as long as the process
+    GoodixFingerprintDaemon* mDaemon;
+};
+
+GoodixFingerprintDaemon::GoodixFingerprintDaemon()
+    : GoodixFingerprintDaemon([] { return V2_1::IGoodixFingerprintDaemon::getService(); }) {}
+
+GoodixFingerprintDaemon::GoodixFingerprintDaemon(Connect connect)
+    : mConnect(std::move(connect)), mDeathRecipient(new DaemonDeathRecipient(this)) {}
+
+GoodixFingerprintDaemon::~GoodixFingerprintDaemon() = default;
+
+sp<V2_1::IGoodixFingerprintDaemon> GoodixFingerprintDaemon::getDaemon() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mDaemon) {
+        return mDaemon;
+    }
+
+    mDaemon = mConnect();
+    if (!mDaemon) {
+        ALOGE("Goodix fingerprint daemon is not available");
+        return nullptr;
+    }
+    mDaemon->linkToDeath(mDeathRecipient, 0 /* cookie */);
+    if (mCallback) {
+        // Registrations don't survive a daemon restart
+        auto ret = mDaemon->setNotify(mCallback);
+        if (!ret.isOk()) {
+            ALOGE("setNotify failed: %s", ret.description().c_str());
+        }
+    }
+    return mDaemon;
+}
+
+void GoodixFingerprintDaemon::onDaemonDied() {
+    ALOGW("Goodix fingerprint daemon died");
+    std::lock_guard<std::mutex> lock(mLock);
+    mDaemon = nullptr;
+}
+
+ndk::ScopedAStatus GoodixFingerprintDaemon::setNotify(
+        const std::shared_ptr<IGoodixFingerprintDaemonCallback>& callback) {
+    sp<DaemonCallback> hidlCallback = callback ? new DaemonCallback(callback) : nullptr;
+    sp<V2_1::IGoodixFingerprintDaemon> daemon;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mCallback = hidlCallback;
+        daemon = mDaemon;
+    }
+
+    if (!daemon) {
+        // Connecting registers mCallback, don't register it a second time
+        return getDaemon() ? ndk::ScopedAStatus::ok()
+                           : ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    }
+    auto ret = daemon->setNotify(hidlCallback);
+    if (!ret.isOk()) {
+        ALOGE("setNotify failed: %s", ret.description().c_str());
+        return ndk::ScopedAStatus::fromExceptionCode(EX_TRANSACTION_FAILED);
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus GoodixFingerprintDaemon::sendCommand(int32_t cmdId,
+                                                        const std::vector<uint8_t>& param,
+                                                        CommandResult* _aidl_return) {
+    sp<V2_1::IGoodixFingerprintDaemon> daemon = getDaemon();
+    if (!daemon) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    }
+
+    // Lend the parcel's buffer to HIDL instead of copying it
+    hidl_vec<uint8_t> data;
+    data.setToExternal(const_cast<uint8_t*>(param.data()), param.size(), false /* shouldOwn */);
+
+    auto ret = daemon->sendCommand(
+            static_cast<uint32_t>(cmdId), data,
+            [_aidl_return](int32_t resultCode, const hidl_vec<int8_t>& result) {
+                _aidl_return->errCode = resultCode;
+                const uint8_t* bytes = reinterpret_cast<const uint8_t*>(result.data());
+                _aidl_return->data.assign(bytes, bytes + result.size());
+            });
+    if (!ret.isOk()) {
+        ALOGE("sendCommand(%d) failed: %s", cmdId, ret.description().c_str());
+        return ndk::ScopedAStatus::fromExceptionCode(EX_TRANSACTION_FAILED);
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+binder_status_t GoodixFingerprintDaemon::dump(int fd, const char** args, uint32_t numArgs) {
+    if (numArgs >= 1 && !strcmp(args[0], "--hbd-start")) {
+        return mHbd.start() ? STATUS_OK : STATUS_UNKNOWN_ERROR;
+    }
+    if (numArgs >= 1 && !strcmp(args[0], "--hbd-stop")) {
+        return mHbd.stop() ? STATUS_OK : STATUS_UNKNOWN_ERROR;
+    }
+    if (numArgs >= 1 && !strcmp(args[0], "--hbd")) {
+        // Latest window of raw samples, every <decimation>th one
+        size_t window = numArgs >= 2 ? std::min<size_t>(atoi(args[1]), HbdStream::kRawCapacity)
+                                     : 256;
+        size_t decimation = numArgs >= 3 ? std::max(atoi(args[2]), 1) : 1;
+        std::vector<uint32_t> samples(window);
+        samples.resize(mHbd.pullLatestRaw(samples.data(), window, decimation));
+        for (uint32_t sample : samples) {
+            dprintf(fd, "%u\n", sample);
+        }
+        return STATUS_OK;
+    }
+    if (numArgs > 0) {
+        dprintf(fd, "usage: dumpsys %s/default [--hbd-start | --hbd-stop | "
+                    "--hbd [window] [decimation]]\n", descriptor);
+        return STATUS_BAD_VALUE;
+    }
+
+    mHbd.dump(fd);
+    return STATUS_OK;
+}
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace goodix
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/vendor/goodix/hardware/biometrics/fingerprint/BnGoodixFingerprintDaemon.h>
+#include <vendor/goodix/hardware/biometrics/fingerprint/2.1/IGoodixFingerprintDaemon.h>
+
+#include <functional>
+#include <mutex>
+
+#include "HbdStream.h"
+
+namespace aidl {
+namespace vendor {
+namespace goodix {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+// AIDL front for the HIDL Goodix daemon. Payloads are handed to HIDL without
+// copying; only the replies are copied once, into the parcelable that owns them.
+class GoodixFingerprintDaemon : public BnGoodixFingerprintDaemon {
+  public:
+    // Returns the HIDL daemon, nullptr when it is not running
+    using Connect = std::function<::android::sp<V2_1::IGoodixFingerprintDaemon>()>;
+
+    // Connects to the registered HIDL service
+    GoodixFingerprintDaemon();
+    // Connects through connect instead, e.g. to a stand-in daemon in the same process
+    explicit GoodixFingerprintDaemon(Connect connect);
+    // Defined where DaemonCallback and DaemonDeathRecipient are complete
+    ~GoodixFingerprintDaemon();
+
+    ndk::ScopedAStatus setNotify(
+            const std::shared_ptr<IGoodixFingerprintDaemonCallback>& callback) override;
+    ndk::ScopedAStatus sendCommand(int32_t cmdId, const std::vector<uint8_t>& param,
+                                   CommandResult* _aidl_return) override;
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
+  private:
+    class DaemonCallback;
+    class DaemonDeathRecipient;
+
+    // Connects to the HIDL daemon if needed, nullptr when it is not available
+    ::android::sp<V2_1::IGoodixFingerprintDaemon> getDaemon();
+    void onDaemonDied();
+
+    const Connect mConnect;
+    std::mutex mLock;
+    ::android::sp<V2_1::IGoodixFingerprintDaemon> mDaemon;
+    ::android::sp<DaemonCallback> mCallback;
+    ::android::sp<DaemonDeathRecipient> mDeathRecipient;
+
+    HbdStream mHbd;
+};
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace goodix
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.goodix.hardware.biometrics.fingerprint-service.nubia"
+
+#include "HbdStream.h"
+
+#include <log/log.h>
+#include <unistd.h>
+
+#include <cinttypes>
+
+using ::android::sp;
+using ::android::hardware::hidl_death_recipient;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hidl::base::V1_0::IBase;
+
+namespace aidl {
+namespace vendor {
+namespace goodix {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+class HbdStream::Callback : public V2_1::IGoodixFingerprintDaemonHbdCallback {
+  public:
+    explicit Callback(HbdStream* stream) : mStream(stream) {}
+
+    Return<void> onHbdData(uint64_t /*devId*/, uint32_t heartBeatRate, uint32_t status,
+                           const hidl_vec<uint32_t>& /*displayData*/,
+                           const hidl_vec<uint32_t>& rawData) override {
+        mStream->onHbdData(heartBeatRate, status, rawData.data(), rawData.size());
+        return Void();
+    }
+
+  private:
+    // The stream lives as long as the process
+    HbdStream* mStream;
+};
+
+class HbdStream::DeathRecipient : public hidl_death_recipient {
+  public:
+    explicit DeathRecipient(HbdStream* stream) : mStream(stream) {}
+
+    void serviceDied(uint64_t /*cookie*/, const ::android::wp<IBase>& /*who*/) override {
+        mStream->onDaemonDied();
+    }
+
+  private:
+    // The stream lives as long as the process
+    HbdStream* mStream;
+};
+
+HbdStream::HbdStream()
+    : HbdStream([] { return V2_1::IGoodixFingerprintDaemonHbd::getService(); }) {}
+
+HbdStream::HbdStream(Connect connect)
+    : mConnect(std::move(connect)), mDeathRecipient(new DeathRecipient(this)) {}
+
+HbdStream::~HbdStream() = default;
+
+bool HbdStream::start() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mStarted) return true;
+
+    if (!mHbd) {
+        mHbd = mConnect();
+        if (!mHbd) {
+            ALOGE("Goodix HBD daemon is not available");
+            return false;
+        }
+        mHbd->linkToDeath(mDeathRecipient, 0 /* cookie */);
+        mCallback = new Callback(this);
+        mHbd->initCallback(mCallback);
+    }
+
+    auto ret = mHbd->startHbd();
+    if (!ret.isOk()) {
+        ALOGE("startHbd failed: %s", ret.description().c_str());
+        return false;
+    }
+    if (int32_t err = ret; err != 0) {
+        ALOGE("startHbd failed: %d", err);
+        return false;
+    }
+    mStarted = true;
+    return true;
+}
+
+bool HbdStream::stop() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mStarted) return true;
+
+    auto ret = mHbd->stopHbd();
+    if (!ret.isOk()) {
+        ALOGE("stopHbd failed: %s", ret.description().c_str());
+        return false;
+    }
+    if (int32_t err = ret; err != 0) {
+        ALOGE("stopHbd failed: %d", err);
+        return false;
+    }
+    mStarted = false;
+    return true;
+}
+
+void HbdStream::onDaemonDied() {
+    ALOGW("Goodix HBD daemon died");
+    // The daemon forgets the callback and stops streaming, the next start() reconnects
+    std::lock_guard<std::mutex> lock(mLock);
+    mHbd = nullptr;
+    mCallback = nullptr;
+    mStarted = false;
+}
+
+void HbdStream::onHbdData(uint32_t heartBeatRate, uint32_t status, const uint32_t* rawData,
+                          size_t rawCount) {
+    mHeartBeatRate.store(heartBeatRate, std::memory_order_relaxed);
+    mStatus.store(status, std::memory_order_relaxed);
+    mFrames.fetch_add(1, std::memory_order_relaxed);
+    mRaw.push(rawData, rawCount);
+}
+
+void HbdStream::dump(int fd) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        dprintf(fd, "HBD: %s, heart rate %u, status %u\n", mStarted ? "started" : "stopped",
+                heartBeatRate(), status());
+    }
+    dprintf(fd, "  frames: %" PRIu64 "\n", mFrames.load(std::memory_order_relaxed));
+    dprintf(fd, "  raw samples: %" PRIu64 " written, %" PRIu64 " dropped, %zu buffered\n",
+            mRaw.written(), mRaw.dropped(), mRaw.size());
+}
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace goodix
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <vendor/goodix/hardware/biometrics/fingerprint/2.1/IGoodixFingerprintDaemonHbd.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+#include "SpscRing.h"
+
+namespace aidl {
+namespace vendor {
+namespace goodix {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace V2_1 = ::vendor::goodix::hardware::biometrics::fingerprint::V2_1;
+
+// Raw heart beat samples from the daemon's onHbdData, buffered for a single reader.
+// The callback only copies into a preallocated ring, it never allocates. The display
+// samples are a downsampled copy of the raw ones and are not kept.
+class HbdStream {
+  public:
+    // Returns the HIDL HBD daemon, nullptr when it is not running
+    using Connect = std::function<::android::sp<V2_1::IGoodixFingerprintDaemonHbd>()>;
+
+    // Connects to the registered HIDL service
+    HbdStream();
+    // Connects through connect instead, e.g. to a stand-in daemon in the same process
+    explicit HbdStream(Connect connect);
+    // Defined where Callback and DeathRecipient are complete
+    ~HbdStream();
+
+    // About 16 s of raw samples at the sensor's 1 kHz rate
+    static constexpr size_t kRawCapacity = 16384;
+
+    bool start();
+    bool stop();
+
+    // Single consumer, see SpscRing::pullLatest
+    size_t pullLatestRaw(uint32_t* out, size_t window, size_t decimation = 1) {
+        return mRaw.pullLatest(out, window, decimation);
+    }
+
+    uint32_t heartBeatRate() const { return mHeartBeatRate.load(std::memory_order_relaxed); }
+    uint32_t status() const { return mStatus.load(std::memory_order_relaxed); }
+
+    void dump(int fd);
+
+  private:
+    class Callback;
+    class DeathRecipient;
+
+    void onDaemonDied();
+    void onHbdData(uint32_t heartBeatRate, uint32_t status, const uint32_t* rawData,
+                   size_t rawCount);
+
+    const Connect mConnect;
+    std::mutex mLock;
+    ::android::sp<V2_1::IGoodixFingerprintDaemonHbd> mHbd;
+    ::android::sp<Callback> mCallback;
+    ::android::sp<DeathRecipient> mDeathRecipient;
+    bool mStarted = false;
+
+    std::atomic<uint32_t> mHeartBeatRate = 0;
+    std::atomic<uint32_t> mStatus = 0;
+    std::atomic<uint64_t> mFrames = 0;
+    SpscRing<uint32_t, kRawCapacity> mRaw;
+};
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace goodix
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace aidl {
+namespace vendor {
+namespace goodix {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+// Fixed-capacity single producer, single consumer ring of trivially copyable
+// samples. Samples are stored contiguously and aligned to a cache line, so a
+// pull without decimation is at most two memcpy calls. When full, new samples
+// are dropped rather than overwriting unread ones.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(std::is_trivially_copyable_v<T>);
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  public:
+    static constexpr size_t kCapacity = Capacity;
+
+    // Producer side, returns the number of samples stored
+    size_t push(const T* samples, size_t count) {
+        uint64_t head = mHead.load(std::memory_order_relaxed);
+        uint64_t tail = mTail.load(std::memory_order_acquire);
+        size_t stored = std::min(count, Capacity - static_cast<size_t>(head - tail));
+
+        size_t offset = head & kMask;
+        size_t first = std::min(stored, Capacity - offset);
+        std::memcpy(&mData[offset], samples, first * sizeof(T));
+        std::memcpy(&mData[0], samples + first, (stored - first) * sizeof(T));
+
+        mHead.store(head + stored, std::memory_order_release);
+        mDropped.fetch_add(count - stored, std::memory_order_relaxed);
+        return stored;
+    }
+
+    // Consumer side. Reads up to maxOut samples, keeping one of every `decimation`
+    // and consuming everything it stepped over. Returns the number written to out.
+    size_t pull(T* out, size_t maxOut, size_t decimation = 1) {
+        decimation = std::max<size_t>(decimation, 1);
+        uint64_t tail = mTail.load(std::memory_order_relaxed);
+        uint64_t head = mHead.load(std::memory_order_acquire);
+        size_t count = std::min(maxOut, static_cast<size_t>(head - tail) / decimation);
+
+        if (decimation == 1) {
+            size_t offset = tail & kMask;
+            size_t first = std::min(count, Capacity - offset);
+            std::memcpy(out, &mData[offset], first * sizeof(T));
+            std::memcpy(out + first, &mData[0], (count - first) * sizeof(T));
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                out[i] = mData[(tail + i * decimation) & kMask];
+            }
+        }
+
+        mTail.store(tail + count * decimation, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side. Drops everything but the most recent window * decimation
+    // samples, then pulls them as above.
+    size_t pullLatest(T* out, size_t window, size_t decimation = 1) {
+        decimation = std::max<size_t>(decimation, 1);
+        uint64_t tail = mTail.load(std::memory_order_relaxed);
+        uint64_t head = mHead.load(std::memory_order_acquire);
+        size_t keep = window * decimation;
+        if (head - tail > keep) {
+            mTail.store(head - keep, std::memory_order_release);
+        }
+        return pull(out, window, decimation);
+    }
+
+    size_t size() const {
+        return static_cast<size_t>(mHead.load(std::memory_order_acquire) -
+                                   mTail.load(std::memory_order_acquire));
+    }
+
+    uint64_t written() const { return mHead.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return mDropped.load(std::memory_order_relaxed); }
+
+  private:
+    static constexpr size_t kMask = Capacity - 1;
+
+    // Producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<uint64_t> mHead = 0;
+    alignas(64) std::atomic<uint64_t> mTail = 0;
+    alignas(64) std::atomic<uint64_t> mDropped = 0;
+    alignas(64) std::array<T, Capacity> mData;
+};
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace goodix
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "GoodixFingerprintDaemon.h"
+
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <android-base/logging.h>
+#include <hidl/HidlTransportSupport.h>
+
+using ::aidl::vendor::goodix::hardware::biometrics::fingerprint::GoodixFingerprintDaemon;
+
+int main() {
+    // HIDL callbacks from the daemon arrive on the hwbinder pool
+    ::android::hardware::configureRpcThreadpool(1, false /* callerWillJoin */);
+    ABinderProcess_setThreadPoolMaxThreadCount(0);
+
+    std::shared_ptr<GoodixFingerprintDaemon> daemon =
+            ndk::SharedRefBase::make<GoodixFingerprintDaemon>();
+
+    const std::string instance = std::string() + GoodixFingerprintDaemon::descriptor + "/default";
+    binder_status_t status = AServiceManager_addService(daemon->asBinder().get(), instance.c_str());
+    CHECK(status == STATUS_OK);
+
+    ABinderProcess_joinThreadPool();
+    return EXIT_FAILURE; // should not reach
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// sendCommand throughput of the bridge for 4 KiB to 4 MiB payloads. The HIDL
+// daemon is a stand-in in the same process, so hwbinder is not involved: this
+// measures what the bridge itself adds on top of the transport.
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "GoodixFingerprintDaemon.h"
+
+using ::android::sp;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+
+namespace aidl {
+namespace vendor {
+namespace goodix {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+// Replies with as many bytes as it was sent, like a calibration data dump
+class StandInDaemon : public V2_1::IGoodixFingerprintDaemon {
+  public:
+    Return<void> initCallback(const sp<V2_1::IGoodixFingerprintDaemonCallback>&) override {
+        return Void();
+    }
+    Return<void> setNotify(const sp<V2_1::IGoodixFingerprintDaemonCallback>&) override {
+        return Void();
+    }
+    Return<int32_t> testCmd(uint32_t, const hidl_vec<uint8_t>&) override { return 0; }
+    Return<void> sendCommand(uint32_t, const hidl_vec<uint8_t>& data,
+                             sendCommand_cb _hidl_cb) override {
+        if (mReply.size() != data.size()) mReply.resize(data.size());
+        _hidl_cb(0, mReply);
+        return Void();
+    }
+
+  private:
+    hidl_vec<int8_t> mReply;
+};
+
+void BM_SendCommand(benchmark::State& state) {
+    sp<StandInDaemon> standIn = new StandInDaemon();
+    auto bridge = ndk::SharedRefBase::make<GoodixFingerprintDaemon>(
+            [standIn] { return sp<V2_1::IGoodixFingerprintDaemon>(standIn); });
+    std::vector<uint8_t> param(state.range(0), 0x5a);
+    CommandResult result;
+    for (auto _ : state) {
+        bridge->sendCommand(1, param, &result);
+        benchmark::DoNotOptimize(result.data.data());
+    }
+    // Both directions
+    state.SetBytesProcessed(2 * state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SendCommand)->RangeMultiplier(4)->Range(4 << 10, 4 << 20);
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace goodix
+} // namespace vendor
+} // namespace aidl
+
+BENCHMARK_MAIN();
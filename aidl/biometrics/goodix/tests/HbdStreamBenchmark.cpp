@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Sustained HBD samples per second through onHbdData and the ring, and the
+// allocations made per frame. The HBD daemon is a stand-in in the same process
+// that hands the same frame to the callback over and over.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "HbdStream.h"
+
+using ::android::sp;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+
+namespace {
+
+std::atomic<uint64_t> sAllocations = 0;
+
+} // namespace
+
+void* operator new(size_t size) {
+    sAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace aidl {
+namespace vendor {
+namespace goodix {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+class StandInHbd : public V2_1::IGoodixFingerprintDaemonHbd {
+  public:
+    Return<void> initCallback(const sp<V2_1::IGoodixFingerprintDaemonHbdCallback>& cb) override {
+        mCallback = cb;
+        return Void();
+    }
+    Return<int32_t> startHbd() override { return 0; }
+    Return<int32_t> stopHbd() override { return 0; }
+    Return<int32_t> enableBioAssayFeature(uint8_t) override { return 0; }
+
+    const sp<V2_1::IGoodixFingerprintDaemonHbdCallback>& callback() const { return mCallback; }
+
+  private:
+    sp<V2_1::IGoodixFingerprintDaemonHbdCallback> mCallback;
+};
+
+void BM_HbdStream(benchmark::State& state) {
+    sp<StandInHbd> standIn = new StandInHbd();
+    HbdStream stream([standIn] { return sp<V2_1::IGoodixFingerprintDaemonHbd>(standIn); });
+    if (!stream.start()) {
+        state.SkipWithError("Can't start the stand-in HBD daemon");
+        return;
+    }
+
+    const size_t frame = state.range(0);
+    hidl_vec<uint32_t> raw(std::vector<uint32_t>(frame, 1000));
+    hidl_vec<uint32_t> display(std::vector<uint32_t>(frame / 4, 1000));
+    std::vector<uint32_t> window(frame);
+
+    uint64_t allocations = sAllocations.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        standIn->callback()->onHbdData(0, 72, 0, display, raw);
+        benchmark::DoNotOptimize(stream.pullLatestRaw(window.data(), window.size()));
+    }
+    allocations = sAllocations.load(std::memory_order_relaxed) - allocations;
+
+    state.SetItemsProcessed(state.iterations() * frame);
+    state.counters["allocs_per_frame"] =
+            benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+    stream.stop();
+}
+// Samples per frame, the larger frames show the copy cost
+BENCHMARK(BM_HbdStream)->Arg(25)->Arg(100)->Arg(1024);
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace goodix
+} // namespace vendor
+} // namespace aidl
+
+BENCHMARK_MAIN();
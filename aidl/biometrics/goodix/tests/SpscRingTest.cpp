@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "SpscRing.h"
+
+namespace aidl {
+namespace vendor {
+namespace goodix {
+namespace hardware {
+namespace biometrics {
+namespace fingerprint {
+
+namespace {
+
+std::vector<uint32_t> sequence(size_t count, uint32_t first = 0) {
+    std::vector<uint32_t> samples(count);
+    std::iota(samples.begin(), samples.end(), first);
+    return samples;
+}
+
+TEST(SpscRingTest, DropsWhenFull) {
+    SpscRing<uint32_t, 8> ring;
+    auto in = sequence(10);
+    EXPECT_EQ(ring.push(in.data(), in.size()), 8);
+    EXPECT_EQ(ring.dropped(), 2);
+    EXPECT_EQ(ring.size(), 8);
+
+    // The oldest samples are kept
+    uint32_t out[8];
+    ASSERT_EQ(ring.pull(out, 8), 8);
+    EXPECT_EQ(out[0], 0);
+    EXPECT_EQ(out[7], 7);
+}
+
+TEST(SpscRingTest, PullsAcrossTheWrap) {
+    SpscRing<uint32_t, 8> ring;
+    auto in = sequence(6);
+    ring.push(in.data(), in.size());
+    uint32_t out[8];
+    ASSERT_EQ(ring.pull(out, 5), 5);
+
+    in = sequence(6, 100);
+    ASSERT_EQ(ring.push(in.data(), in.size()), 6);
+    ASSERT_EQ(ring.pull(out, 8), 7);
+    EXPECT_EQ(out[0], 5);
+    EXPECT_EQ(out[1], 100);
+    EXPECT_EQ(out[6], 105);
+}
+
+TEST(SpscRingTest, Decimates) {
+    SpscRing<uint32_t, 8> ring;
+    auto in = sequence(7);
+    ring.push(in.data(), in.size());
+
+    uint32_t out[8];
+    ASSERT_EQ(ring.pull(out, 8, 2), 3);
+    EXPECT_EQ(out[0], 0);
+    EXPECT_EQ(out[1], 2);
+    EXPECT_EQ(out[2], 4);
+    // Everything stepped over is consumed, the odd one out stays
+    EXPECT_EQ(ring.size(), 1);
+}
+
+TEST(SpscRingTest, PullsTheLatestWindow) {
+    SpscRing<uint32_t, 8> ring;
+    auto in = sequence(8);
+    ring.push(in.data(), in.size());
+
+    uint32_t out[2];
+    ASSERT_EQ(ring.pullLatest(out, 2, 2), 2);
+    EXPECT_EQ(out[0], 4);
+    EXPECT_EQ(out[1], 6);
+    EXPECT_EQ(ring.size(), 0);
+}
+
+TEST(SpscRingTest, KeepsOrderAcrossThreads) {
+    constexpr uint32_t kSamples = 100000;
+    static SpscRing<uint32_t, 1024> ring;
+
+    std::thread producer([] {
+        for (uint32_t i = 0; i < kSamples;) {
+            i += ring.push(&i, 1);
+        }
+    });
+    uint32_t expected = 0;
+    uint32_t sample;
+    while (expected < kSamples) {
+        if (ring.pull(&sample, 1)) {
+            ASSERT_EQ(sample, expected);
+            expected++;
+        }
+    }
+    producer.join();
+}
+
+} // namespace
+
+} // namespace fingerprint
+} // namespace biometrics
+} // namespace hardware
+} // namespace goodix
+} // namespace vendor
+} // namespace aidl
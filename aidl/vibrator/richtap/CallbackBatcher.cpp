@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.aac.hardware.richtap.vibrator-service.nubia"
+
+#include "CallbackBatcher.h"
+
+#include <log/log.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <vector>
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+CallbackBatcher::CallbackBatcher(std::chrono::milliseconds window)
+    : mWindow(window), mThread(&CallbackBatcher::threadLoop, this) {}
+
+CallbackBatcher::~CallbackBatcher() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCv.notify_one();
+    mThread.join();
+}
+
+void CallbackBatcher::pruneLocked() {
+    // Entries with requests in flight or a notification due are never dropped
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+        if (idle(it->second) && !AIBinder_isAlive(it->second.binder.get())) {
+            it = mEntries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    while (mEntries.size() >= kMaxEntries) {
+        auto oldest = mEntries.end();
+        for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+            if (idle(it->second) &&
+                (oldest == mEntries.end() || it->second.lastUsed < oldest->second.lastUsed)) {
+                oldest = it;
+            }
+        }
+        if (oldest == mEntries.end()) break;
+        // The client's numbering starts over if it comes back with this binder
+        mEntries.erase(oldest);
+    }
+}
+
+uint32_t CallbackBatcher::submit(const std::shared_ptr<IRichtapCallback>& callback) {
+    AIBinder* binder = callback->asBinder().get();
+
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mEntries.find(binder);
+    if (it == mEntries.end()) {
+        if (mEntries.size() >= kMaxEntries) pruneLocked();
+        Entry entry;
+        entry.binder = callback->asBinder();
+        it = mEntries.emplace(binder, std::move(entry)).first;
+    }
+    it->second.lastUsed = std::chrono::steady_clock::now();
+    return ++it->second.submitted;
+}
+
+void CallbackBatcher::complete(const std::shared_ptr<IRichtapCallback>& callback, uint32_t seq) {
+    AIBinder* binder = callback->asBinder().get();
+    mCompletions.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mEntries.find(binder);
+        if (it == mEntries.end()) return;
+
+        Entry& entry = it->second;
+        entry.finished++;
+        if (seq == entry.completed + 1) {
+            entry.completed = seq;
+            while (!entry.early.empty() && *entry.early.begin() == entry.completed + 1) {
+                entry.completed++;
+                entry.early.erase(entry.early.begin());
+            }
+        } else if (seq > entry.completed) {
+            entry.early.insert(seq);
+            entry.earlyDue.push_back(seq);
+        }
+        if (entry.callback) return;  // Already due, goes out in the same flush
+
+        entry.callback = callback;
+        entry.dueAt = std::chrono::steady_clock::now() + mWindow;
+        mDue.push_back(binder);
+    }
+    mCv.notify_one();
+}
+
+void CallbackBatcher::threadLoop() {
+    struct Notification {
+        std::shared_ptr<IRichtapCallback> callback;
+        // Values for onCallback(), see the header
+        std::vector<int32_t> values;
+        uint32_t coalesced;
+    };
+    std::vector<Notification> batch;
+
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mCv.wait(lock, [this] { return mExit || !mDue.empty(); });
+        if (mExit) return;
+
+        auto dueAt = mEntries.at(mDue.front()).dueAt;
+        if (mCv.wait_until(lock, dueAt, [this] { return mExit; })) return;
+
+        // Everything due by now goes out in one go
+        auto now = std::chrono::steady_clock::now();
+        while (!mDue.empty()) {
+            Entry& entry = mEntries.at(mDue.front());
+            if (entry.dueAt > now) break;
+            Notification notification = {std::move(entry.callback), {}, 0};
+            if (entry.completed != entry.notified) {
+                notification.values.push_back(static_cast<int32_t>(entry.completed));
+                notification.coalesced = entry.completed - entry.notified;
+                entry.notified = entry.completed;
+            }
+            for (uint32_t seq : entry.earlyDue) {
+                // Covered by the contiguous run when the older requests caught up
+                if (seq > entry.completed) {
+                    notification.values.push_back(-static_cast<int32_t>(seq));
+                }
+            }
+            entry.earlyDue.clear();
+            entry.callback.reset();
+            mDue.pop_front();
+            batch.push_back(std::move(notification));
+        }
+
+        lock.unlock();
+        for (Notification& notification : batch) {
+            for (int32_t value : notification.values) {
+                auto status = notification.callback->onCallback(value);
+                mTransactions.fetch_add(1, std::memory_order_relaxed);
+                if (!status.isOk()) {
+                    mFailures.fetch_add(1, std::memory_order_relaxed);
+                    ALOGW("onCallback failed: %s", status.getDescription().c_str());
+                }
+            }
+            if (notification.coalesced > mMaxCoalesced.load(std::memory_order_relaxed)) {
+                mMaxCoalesced.store(notification.coalesced, std::memory_order_relaxed);
+            }
+        }
+        // Drop the references outside the lock too
+        batch.clear();
+        lock.lock();
+    }
+}
+
+void CallbackBatcher::dump(int fd) {
+    size_t callbacks, due;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        callbacks = mEntries.size();
+        due = mDue.size();
+    }
+    uint64_t completions = mCompletions.load(std::memory_order_relaxed);
+    uint64_t transactions = mTransactions.load(std::memory_order_relaxed);
+    dprintf(fd, "Callbacks: window %lld ms, %zu binders, %zu due\n",
+            static_cast<long long>(mWindow.count()), callbacks, due);
+    dprintf(fd, "  completions: %" PRIu64 ", transactions: %" PRIu64 ", failed: %" PRIu64 "\n",
+            completions, transactions, mFailures.load(std::memory_order_relaxed));
+    dprintf(fd, "  completions per transaction: avg %.2f, max in one run %u\n",
+            transactions ? static_cast<double>(completions) / transactions : 0.0,
+            mMaxCoalesced.load(std::memory_order_relaxed));
+}
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/vendor/aac/hardware/richtap/vibrator/IRichtapCallback.h>
+#include <android/binder_ibinder.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+// Completion notifications, coalesced per callback binder.
+//
+// Requests are numbered 1, 2, ... per callback binder as they are submitted.
+// onCallback(seq) with seq > 0 tells the client that every request up to and
+// including seq is done. Requests don't always finish in order, a suspended
+// ringtone can outlive the interactive requests that preempted it, so one that
+// finishes ahead of an older request is reported on its own as onCallback(-seq).
+// Completions on the same binder within the window are flushed together: a
+// single transaction for the contiguous run, plus one per request done early.
+//
+// The binder is kept alive for as long as it has an entry, so a client that keeps
+// passing the same callback object sees one numbering. Idle entries are only
+// dropped once the client died, or past kMaxEntries, least recently used first.
+//
+// Notifications are sent from a dedicated thread, complete() never blocks on binder.
+class CallbackBatcher {
+  public:
+    explicit CallbackBatcher(std::chrono::milliseconds window);
+    ~CallbackBatcher();
+
+    // Sequence number of a new request notified through callback
+    uint32_t submit(const std::shared_ptr<IRichtapCallback>& callback);
+    void complete(const std::shared_ptr<IRichtapCallback>& callback, uint32_t seq);
+
+    void dump(int fd);
+
+  private:
+    // Idle entries are only looked at once there are this many
+    static constexpr size_t kMaxEntries = 32;
+
+    struct Entry {
+        // Holding the proxy keeps the map key from being reused by another binder
+        ndk::SpAIBinder binder;
+        std::chrono::steady_clock::time_point lastUsed;
+        uint32_t submitted = 0;
+        uint32_t finished = 0;
+        // Every request up to here is done
+        uint32_t completed = 0;
+        uint32_t notified = 0;
+        // Done ahead of older requests
+        std::set<uint32_t> early;
+        // Done ahead of older requests and not notified yet
+        std::vector<uint32_t> earlyDue;
+        // Set while a notification is due
+        std::shared_ptr<IRichtapCallback> callback;
+        std::chrono::steady_clock::time_point dueAt;
+    };
+
+    static bool idle(const Entry& entry) {
+        return entry.finished == entry.submitted && !entry.callback;
+    }
+    void pruneLocked();
+    void threadLoop();
+
+    const std::chrono::milliseconds mWindow;
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    std::unordered_map<AIBinder*, Entry> mEntries;
+    // Binders with a notification due, oldest first. The window is the same for
+    // every entry so this is also in the order of due times.
+    std::deque<AIBinder*> mDue;
+    bool mExit = false;
+    std::thread mThread;
+
+    std::atomic<uint64_t> mCompletions = 0;
+    std::atomic<uint64_t> mTransactions = 0;
+    std::atomic<uint64_t> mFailures = 0;
+    std::atomic<uint32_t> mMaxCoalesced = 0;
+};
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
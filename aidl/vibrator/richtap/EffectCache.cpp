@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "EffectCache.h"
+
+#include <unistd.h>
+
+#include <cinttypes>
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+uint64_t EffectCache::hash(const std::vector<int32_t>& key) {
+    // FNV-1a over the bytes of the key
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int32_t value : key) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            hash ^= (static_cast<uint32_t>(value) >> shift) & 0xff;
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+EffectCache::Waveform EffectCache::get(const std::vector<int32_t>& key,
+                                       const std::function<std::vector<Sample>()>& render) {
+    uint64_t keyHash = hash(key);
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mIndex.find(keyHash);
+        if (it != mIndex.end() && it->second->key == key) {
+            mLru.splice(mLru.begin(), mLru, it->second);
+            mHits.fetch_add(1, std::memory_order_relaxed);
+            return it->second->waveform;
+        }
+        generation = mGeneration;
+    }
+
+    mMisses.fetch_add(1, std::memory_order_relaxed);
+    auto waveform = std::make_shared<const std::vector<Sample>>(render());
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (generation == mGeneration) {
+        insertLocked(keyHash, key, waveform);
+    }
+    return waveform;
+}
+
+void EffectCache::insertLocked(uint64_t keyHash, const std::vector<int32_t>& key,
+                               const Waveform& waveform) {
+    size_t bytes = waveform->size() * sizeof(Sample);
+    if (bytes > mCapacityBytes) return;
+
+    // Rendered twice in parallel, or a hash collision: the newest one wins
+    if (auto it = mIndex.find(keyHash); it != mIndex.end()) {
+        eraseLocked(it->second);
+    }
+    while (mSizeBytes + bytes > mCapacityBytes) {
+        eraseLocked(std::prev(mLru.end()));
+        mEvictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    mLru.push_front({keyHash, key, waveform});
+    mIndex[keyHash] = mLru.begin();
+    mSizeBytes += bytes;
+}
+
+void EffectCache::eraseLocked(std::list<Entry>::iterator it) {
+    mSizeBytes -= it->waveform->size() * sizeof(Sample);
+    mIndex.erase(it->hash);
+    mLru.erase(it);
+}
+
+void EffectCache::invalidate() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mGeneration++;
+    mLru.clear();
+    mIndex.clear();
+    mSizeBytes = 0;
+    mInvalidations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EffectCache::dump(int fd) {
+    uint64_t hits = mHits.load(std::memory_order_relaxed);
+    uint64_t misses = mMisses.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        dprintf(fd, "Effect cache: %zu entries, %zu/%zu bytes\n", mLru.size(), mSizeBytes,
+                mCapacityBytes);
+    }
+    dprintf(fd, "  hits: %" PRIu64 ", misses: %" PRIu64 " (hit rate %.1f%%)\n", hits, misses,
+            hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+    dprintf(fd, "  evictions: %" PRIu64 ", invalidations: %" PRIu64 "\n",
+            mEvictions.load(std::memory_order_relaxed),
+            mInvalidations.load(std::memory_order_relaxed));
+}
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
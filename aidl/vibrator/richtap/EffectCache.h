@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "HapticOutput.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+// Rendered waveforms by request parameters, least recently used first out.
+// Bounded by the total size of the waveforms; everything is dropped whenever
+// the tuning the waveforms were rendered with changes.
+class EffectCache {
+  public:
+    using Waveform = std::shared_ptr<const std::vector<Sample>>;
+
+    static constexpr size_t kDefaultCapacityBytes = 1 << 20;
+
+    explicit EffectCache(size_t capacityBytes = kDefaultCapacityBytes)
+        : mCapacityBytes(capacityBytes) {}
+
+    // key identifies the request, render is called outside the lock on a miss
+    Waveform get(const std::vector<int32_t>& key, const std::function<std::vector<Sample>()>& render);
+    void invalidate();
+
+    void dump(int fd);
+
+  private:
+    struct Entry {
+        uint64_t hash;
+        std::vector<int32_t> key;
+        Waveform waveform;
+    };
+
+    static uint64_t hash(const std::vector<int32_t>& key);
+    void insertLocked(uint64_t hash, const std::vector<int32_t>& key, const Waveform& waveform);
+    void eraseLocked(std::list<Entry>::iterator it);
+
+    const size_t mCapacityBytes;
+
+    std::mutex mLock;
+    // Most recently used first
+    std::list<Entry> mLru;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> mIndex;
+    size_t mSizeBytes = 0;
+    // Bumped by invalidate(), waveforms rendered before that are not inserted
+    uint64_t mGeneration = 0;
+
+    std::atomic<uint64_t> mHits = 0;
+    std::atomic<uint64_t> mMisses = 0;
+    std::atomic<uint64_t> mEvictions = 0;
+    std::atomic<uint64_t> mInvalidations = 0;
+};
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.aac.hardware.richtap.vibrator-service.nubia"
+
+#include "HapticKernels.h"
+
+#include <log/log.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAPTIC_KERNELS_NEON
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAPTIC_KERNELS_X86
+#endif
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+
+// The gain is tracked in Q16.16 on top of the Q15 gain: start << 16 plus i
+// times the per-sample step, both fit in 32 bits for gains up to kUnityGain.
+// So do the lane offsets of the vector loops, as long as count covers the lanes.
+int32_t envelopeStep(int32_t startGain, int32_t endGain, size_t count) {
+    return count ? static_cast<int32_t>((static_cast<int64_t>(endGain - startGain) << 16) /
+                                        static_cast<int64_t>(count))
+                 : 0;
+}
+
+void applyEnvelopeScalar(const int16_t* carrier, int16_t* out, size_t count, int32_t startGain,
+                         int32_t endGain) {
+    int32_t step = envelopeStep(startGain, endGain, count);
+    int32_t acc = startGain << 16;
+    for (size_t i = 0; i < count; i++) {
+        int32_t gain = acc >> 16;
+        out[i] = static_cast<int16_t>((carrier[i] * gain) >> 15);
+        acc += step;
+    }
+}
+
+void mixSaturateScalar(const int16_t* in, Sample* out, size_t count, int32_t gain) {
+    for (size_t i = 0; i < count; i++) {
+        int32_t value = out[i] + (((in[i] * gain) >> 15) >> 8);
+        out[i] = static_cast<Sample>(std::clamp(value, -128, 127));
+    }
+}
+
+#ifdef HAPTIC_KERNELS_NEON
+void applyEnvelopeNeon(const int16_t* carrier, int16_t* out, size_t count, int32_t startGain,
+                       int32_t endGain) {
+    int32_t step = envelopeStep(startGain, endGain, count);
+    int32_t tail = startGain << 16;
+    size_t i = 0;
+    if (count >= 4) {
+        const int32_t lanes[4] = {0, step, 2 * step, 3 * step};
+        int32x4_t acc = vaddq_s32(vdupq_n_s32(tail), vld1q_s32(lanes));
+        int32x4_t step4 = vdupq_n_s32(4 * step);
+        for (; i + 4 <= count; i += 4) {
+            int32x4_t gain = vshrq_n_s32(acc, 16);
+            int32x4_t value = vmulq_s32(vmovl_s16(vld1_s16(carrier + i)), gain);
+            vst1_s16(out + i, vmovn_s32(vshrq_n_s32(value, 15)));
+            acc = vaddq_s32(acc, step4);
+        }
+        tail = vgetq_lane_s32(acc, 0);
+    }
+
+    for (; i < count; i++) {
+        out[i] = static_cast<int16_t>((carrier[i] * (tail >> 16)) >> 15);
+        tail += step;
+    }
+}
+
+void mixSaturateNeon(const int16_t* in, Sample* out, size_t count, int32_t gain) {
+    int32x4_t gain4 = vdupq_n_s32(gain);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t samples = vld1q_s16(in + i);
+        int32x4_t lo = vmulq_s32(vmovl_s16(vget_low_s16(samples)), gain4);
+        int32x4_t hi = vmulq_s32(vmovl_s16(vget_high_s16(samples)), gain4);
+        lo = vshrq_n_s32(vshrq_n_s32(lo, 15), 8);
+        hi = vshrq_n_s32(vshrq_n_s32(hi, 15), 8);
+        int16x8_t mixed = vmovl_s8(vld1_s8(out + i));
+        lo = vaddq_s32(lo, vmovl_s16(vget_low_s16(mixed)));
+        hi = vaddq_s32(hi, vmovl_s16(vget_high_s16(mixed)));
+        // Saturating narrows clamp to [-128, 127]
+        vst1_s8(out + i, vqmovn_s16(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi))));
+    }
+    mixSaturateScalar(in + i, out + i, count - i, gain);
+}
+#endif
+
+#ifdef HAPTIC_KERNELS_X86
+// Unaligned loads of 8 bytes and 16 bytes, plain SSE2
+__m128i load64(const void* p) {
+    return _mm_loadl_epi64(static_cast<const __m128i*>(p));
+}
+
+__m128i load128(const void* p) {
+    return _mm_loadu_si128(static_cast<const __m128i*>(p));
+}
+
+__attribute__((target("sse4.1")))
+void applyEnvelopeSse41(const int16_t* carrier, int16_t* out, size_t count, int32_t startGain,
+                        int32_t endGain) {
+    int32_t step = envelopeStep(startGain, endGain, count);
+    int32_t tail = startGain << 16;
+    size_t i = 0;
+    if (count >= 4) {
+        __m128i acc = _mm_add_epi32(_mm_set1_epi32(tail),
+                                    _mm_setr_epi32(0, step, 2 * step, 3 * step));
+        __m128i step4 = _mm_set1_epi32(4 * step);
+        for (; i + 4 <= count; i += 4) {
+            __m128i gain = _mm_srai_epi32(acc, 16);
+            __m128i samples = _mm_cvtepi16_epi32(load64(carrier + i));
+            __m128i value = _mm_srai_epi32(_mm_mullo_epi32(samples, gain), 15);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(value, value));
+            acc = _mm_add_epi32(acc, step4);
+        }
+        tail = _mm_cvtsi128_si32(acc);
+    }
+
+    for (; i < count; i++) {
+        out[i] = static_cast<int16_t>((carrier[i] * (tail >> 16)) >> 15);
+        tail += step;
+    }
+}
+
+__attribute__((target("sse4.1")))
+void mixSaturateSse41(const int16_t* in, Sample* out, size_t count, int32_t gain) {
+    __m128i gain4 = _mm_set1_epi32(gain);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i samples = _mm_cvtepi16_epi32(load64(in + i));
+        __m128i value = _mm_srai_epi32(_mm_srai_epi32(_mm_mullo_epi32(samples, gain4), 15), 8);
+        int32_t packed;
+        memcpy(&packed, out + i, sizeof(packed));
+        value = _mm_add_epi32(value, _mm_cvtepi8_epi32(_mm_cvtsi32_si128(packed)));
+        // Saturating packs clamp to [-128, 127]
+        __m128i narrow = _mm_packs_epi16(_mm_packs_epi32(value, value), _mm_setzero_si128());
+        packed = _mm_cvtsi128_si32(narrow);
+        memcpy(out + i, &packed, sizeof(packed));
+    }
+    mixSaturateScalar(in + i, out + i, count - i, gain);
+}
+
+__attribute__((target("avx2")))
+void applyEnvelopeAvx2(const int16_t* carrier, int16_t* out, size_t count, int32_t startGain,
+                       int32_t endGain) {
+    int32_t step = envelopeStep(startGain, endGain, count);
+    int32_t tail = startGain << 16;
+    size_t i = 0;
+    if (count >= 8) {
+        __m256i acc = _mm256_add_epi32(
+                _mm256_set1_epi32(tail),
+                _mm256_mullo_epi32(_mm256_set1_epi32(step),
+                                   _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+        __m256i step8 = _mm256_set1_epi32(8 * step);
+        for (; i + 8 <= count; i += 8) {
+            __m256i gain = _mm256_srai_epi32(acc, 16);
+            __m256i samples = _mm256_cvtepi16_epi32(load128(carrier + i));
+            __m256i value = _mm256_srai_epi32(_mm256_mullo_epi32(samples, gain), 15);
+            __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(value),
+                                             _mm256_extracti128_si256(value, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+            acc = _mm256_add_epi32(acc, step8);
+        }
+        tail = _mm256_cvtsi256_si32(acc);
+    }
+
+    for (; i < count; i++) {
+        out[i] = static_cast<int16_t>((carrier[i] * (tail >> 16)) >> 15);
+        tail += step;
+    }
+}
+
+__attribute__((target("avx2")))
+void mixSaturateAvx2(const int16_t* in, Sample* out, size_t count, int32_t gain) {
+    __m256i gain8 = _mm256_set1_epi32(gain);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i samples = _mm256_cvtepi16_epi32(load128(in + i));
+        __m256i value = _mm256_srai_epi32(_mm256_mullo_epi32(samples, gain8), 15);
+        value = _mm256_add_epi32(_mm256_srai_epi32(value, 8),
+                                 _mm256_cvtepi8_epi32(load64(out + i)));
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(value),
+                                        _mm256_extracti128_si256(value, 1));
+        // Saturating packs clamp to [-128, 127]
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi16(words, words));
+    }
+    mixSaturateScalar(in + i, out + i, count - i, gain);
+}
+#endif
+
+constexpr HapticKernels kScalar = {"scalar", applyEnvelopeScalar, mixSaturateScalar};
+#ifdef HAPTIC_KERNELS_NEON
+constexpr HapticKernels kNeon = {"neon", applyEnvelopeNeon, mixSaturateNeon};
+#endif
+#ifdef HAPTIC_KERNELS_X86
+constexpr HapticKernels kSse41 = {"sse4.1", applyEnvelopeSse41, mixSaturateSse41};
+constexpr HapticKernels kAvx2 = {"avx2", applyEnvelopeAvx2, mixSaturateAvx2};
+#endif
+
+}  // namespace
+
+std::vector<const HapticKernels*> supportedHapticKernels() {
+    std::vector<const HapticKernels*> kernels = {&kScalar};
+#if defined(HAPTIC_KERNELS_NEON)
+    kernels.push_back(&kNeon);
+#elif defined(HAPTIC_KERNELS_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) kernels.push_back(&kSse41);
+    if (__builtin_cpu_supports("avx2")) kernels.push_back(&kAvx2);
+#endif
+    return kernels;
+}
+
+const HapticKernels& hapticKernels() {
+    static const HapticKernels& sKernels = []() -> const HapticKernels& {
+        const HapticKernels& kernels = *supportedHapticKernels().back();
+        ALOGI("Using %s haptic kernels", kernels.name);
+        return kernels;
+    }();
+    return sKernels;
+}
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "HapticOutput.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+// Gains are Q15, kUnityGain is 1.0
+constexpr int32_t kUnityGain = 32767;
+
+// Per-sample inner loops of the renderer. Every implementation gives bit-exact
+// the same output as the scalar one, the fixed point math is spelled out there.
+struct HapticKernels {
+    const char* name;
+    // out[i] = carrier[i] * gain(i), gain going linearly from startGain to endGain
+    void (*applyEnvelope)(const int16_t* carrier, int16_t* out, size_t count, int32_t startGain,
+                          int32_t endGain);
+    // out[i] = saturate(out[i] + (((in[i] * gain) >> 15) >> 8)), mixes into what is
+    // already there. Both shifts round towards negative infinity.
+    void (*mixSaturate)(const int16_t* in, Sample* out, size_t count, int32_t gain);
+};
+
+// The fastest implementation the CPU supports, picked on first use
+const HapticKernels& hapticKernels();
+// Every implementation the CPU supports, from the scalar one to the fastest
+std::vector<const HapticKernels*> supportedHapticKernels();
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.aac.hardware.richtap.vibrator-service.nubia"
+
+#include "HapticOutput.h"
+
+#include <android-base/unique_fd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <log/log.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+constexpr char kInputDir[] = "/dev/input";
+
+struct DirCloser {
+    void operator()(DIR* dir) const { closedir(dir); }
+};
+
+bool testBit(const uint8_t* bits, int bit) {
+    return bits[bit / 8] & (1 << (bit % 8));
+}
+}  // namespace
+
+std::unique_ptr<HapticOutput> HapticOutput::create(const std::string& spec) {
+    if (spec == "memory") {
+        return std::make_unique<MemoryOutput>();
+    }
+    if (spec.rfind("file:", 0) == 0) {
+        return FileOutput::open(spec.substr(strlen("file:")));
+    }
+    if (!spec.empty() && spec != "ff") {
+        ALOGE("Unknown output %s, using ff", spec.c_str());
+    }
+    return InputFfOutput::open();
+}
+
+std::unique_ptr<InputFfOutput> InputFfOutput::open() {
+    std::unique_ptr<DIR, DirCloser> dir(opendir(kInputDir));
+    if (!dir) {
+        ALOGE("Can't open %s: %s", kInputDir, strerror(errno));
+        return nullptr;
+    }
+
+    while (dirent* entry = readdir(dir.get())) {
+        if (strncmp(entry->d_name, "event", strlen("event"))) continue;
+
+        std::string path = std::string(kInputDir) + "/" + entry->d_name;
+        ::android::base::unique_fd fd(::open(path.c_str(), O_RDWR | O_CLOEXEC));
+        if (fd < 0) continue;
+
+        uint8_t ffBits[FF_CNT / 8 + 1] = {};
+        if (ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffBits)), ffBits) < 0) continue;
+        if (!testBit(ffBits, FF_PERIODIC) || !testBit(ffBits, FF_CUSTOM)) continue;
+
+        ALOGI("Using force feedback device %s", path.c_str());
+        return std::unique_ptr<InputFfOutput>(new InputFfOutput(fd.release()));
+    }
+
+    ALOGE("No force feedback device with FF_CUSTOM support");
+    return nullptr;
+}
+
+InputFfOutput::~InputFfOutput() {
+    stop();
+    if (mEffectId >= 0) {
+        ioctl(mFd, EVIOCRMFF, mEffectId);
+    }
+    close(mFd);
+}
+
+bool InputFfOutput::write(const Sample* samples, size_t count) {
+    mCustomData.resize(count);
+    std::transform(samples, samples + count, mCustomData.begin(),
+                   [](Sample sample) { return static_cast<int16_t>(sample * 256); });
+
+    ff_effect effect = {};
+    effect.type = FF_PERIODIC;
+    // Reusing the id updates the uploaded effect in place
+    effect.id = mEffectId;
+    effect.replay.length = static_cast<uint16_t>(count * 1000 / kSampleRate);
+    effect.u.periodic.waveform = FF_CUSTOM;
+    effect.u.periodic.magnitude = 0x7fff;
+    effect.u.periodic.custom_len = static_cast<uint32_t>(mCustomData.size());
+    effect.u.periodic.custom_data = mCustomData.data();
+    if (ioctl(mFd, EVIOCSFF, &effect) < 0) {
+        ALOGE("Can't upload effect: %s", strerror(errno));
+        return false;
+    }
+    mEffectId = effect.id;
+
+    input_event play = {};
+    play.type = EV_FF;
+    play.code = static_cast<uint16_t>(mEffectId);
+    play.value = 1;
+    if (::write(mFd, &play, sizeof(play)) != sizeof(play)) {
+        ALOGE("Can't play effect: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void InputFfOutput::stop() {
+    if (mEffectId < 0) return;
+
+    input_event stop = {};
+    stop.type = EV_FF;
+    stop.code = static_cast<uint16_t>(mEffectId);
+    stop.value = 0;
+    if (::write(mFd, &stop, sizeof(stop)) != sizeof(stop)) {
+        ALOGE("Can't stop effect: %s", strerror(errno));
+    }
+}
+
+std::unique_ptr<FileOutput> FileOutput::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ALOGE("Can't open %s: %s", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    return std::unique_ptr<FileOutput>(new FileOutput(fd));
+}
+
+FileOutput::~FileOutput() {
+    close(mFd);
+}
+
+bool FileOutput::write(const Sample* samples, size_t count) {
+    const auto* data = reinterpret_cast<const uint8_t*>(samples);
+    size_t left = count * sizeof(Sample);
+    while (left > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(::write(mFd, data, left));
+        if (written < 0) {
+            ALOGE("Can't write samples: %s", strerror(errno));
+            return false;
+        }
+        data += written;
+        left -= written;
+    }
+    return true;
+}
+
+bool MemoryOutput::write(const Sample* samples, size_t count) {
+    std::lock_guard<std::mutex> lock(mLock);
+    size_t kept = std::min(count, kCapacity - mSamples.size());
+    mSamples.insert(mSamples.end(), samples, samples + kept);
+    mDropped += count - kept;
+    return true;
+}
+
+void MemoryOutput::stop() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mStops++;
+}
+
+std::vector<Sample> MemoryOutput::samples() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mSamples;
+}
+
+size_t MemoryOutput::stops() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStops;
+}
+
+size_t MemoryOutput::dropped() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mDropped;
+}
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
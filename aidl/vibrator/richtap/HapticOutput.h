@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+// Signed 8 bit PCM at kSampleRate, the format of the haptic driver's RTP mode
+using Sample = int8_t;
+constexpr uint32_t kSampleRate = 24000;
+
+// Where rendered samples end up. Only called from the playback thread.
+class HapticOutput {
+  public:
+    virtual ~HapticOutput() = default;
+
+    virtual const char* name() const = 0;
+    // True when write() should be paced to the sample rate
+    virtual bool realtime() const = 0;
+    // True when write() plays after what is still playing, false when it replaces it
+    virtual bool queues() const = 0;
+    virtual bool write(const Sample* samples, size_t count) = 0;
+    // Silences the actuator, called when playback ends or is interrupted
+    virtual void stop() = 0;
+
+    // "ff" (default), "file:<path>" or "memory", from ro.vendor.richtap.output
+    static std::unique_ptr<HapticOutput> create(const std::string& spec);
+};
+
+// Input force feedback device, each buffer is played as an FF_CUSTOM periodic effect
+class InputFfOutput : public HapticOutput {
+  public:
+    ~InputFfOutput() override;
+
+    static std::unique_ptr<InputFfOutput> open();
+
+    const char* name() const override { return "ff"; }
+    bool realtime() const override { return true; }
+    // Uploading to the same effect id restarts it with the new data
+    bool queues() const override { return false; }
+    bool write(const Sample* samples, size_t count) override;
+    void stop() override;
+
+  private:
+    explicit InputFfOutput(int fd) : mFd(fd) {}
+
+    int mFd;
+    int16_t mEffectId = -1;
+    std::vector<int16_t> mCustomData;
+};
+
+// Raw samples appended to a file, for capturing what would have been played
+class FileOutput : public HapticOutput {
+  public:
+    ~FileOutput() override;
+
+    static std::unique_ptr<FileOutput> open(const std::string& path);
+
+    const char* name() const override { return "file"; }
+    bool realtime() const override { return false; }
+    bool queues() const override { return true; }
+    bool write(const Sample* samples, size_t count) override;
+    void stop() override {}
+
+  private:
+    explicit FileOutput(int fd) : mFd(fd) {}
+
+    int mFd;
+};
+
+// Keeps the first kCapacity samples in memory, for host builds without a haptic driver
+class MemoryOutput : public HapticOutput {
+  public:
+    // One minute of samples
+    static constexpr size_t kCapacity = kSampleRate * 60;
+
+    const char* name() const override { return "memory"; }
+    bool realtime() const override { return false; }
+    bool queues() const override { return true; }
+    bool write(const Sample* samples, size_t count) override;
+    void stop() override;
+
+    std::vector<Sample> samples() const;
+    size_t stops() const;
+    // Samples written past kCapacity
+    size_t dropped() const;
+
+  private:
+    mutable std::mutex mLock;
+    std::vector<Sample> mSamples;
+    size_t mStops = 0;
+    size_t mDropped = 0;
+};
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.aac.hardware.richtap.vibrator-service.nubia"
+
+#include "HapticPlayer.h"
+
+#include <log/log.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <iterator>
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+constexpr int kPlaybackPriority = 2;
+
+constexpr std::chrono::nanoseconds samplesToDuration(size_t count) {
+    return std::chrono::nanoseconds(static_cast<int64_t>(count) * 1000000000LL / kSampleRate);
+}
+}  // namespace
+
+size_t BufferSource::read(Sample* out, size_t count) {
+    count = std::min(count, mSamples->size() - mPosition);
+    std::copy_n(mSamples->data() + mPosition, count, out);
+    mPosition += count;
+    return count;
+}
+
+void RenderSource::prepare() {
+    if (mBuffer) return;
+    mBuffer.emplace(mRender());
+    mRender = nullptr;
+}
+
+size_t RenderSource::read(Sample* out, size_t count) {
+    prepare();
+    return mBuffer->read(out, count);
+}
+
+HapticPlayer::HapticPlayer(std::unique_ptr<HapticOutput> output, CallbackBatcher& callbacks)
+    : mOutput(std::move(output)), mCallbacks(callbacks), mThread(&HapticPlayer::threadLoop, this) {}
+
+HapticPlayer::~HapticPlayer() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCv.notify_one();
+    mThread.join();
+}
+
+void HapticPlayer::play(std::unique_ptr<HapticSource> source, HapticPriority priority,
+                        std::shared_ptr<IRichtapCallback> callback) {
+    uint32_t seq = callback ? mCallbacks.submit(callback) : 0;
+    std::optional<Request> replaced;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto& slot = mQueued[static_cast<size_t>(priority)];
+        replaced.swap(slot);
+        slot = Request{std::move(source), std::move(callback), seq, priority,
+                       std::chrono::steady_clock::now()};
+    }
+    mCv.notify_one();
+    if (replaced) {
+        // Never started or suspended
+        stats(replaced->priority).interrupted.fetch_add(1, std::memory_order_relaxed);
+        complete(*replaced);
+    }
+}
+
+void HapticPlayer::stop() {
+    std::array<std::optional<Request>, kPriorities> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        dropped.swap(mQueued);
+        mStopRequested = true;
+    }
+    mCv.notify_one();
+    for (auto& request : dropped) {
+        if (!request) continue;
+        stats(request->priority).interrupted.fetch_add(1, std::memory_order_relaxed);
+        complete(*request);
+    }
+}
+
+void HapticPlayer::complete(Request& request) {
+    mUnderruns.fetch_add(request.source->underruns(), std::memory_order_relaxed);
+    if (!request.callback) return;
+    mCallbacks.complete(request.callback, request.seq);
+}
+
+bool HapticPlayer::preemptedLocked(HapticPriority priority) const {
+    if (mExit || mStopRequested) return true;
+    for (size_t i = static_cast<size_t>(priority); i < kPriorities; i++) {
+        if (mQueued[i]) return true;
+    }
+    return false;
+}
+
+void HapticPlayer::threadLoop() {
+    sched_param param = {.sched_priority = kPlaybackPriority};
+    if (int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) {
+        ALOGW("Can't make the playback thread real-time: %s", strerror(err));
+    }
+
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mCv.wait(lock, [this] {
+            return mExit || mStopRequested ||
+                   std::any_of(mQueued.begin(), mQueued.end(), [](auto& r) { return r.has_value(); });
+        });
+        if (mExit) return;
+        // Whatever is queued now came in after the stop
+        mStopRequested = false;
+
+        auto next = std::find_if(mQueued.rbegin(), mQueued.rend(),
+                                 [](auto& r) { return r.has_value(); });
+        if (next == mQueued.rend()) continue;
+        Request request = std::move(**next);
+        next->reset();
+
+        lock.unlock();
+        Outcome outcome = playRequest(request);
+        lock.lock();
+
+        if (outcome == Outcome::PREEMPTED && !mQueued[static_cast<size_t>(request.priority)]) {
+            // Something above took over, pick up from here once it is done
+            stats(request.priority).suspended.fetch_add(1, std::memory_order_relaxed);
+            mQueued[static_cast<size_t>(request.priority)] = std::move(request);
+            continue;
+        }
+        if (outcome != Outcome::PLAYED) {
+            stats(request.priority).interrupted.fetch_add(1, std::memory_order_relaxed);
+        }
+        lock.unlock();
+        complete(request);
+        lock.lock();
+    }
+}
+
+HapticPlayer::Outcome HapticPlayer::playRequest(Request& request) {
+    Sample buffer[kBufferSamples];
+    ClassStats& classStats = stats(request.priority);
+    // Before the clock starts, a slow prepare would leave the output behind otherwise
+    request.source->prepare();
+    auto deadline = std::chrono::steady_clock::now();
+
+    while (true) {
+        size_t count = request.source->read(buffer, kBufferSamples);
+        if (count == 0) {
+            mOutput->stop();
+            classStats.played.fetch_add(1, std::memory_order_relaxed);
+            return Outcome::PLAYED;
+        }
+
+        if (!request.started) {
+            request.started = true;
+            classStats.started.fetch_add(1, std::memory_order_relaxed);
+            uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - request.submittedAt).count();
+            classStats.firstSampleTotalUs.fetch_add(us, std::memory_order_relaxed);
+            if (us > classStats.firstSampleMaxUs.load(std::memory_order_relaxed)) {
+                classStats.firstSampleMaxUs.store(us, std::memory_order_relaxed);
+            }
+        }
+        if (!mOutput->write(buffer, count)) {
+            mOutput->stop();
+            return Outcome::FAILED;
+        }
+        mSamplesWritten.fetch_add(count, std::memory_order_relaxed);
+
+        std::unique_lock<std::mutex> lock(mLock);
+        if (mOutput->realtime()) {
+            // Stay one buffer ahead of an output that queues. One that doesn't only gets
+            // the next buffer once this one played out, it would be cut short otherwise.
+            deadline += samplesToDuration(count);
+            auto wakeAt = mOutput->queues() ? deadline - samplesToDuration(kBufferSamples)
+                                            : deadline;
+            mCv.wait_until(lock, wakeAt, [&] { return preemptedLocked(request.priority); });
+        }
+        if (preemptedLocked(request.priority)) {
+            if (mExit || mStopRequested) {
+                mStopRequested = false;
+                mOutput->stop();
+                return Outcome::STOPPED;
+            }
+            // The next waveform overwrites this one, no need to stop the output
+            return Outcome::PREEMPTED;
+        }
+    }
+}
+
+void HapticPlayer::dump(int fd) {
+    static constexpr const char* kClassNames[] = {"ringtone", "notification", "interactive"};
+    static_assert(std::size(kClassNames) == kPriorities);
+
+    dprintf(fd, "Output: %s, samples: %" PRIu64 ", source underruns: %" PRIu64 "\n",
+            mOutput->name(), mSamplesWritten.load(std::memory_order_relaxed),
+            mUnderruns.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < kPriorities; i++) {
+        const ClassStats& classStats = mStats[i];
+        uint32_t started = classStats.started.load(std::memory_order_relaxed);
+        dprintf(fd, "  %s: played %u, interrupted %u, suspended %u\n", kClassNames[i],
+                classStats.played.load(std::memory_order_relaxed),
+                classStats.interrupted.load(std::memory_order_relaxed),
+                classStats.suspended.load(std::memory_order_relaxed));
+        dprintf(fd, "    call to first sample: avg %.2f ms, max %.2f ms\n",
+                started ? classStats.firstSampleTotalUs.load(std::memory_order_relaxed) / 1000.0 /
+                                  started
+                        : 0.0,
+                classStats.firstSampleMaxUs.load(std::memory_order_relaxed) / 1000.0);
+    }
+}
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/vendor/aac/hardware/richtap/vibrator/IRichtapCallback.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "CallbackBatcher.h"
+#include "HapticOutput.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+// Samples pulled by the playback thread, one buffer at a time
+class HapticSource {
+  public:
+    virtual ~HapticSource() = default;
+    // Called on the playback thread before the first read, for work too slow for
+    // the binder call that queued the source
+    virtual void prepare() {}
+    // Fills up to count samples, 0 means the end of the waveform
+    virtual size_t read(Sample* out, size_t count) = 0;
+    // Reads that had to be filled with silence because the data wasn't there yet
+    virtual uint32_t underruns() const { return 0; }
+};
+
+// A waveform rendered up front
+class BufferSource : public HapticSource {
+  public:
+    explicit BufferSource(std::shared_ptr<const std::vector<Sample>> samples)
+        : mSamples(std::move(samples)) {}
+
+    size_t read(Sample* out, size_t count) override;
+
+  private:
+    std::shared_ptr<const std::vector<Sample>> mSamples;
+    size_t mPosition = 0;
+};
+
+// A waveform rendered by the playback thread once its request starts
+class RenderSource : public HapticSource {
+  public:
+    using Render = std::function<std::shared_ptr<const std::vector<Sample>>()>;
+
+    explicit RenderSource(Render render) : mRender(std::move(render)) {}
+
+    void prepare() override;
+    size_t read(Sample* out, size_t count) override;
+
+  private:
+    Render mRender;
+    std::optional<BufferSource> mBuffer;
+};
+
+// Scheduling classes, a request only preempts requests of its own class or below
+enum class HapticPriority : uint8_t {
+    RINGTONE,      // long or streamed waveforms
+    NOTIFICATION,
+    INTERACTIVE,   // ticks, clicks and per-frame effects
+    COUNT
+};
+
+// Plays the highest priority request on a SCHED_FIFO thread.
+//
+// Each class holds at most one request, a newer one replaces the older. A request
+// of a higher or the same class takes over at the next buffer boundary; a lower
+// class request that gets preempted is suspended and resumes where it left off
+// once nothing above it is left. The time from play() to the new waveform's first
+// sample is thus bounded by one buffer plus whatever the output has queued.
+//
+// The request's callback is notified through the batcher once it is done, whether
+// it played to the end, was replaced or was stopped.
+class HapticPlayer {
+  public:
+    // 4 ms, the granularity of preempting and stopping playback
+    static constexpr size_t kBufferSamples = kSampleRate / 250;
+
+    HapticPlayer(std::unique_ptr<HapticOutput> output, CallbackBatcher& callbacks);
+    ~HapticPlayer();
+
+    void play(std::unique_ptr<HapticSource> source, HapticPriority priority,
+              std::shared_ptr<IRichtapCallback> callback);
+    // Drops everything, playing and suspended
+    void stop();
+
+    void dump(int fd);
+
+  private:
+    static constexpr size_t kPriorities = static_cast<size_t>(HapticPriority::COUNT);
+
+    struct Request {
+        std::unique_ptr<HapticSource> source;
+        std::shared_ptr<IRichtapCallback> callback;
+        uint32_t seq;
+        HapticPriority priority;
+        std::chrono::steady_clock::time_point submittedAt;
+        bool started = false;
+    };
+
+    enum class Outcome { PLAYED, FAILED, PREEMPTED, STOPPED };
+
+    struct ClassStats {
+        std::atomic<uint32_t> started = 0;
+        std::atomic<uint32_t> played = 0;
+        std::atomic<uint32_t> interrupted = 0;
+        std::atomic<uint32_t> suspended = 0;
+        std::atomic<uint64_t> firstSampleTotalUs = 0;
+        std::atomic<uint64_t> firstSampleMaxUs = 0;
+    };
+
+    void threadLoop();
+    // True when something should take over from a request of this class
+    bool preemptedLocked(HapticPriority priority) const;
+    // Plays until the source ends or it is preempted or stopped
+    Outcome playRequest(Request& request);
+    void complete(Request& request);
+    ClassStats& stats(HapticPriority priority) {
+        return mStats[static_cast<size_t>(priority)];
+    }
+
+    std::unique_ptr<HapticOutput> mOutput;
+    CallbackBatcher& mCallbacks;
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    // Waiting or suspended, one per class
+    std::array<std::optional<Request>, kPriorities> mQueued;
+    bool mStopRequested = false;
+    bool mExit = false;
+    std::thread mThread;
+
+    std::array<ClassStats, kPriorities> mStats;
+    std::atomic<uint64_t> mSamplesWritten = 0;
+    // Of the sources that are done
+    std::atomic<uint64_t> mUnderruns = 0;
+};
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "HapticRenderer.h"
+
+#include "HapticKernels.h"
+
+#include <algorithm>
+#include <array>
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+constexpr size_t kSineBits = 8;
+constexpr double kPi = 3.14159265358979323846;
+
+constexpr double sinTaylor(double x) {
+    // Range reduced to [-pi, pi] by the caller, 11 terms are exact to 1e-9 there
+    double term = x, sum = x;
+    for (int n = 1; n <= 11; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+// One period of a full scale sine, evaluated at compile time
+constexpr std::array<int16_t, 1 << kSineBits> kSine = [] {
+    std::array<int16_t, 1 << kSineBits> table = {};
+    for (size_t i = 0; i < table.size(); i++) {
+        double x = 2 * kPi * i / table.size();
+        if (x > kPi) x -= 2 * kPi;
+        double value = sinTaylor(x) * 32767;
+        table[i] = static_cast<int16_t>(value < 0 ? value - 0.5 : value + 0.5);
+    }
+    return table;
+}();
+
+constexpr int32_t kFadeMs = 2;
+constexpr int32_t kTransientCycles = 2;
+
+int32_t clampPercent(int32_t value) {
+    return std::clamp(value, 0, 100);
+}
+
+int32_t percentToGain(int32_t percent) {
+    return clampPercent(percent) * kUnityGain / 100;
+}
+}  // namespace
+
+uint32_t HapticRenderer::frequencyMilliHz(int32_t freq) const {
+    // f0 is in 0.1 Hz, 50 maps to f0
+    return static_cast<uint32_t>(mParams.f0) * 100 * (50 + clampPercent(freq)) / 100;
+}
+
+void HapticRenderer::synth(std::vector<Sample>& out, size_t offset, size_t count, int32_t freq,
+                           int32_t startGain, int32_t endGain) const {
+    if (out.size() < offset + count) {
+        out.resize(offset + count);
+    }
+
+    // The table lookup stays scalar, the envelope and the mix go through the kernels
+    std::vector<int16_t> carrier(count);
+    uint64_t step = (static_cast<uint64_t>(frequencyMilliHz(freq)) << 32) / (kSampleRate * 1000ULL);
+    uint32_t phase = 0;
+    for (size_t i = 0; i < count; i++) {
+        carrier[i] = kSine[phase >> (32 - kSineBits)];
+        phase += static_cast<uint32_t>(step);
+    }
+
+    const HapticKernels& kernels = hapticKernels();
+    kernels.applyEnvelope(carrier.data(), carrier.data(), count, startGain, endGain);
+    // Mix with what is already there, transients can overlap
+    kernels.mixSaturate(carrier.data(), out.data() + offset, count,
+                        percentToGain(mParams.dynamicScale));
+}
+
+void HapticRenderer::transient(std::vector<Sample>& out, size_t offset, int32_t intensity,
+                               int32_t freq) const {
+    uint32_t milliHz = std::max<uint32_t>(frequencyMilliHz(freq), 1);
+    size_t count = static_cast<size_t>(kTransientCycles * 1000ULL * kSampleRate / milliHz);
+    size_t attack = count / 4;
+    int32_t gain = percentToGain(intensity);
+    synth(out, offset, attack, freq, 0, gain);
+    synth(out, offset + attack, count - attack, freq, gain, 0);
+}
+
+std::vector<Sample> HapticRenderer::renderConstant(int32_t durationMs, int32_t amplitude) const {
+    std::vector<Sample> out;
+    if (durationMs <= 0) return out;
+
+    int32_t gain = std::clamp(amplitude, 0, 255) * kUnityGain / 255;
+    size_t fade = std::min(samplesForMs(kFadeMs), samplesForMs(durationMs) / 2);
+    size_t total = samplesForMs(durationMs);
+    out.reserve(total);
+    synth(out, 0, fade, 50, 0, gain);
+    synth(out, fade, total - 2 * fade, 50, gain, gain);
+    synth(out, total - fade, fade, 50, gain, 0);
+    return out;
+}
+
+std::vector<Sample> HapticRenderer::renderHeParam(int32_t intervalMs, int32_t intensity,
+                                                  int32_t freq) const {
+    std::vector<Sample> out;
+    if (intervalMs <= 0) return out;
+
+    int32_t gain = percentToGain(intensity);
+    synth(out, 0, samplesForMs(intervalMs), freq, gain, gain);
+    return out;
+}
+
+std::vector<Sample> HapticRenderer::renderEnvelope(const std::vector<int32_t>& envInfo,
+                                                   bool fastFlag) const {
+    std::vector<Sample> out;
+    size_t points = envInfo.size() / kEnvelopePointSize;
+    if (points < 2) return out;
+
+    for (size_t i = 0; i + 1 < points; i++) {
+        const int32_t* from = &envInfo[i * kEnvelopePointSize];
+        const int32_t* to = &envInfo[(i + 1) * kEnvelopePointSize];
+        if (to[0] <= from[0]) continue;
+        size_t offset = samplesForMs(from[0]);
+        synth(out, offset, samplesForMs(to[0]) - offset, from[2], percentToGain(from[1]),
+              percentToGain(to[1]));
+    }
+
+    if (!fastFlag) {
+        // Soften the edges so a non-zero first or last point doesn't click
+        size_t fade = std::min(samplesForMs(kFadeMs), out.size() / 2);
+        for (size_t i = 0; i < fade; i++) {
+            out[i] = static_cast<Sample>(out[i] * static_cast<int32_t>(i) / static_cast<int32_t>(fade));
+            out[out.size() - 1 - i] = static_cast<Sample>(out[out.size() - 1 - i] *
+                                                          static_cast<int32_t>(i) /
+                                                          static_cast<int32_t>(fade));
+        }
+    }
+    return out;
+}
+
+std::vector<Sample> HapticRenderer::renderHe(int32_t looper, int32_t intervalMs, int32_t amplitude,
+                                             int32_t freq, const std::vector<int32_t>& data) const {
+    std::vector<Sample> pattern;
+    // amplitude scales every event's intensity, freq shifts every event's frequency
+    int32_t scale = std::clamp(amplitude, 0, 255);
+    int32_t shift = freq - 50;
+
+    for (size_t i = 0; i + kHeEventSize <= data.size(); i += kHeEventSize) {
+        int32_t type = data[i];
+        size_t offset = samplesForMs(std::max(data[i + 1], 0));
+        int32_t durationMs = data[i + 2];
+        int32_t intensity = clampPercent(data[i + 3]) * scale / 255;
+        int32_t eventFreq = clampPercent(data[i + 4] + shift);
+
+        if (type == kHeTransient) {
+            transient(pattern, offset, intensity, eventFreq);
+        } else if (type == kHeContinuous && durationMs > 0) {
+            int32_t gain = percentToGain(intensity);
+            synth(pattern, offset, samplesForMs(durationMs), eventFreq, gain, gain);
+        }
+    }
+
+    std::vector<Sample> out;
+    if (pattern.empty()) return out;
+
+    int32_t loops = std::max(looper, 1);
+    size_t gap = samplesForMs(std::max(intervalMs, 0));
+    out.reserve(loops * (pattern.size() + gap));
+    for (int32_t loop = 0; loop < loops; loop++) {
+        out.insert(out.end(), pattern.begin(), pattern.end());
+        if (loop + 1 < loops) out.resize(out.size() + gap);
+    }
+    return out;
+}
+
+int64_t HapticRenderer::envelopeDurationMs(const std::vector<int32_t>& envInfo) {
+    if (envInfo.size() % kEnvelopePointSize) return -1;
+
+    int64_t lastMs = -1;
+    for (size_t i = 0; i < envInfo.size(); i += kEnvelopePointSize) {
+        if (envInfo[i] <= lastMs) return -1;
+        lastMs = envInfo[i];
+    }
+    return std::max<int64_t>(lastMs, 0);
+}
+
+int64_t HapticRenderer::heDurationMs(int32_t looper, int32_t intervalMs,
+                                     const std::vector<int32_t>& data) const {
+    if (data.size() % kHeEventSize) return -1;
+
+    // Transients are longest at the lowest relative frequency
+    int64_t transientMs =
+            kTransientCycles * 1000000LL / std::max<uint32_t>(frequencyMilliHz(0), 1) + 1;
+    int64_t patternMs = 0;
+    for (size_t i = 0; i < data.size(); i += kHeEventSize) {
+        int64_t endMs = std::max(data[i + 1], 0);
+        if (data[i] == kHeTransient) {
+            endMs += transientMs;
+        } else if (data[i] == kHeContinuous) {
+            endMs += std::max(data[i + 2], 0);
+        }
+        patternMs = std::max(patternMs, endMs);
+    }
+
+    int64_t loops = std::max(looper, 1);
+    return loops * patternMs + (loops - 1) * std::max(intervalMs, 0);
+}
+
+std::vector<Sample> HapticRenderer::renderEffect(int32_t effect) const {
+    // Same ids as android.hardware.vibrator.Effect
+    enum : int32_t {
+        CLICK = 0,
+        DOUBLE_CLICK = 1,
+        TICK = 2,
+        THUD = 3,
+        POP = 4,
+        HEAVY_CLICK = 5,
+        TEXTURE_TICK = 21,
+    };
+
+    std::vector<Sample> out;
+    switch (effect) {
+        case CLICK:
+            transient(out, 0, 100, 50);
+            break;
+        case DOUBLE_CLICK:
+            transient(out, 0, 100, 50);
+            transient(out, samplesForMs(100), 100, 50);
+            break;
+        case TICK:
+            transient(out, 0, 50, 60);
+            break;
+        case THUD:
+            synth(out, 0, samplesForMs(30), 20, percentToGain(100), 0);
+            break;
+        case POP:
+            transient(out, 0, 70, 80);
+            break;
+        case HEAVY_CLICK:
+            transient(out, 0, 100, 40);
+            transient(out, samplesForMs(6), 60, 40);
+            break;
+        case TEXTURE_TICK:
+            transient(out, 0, 30, 70);
+            break;
+        default:
+            break;
+    }
+    return out;
+}
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
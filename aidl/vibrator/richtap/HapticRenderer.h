@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "HapticOutput.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+// Actuator tuning, set through setF0 and setDynamicScale
+struct RenderParams {
+    // Resonant frequency in 0.1 Hz
+    int32_t f0 = 1700;
+    // Global gain in percent
+    int32_t dynamicScale = 100;
+
+    bool operator==(const RenderParams&) const = default;
+};
+
+// Turns the RichTap effect descriptions into samples. Integer math and a
+// precomputed sine table only: the same input always gives the same output.
+//
+// Intensities and relative frequencies are in [0, 100], a relative frequency
+// of 50 plays at f0 and the range covers 0.5 to 1.5 times f0.
+class HapticRenderer {
+  public:
+    // HE data is a list of events of kHeEventSize ints:
+    //   {type, relativeTimeMs, durationMs, intensity, frequency, reserved}
+    static constexpr size_t kHeEventSize = 6;
+    static constexpr int32_t kHeContinuous = 1;
+    static constexpr int32_t kHeTransient = 2;
+    // Envelope points are {timeMs, intensity, frequency}, with increasing times
+    static constexpr size_t kEnvelopePointSize = 3;
+    // Longest waveform a single call may ask for
+    static constexpr int64_t kMaxDurationMs = 30 * 1000;
+    // Resonant frequencies setF0 accepts, 10 to 500 Hz
+    static constexpr int32_t kMinF0 = 100;
+    static constexpr int32_t kMaxF0 = 5000;
+
+    explicit HapticRenderer(const RenderParams& params) : mParams(params) {}
+
+    // on(): amplitude in [0, 255]
+    std::vector<Sample> renderConstant(int32_t durationMs, int32_t amplitude) const;
+    std::vector<Sample> renderHeParam(int32_t intervalMs, int32_t intensity, int32_t freq) const;
+    std::vector<Sample> renderEnvelope(const std::vector<int32_t>& envInfo, bool fastFlag) const;
+    std::vector<Sample> renderHe(int32_t looper, int32_t intervalMs, int32_t amplitude,
+                                 int32_t freq, const std::vector<int32_t>& data) const;
+    // android.hardware.vibrator Effect ids, empty when the effect isn't supported
+    std::vector<Sample> renderEffect(int32_t effect) const;
+
+    // Upper bounds of what the render calls above produce in ms, -1 for invalid input
+    static int64_t envelopeDurationMs(const std::vector<int32_t>& envInfo);
+    int64_t heDurationMs(int32_t looper, int32_t intervalMs, const std::vector<int32_t>& data) const;
+
+    static size_t samplesForMs(int64_t ms) { return static_cast<size_t>(ms * kSampleRate / 1000); }
+
+  private:
+    // Gain at the start and the end of a segment, Q15 in [0, kUnityGain]
+    void synth(std::vector<Sample>& out, size_t offset, size_t count, int32_t freq,
+               int32_t startGain, int32_t endGain) const;
+    void transient(std::vector<Sample>& out, size_t offset, int32_t intensity, int32_t freq) const;
+    uint32_t frequencyMilliHz(int32_t freq) const;
+
+    const RenderParams mParams;
+};
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
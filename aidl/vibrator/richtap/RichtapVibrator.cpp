@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.aac.hardware.richtap.vibrator-service.nubia"
+
+#include "RichtapVibrator.h"
+#include "RtpSource.h"
+
+#include <log/log.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+// First element of the effect cache keys
+enum CacheKey : int32_t {
+    PERFORM,
+    PERFORM_HE,
+    PERFORM_HE_PARAM,
+};
+
+// Waveforms up to this long are interactive, up to the next one notifications
+constexpr int64_t kInteractiveMaxMs = 100;
+constexpr int64_t kNotificationMaxMs = 1000;
+
+HapticPriority priorityFor(size_t samples) {
+    if (samples <= HapticRenderer::samplesForMs(kInteractiveMaxMs)) {
+        return HapticPriority::INTERACTIVE;
+    }
+    if (samples <= HapticRenderer::samplesForMs(kNotificationMaxMs)) {
+        return HapticPriority::NOTIFICATION;
+    }
+    return HapticPriority::RINGTONE;
+}
+}  // namespace
+
+RichtapVibrator::RichtapVibrator(std::unique_ptr<HapticOutput> output,
+                                 std::chrono::milliseconds callbackWindow)
+    : mCallbacks(callbackWindow), mPlayer(std::move(output), mCallbacks) {}
+
+HapticRenderer RichtapVibrator::renderer() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return HapticRenderer(mParams);
+}
+
+void RichtapVibrator::play(EffectCache::Waveform waveform,
+                           const std::shared_ptr<IRichtapCallback>& callback) {
+    HapticPriority priority = priorityFor(waveform->size());
+    mPlayer.play(std::make_unique<BufferSource>(std::move(waveform)), priority, callback);
+}
+
+void RichtapVibrator::playRendered(HapticPriority priority, std::vector<int32_t> key,
+                                   std::function<std::vector<Sample>(const HapticRenderer&)> render,
+                                   const std::shared_ptr<IRichtapCallback>& callback) {
+    auto source = std::make_unique<RenderSource>(
+            [this, key = std::move(key), render = std::move(render)]() -> EffectCache::Waveform {
+                if (key.empty()) {
+                    return std::make_shared<const std::vector<Sample>>(render(renderer()));
+                }
+                return mCache.get(key, [&] { return render(renderer()); });
+            });
+    mPlayer.play(std::move(source), priority, callback);
+}
+
+ndk::ScopedAStatus RichtapVibrator::init(const std::shared_ptr<IRichtapCallback>& /*callback*/) {
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::setDynamicScale(
+        int32_t scale, const std::shared_ptr<IRichtapCallback>& /*callback*/) {
+    ALOGD("setDynamicScale: %d", scale);
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mParams.dynamicScale != scale) {
+        mParams.dynamicScale = scale;
+        mCache.invalidate();
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::setF0(int32_t f0,
+                                          const std::shared_ptr<IRichtapCallback>& /*callback*/) {
+    ALOGD("setF0: %d", f0);
+    if (f0 < HapticRenderer::kMinF0 || f0 > HapticRenderer::kMaxF0) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mParams.f0 != f0) {
+        mParams.f0 = f0;
+        mCache.invalidate();
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::stop(const std::shared_ptr<IRichtapCallback>& /*callback*/) {
+    mPlayer.stop();
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::setAmplitude(
+        int32_t amplitude, const std::shared_ptr<IRichtapCallback>& /*callback*/) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mAmplitude = amplitude;
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::performHeParam(
+        int32_t interval, int32_t amplitude, int32_t freq,
+        const std::shared_ptr<IRichtapCallback>& callback) {
+    if (interval > HapticRenderer::kMaxDurationMs) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+    // Updated every frame by games, always interactive whatever the interval
+    playRendered(HapticPriority::INTERACTIVE, {PERFORM_HE_PARAM, interval, amplitude, freq},
+                 [=](const HapticRenderer& renderer) {
+                     return renderer.renderHeParam(interval, amplitude, freq);
+                 },
+                 callback);
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::off(const std::shared_ptr<IRichtapCallback>& /*callback*/) {
+    mPlayer.stop();
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::on(int32_t duration,
+                                       const std::shared_ptr<IRichtapCallback>& callback) {
+    if (duration > HapticRenderer::kMaxDurationMs) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+    int32_t amplitude;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        amplitude = mAmplitude;
+    }
+    playRendered(priorityFor(HapticRenderer::samplesForMs(std::max(duration, 0))), {},
+                 [=](const HapticRenderer& renderer) {
+                     return renderer.renderConstant(duration, amplitude);
+                 },
+                 callback);
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::perform(int32_t effect, int8_t enable,
+                                            const std::shared_ptr<IRichtapCallback>& callback,
+                                            int32_t* _aidl_return) {
+    if (!enable) {
+        mPlayer.stop();
+        *_aidl_return = 0;
+        return ndk::ScopedAStatus::ok();
+    }
+
+    // Rendered here, the reply needs the duration. The predefined effects are a few
+    // thousand samples at most and cached after the first call.
+    EffectCache::Waveform waveform =
+            mCache.get({PERFORM, effect}, [&] { return renderer().renderEffect(effect); });
+    if (waveform->empty()) {
+        ALOGW("Unsupported effect %d", effect);
+        *_aidl_return = -1;
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+    // Duration in ms, rounded up
+    *_aidl_return = static_cast<int32_t>((waveform->size() * 1000 + kSampleRate - 1) / kSampleRate);
+    play(std::move(waveform), callback);
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::performEnvelope(
+        const std::vector<int32_t>& envInfo, bool fastFlag,
+        const std::shared_ptr<IRichtapCallback>& callback) {
+    // Negative or non-increasing times would index out of the rendered buffer
+    int64_t durationMs = HapticRenderer::envelopeDurationMs(envInfo);
+    if (durationMs < 0 || durationMs > HapticRenderer::kMaxDurationMs) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+    playRendered(priorityFor(HapticRenderer::samplesForMs(durationMs)), {},
+                 [=](const HapticRenderer& renderer) {
+                     return renderer.renderEnvelope(envInfo, fastFlag);
+                 },
+                 callback);
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::performRtp(const ndk::ScopedFileDescriptor& file,
+                                               const std::shared_ptr<IRichtapCallback>& callback) {
+    std::unique_ptr<RtpSource> source = RtpSource::open(file.get());
+    if (!source) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+    ALOGD("performRtp: %s", source->mapped() ? "mapped" : "streamed");
+    mPlayer.play(std::move(source), HapticPriority::RINGTONE, callback);
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus RichtapVibrator::performHe(int32_t looper, int32_t interval, int32_t amplitude,
+                                              int32_t freq, const std::vector<int32_t>& data,
+                                              const std::shared_ptr<IRichtapCallback>& callback) {
+    int64_t durationMs = renderer().heDurationMs(looper, interval, data);
+    if (durationMs < 0 || durationMs > HapticRenderer::kMaxDurationMs) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+    std::vector<int32_t> key = {PERFORM_HE, looper, interval, amplitude, freq};
+    key.insert(key.end(), data.begin(), data.end());
+    playRendered(priorityFor(HapticRenderer::samplesForMs(durationMs)), std::move(key),
+                 [=](const HapticRenderer& renderer) {
+                     return renderer.renderHe(looper, interval, amplitude, freq, data);
+                 },
+                 callback);
+    return ndk::ScopedAStatus::ok();
+}
+
+binder_status_t RichtapVibrator::dump(int fd, const char** /*args*/, uint32_t /*numArgs*/) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        dprintf(fd, "f0: %d.%d Hz, dynamic scale: %d%%, amplitude: %d\n", mParams.f0 / 10,
+                mParams.f0 % 10, mParams.dynamicScale, mAmplitude);
+    }
+    mPlayer.dump(fd);
+    mCallbacks.dump(fd);
+    mCache.dump(fd);
+    return STATUS_OK;
+}
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/vendor/aac/hardware/richtap/vibrator/BnRichtapVibrator.h>
+
+#include <functional>
+#include <mutex>
+
+#include "CallbackBatcher.h"
+#include "EffectCache.h"
+#include "HapticPlayer.h"
+#include "HapticRenderer.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+class RichtapVibrator : public BnRichtapVibrator {
+  public:
+    RichtapVibrator(std::unique_ptr<HapticOutput> output, std::chrono::milliseconds callbackWindow);
+
+    ndk::ScopedAStatus init(const std::shared_ptr<IRichtapCallback>& callback) override;
+    ndk::ScopedAStatus setDynamicScale(int32_t scale,
+                                       const std::shared_ptr<IRichtapCallback>& callback) override;
+    ndk::ScopedAStatus setF0(int32_t f0, const std::shared_ptr<IRichtapCallback>& callback) override;
+    ndk::ScopedAStatus stop(const std::shared_ptr<IRichtapCallback>& callback) override;
+    ndk::ScopedAStatus setAmplitude(int32_t amplitude,
+                                    const std::shared_ptr<IRichtapCallback>& callback) override;
+    ndk::ScopedAStatus performHeParam(int32_t interval, int32_t amplitude, int32_t freq,
+                                      const std::shared_ptr<IRichtapCallback>& callback) override;
+    ndk::ScopedAStatus off(const std::shared_ptr<IRichtapCallback>& callback) override;
+    ndk::ScopedAStatus on(int32_t duration,
+                          const std::shared_ptr<IRichtapCallback>& callback) override;
+    ndk::ScopedAStatus perform(int32_t effect, int8_t enable,
+                               const std::shared_ptr<IRichtapCallback>& callback,
+                               int32_t* _aidl_return) override;
+    ndk::ScopedAStatus performEnvelope(const std::vector<int32_t>& envInfo, bool fastFlag,
+                                       const std::shared_ptr<IRichtapCallback>& callback) override;
+    ndk::ScopedAStatus performRtp(const ndk::ScopedFileDescriptor& file,
+                                  const std::shared_ptr<IRichtapCallback>& callback) override;
+    ndk::ScopedAStatus performHe(int32_t looper, int32_t interval, int32_t amplitude, int32_t freq,
+                                 const std::vector<int32_t>& data,
+                                 const std::shared_ptr<IRichtapCallback>& callback) override;
+
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
+  private:
+    // Renderer for the current tuning
+    HapticRenderer renderer();
+    void play(EffectCache::Waveform waveform, const std::shared_ptr<IRichtapCallback>& callback);
+    // Renders on the playback thread, with the tuning current by then. Cached under
+    // key unless it is empty.
+    void playRendered(HapticPriority priority, std::vector<int32_t> key,
+                      std::function<std::vector<Sample>(const HapticRenderer&)> render,
+                      const std::shared_ptr<IRichtapCallback>& callback);
+
+    std::mutex mLock;
+    RenderParams mParams;
+    int32_t mAmplitude = 255;
+
+    // perform, performHe and performHeParam repeat the same few patterns a lot. Used
+    // by the player's thread, so declared before it.
+    EffectCache mCache;
+
+    // Declared before the player, which notifies through it until it is gone
+    CallbackBatcher mCallbacks;
+    HapticPlayer mPlayer;
+};
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
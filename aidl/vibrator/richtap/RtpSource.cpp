@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.aac.hardware.richtap.vibrator-service.nubia"
+
+#include "RtpSource.h"
+
+#include <fcntl.h>
+#include <log/log.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+constexpr size_t kWavHeaderSize = 12;
+constexpr size_t kChunkHeaderSize = 8;
+constexpr int kPollTimeoutMs = 20;
+
+uint32_t le32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+uint16_t le16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+}  // namespace
+
+ssize_t RtpSource::parseHeader(const uint8_t* data, size_t size, bool complete,
+                               bool* isUnsigned, size_t* dataSize) {
+    *isUnsigned = false;
+    *dataSize = SIZE_MAX;
+    if (size < kWavHeaderSize && !complete) return kIncomplete;
+    if (size < kWavHeaderSize || memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4)) {
+        // Raw samples
+        return 0;
+    }
+
+    bool formatOk = false;
+    size_t offset = kWavHeaderSize;
+    while (offset + kChunkHeaderSize <= size) {
+        const uint8_t* chunk = data + offset;
+        uint32_t chunkSize = le32(chunk + 4);
+        if (!memcmp(chunk, "fmt ", 4)) {
+            if (chunkSize < 16) return -1;
+            if (offset + kChunkHeaderSize + 16 > size) return complete ? -1 : kIncomplete;
+            const uint8_t* fmt = chunk + kChunkHeaderSize;
+            uint16_t format = le16(fmt);
+            uint16_t channels = le16(fmt + 2);
+            uint32_t rate = le32(fmt + 4);
+            uint16_t bits = le16(fmt + 14);
+            if (format != 1 /* PCM */ || channels != 1 || rate != kSampleRate || bits != 8) {
+                ALOGE("Unsupported RTP format %u, %u channels, %u Hz, %u bits", format, channels,
+                      rate, bits);
+                return -1;
+            }
+            formatOk = true;
+        } else if (!memcmp(chunk, "data", 4)) {
+            if (!formatOk) return -1;
+            // 8 bit WAV samples are unsigned
+            *isUnsigned = true;
+            *dataSize = chunkSize;
+            return static_cast<ssize_t>(offset + kChunkHeaderSize);
+        }
+        offset += kChunkHeaderSize + chunkSize + (chunkSize & 1);
+    }
+    if (!complete) return kIncomplete;
+    ALOGE("No data chunk in the RTP header");
+    return -1;
+}
+
+std::unique_ptr<RtpSource> RtpSource::open(int fd) {
+    ::android::base::unique_fd dupFd(fcntl(fd, F_DUPFD_CLOEXEC, 0));
+    if (dupFd < 0) {
+        ALOGE("Can't dup the RTP fd: %s", strerror(errno));
+        return nullptr;
+    }
+    std::unique_ptr<RtpSource> source(new RtpSource(std::move(dupFd)));
+    int sourceFd = source->mFd.get();
+
+    // A mapping of a file the client can still truncate faults on the playback thread
+    struct stat st;
+    off_t offset = lseek(sourceFd, 0, SEEK_CUR);
+    int seals = fcntl(sourceFd, F_GET_SEALS);
+    if (seals >= 0 && (seals & F_SEAL_SHRINK) && fstat(sourceFd, &st) == 0 &&
+        S_ISREG(st.st_mode) && offset >= 0 && st.st_size > offset) {
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, sourceFd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            source->mMap = static_cast<const uint8_t*>(map);
+            source->mMapSize = st.st_size;
+            ssize_t start = parseHeader(source->mMap + offset, source->mMapSize - offset,
+                                        true /* complete */, &source->mUnsigned,
+                                        &source->mRemaining);
+            if (start < 0) return nullptr;
+            source->mPosition = offset + start;
+            source->mRemaining = std::min(source->mRemaining, source->mMapSize - source->mPosition);
+            return source;
+        }
+        ALOGW("Can't map the RTP file, streaming it: %s", strerror(errno));
+    }
+
+    // Even the header is read on the reader thread, a client's empty pipe must not
+    // hold up the binder thread
+    source->mReader = std::thread(&RtpSource::readerLoop, source.get());
+    return source;
+}
+
+RtpSource::~RtpSource() {
+    if (mReader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mExit = true;
+        }
+        mCv.notify_all();
+        mReader.join();
+    }
+    if (mMap) {
+        munmap(const_cast<uint8_t*>(mMap), mMapSize);
+    }
+}
+
+size_t RtpSource::copySamples(const uint8_t* in, size_t count, Sample* out) const {
+    if (mUnsigned) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = static_cast<Sample>(in[i] - 128);
+        }
+    } else {
+        memcpy(out, in, count);
+    }
+    return count;
+}
+
+size_t RtpSource::read(Sample* out, size_t count) {
+    if (mMap) {
+        count = std::min(count, mRemaining);
+        copySamples(mMap + mPosition, count, out);
+        mPosition += count;
+        mRemaining -= count;
+        return count;
+    }
+    return readStreamed(out, count);
+}
+
+size_t RtpSource::readStreamed(Sample* out, size_t count) {
+    size_t done = 0;
+    std::unique_lock<std::mutex> lock(mLock);
+    count = std::min(count, mRemaining);
+    while (done < count) {
+        Chunk& chunk = mChunks[mReadChunk];
+        if (!chunk.filled) {
+            if (mEof) break;
+            // The reader fell behind, play silence rather than blocking the playback thread
+            mUnderruns.fetch_add(1, std::memory_order_relaxed);
+            std::fill(out + done, out + count, 0);
+            return count;
+        }
+
+        size_t n = std::min(count - done, chunk.size - mReadOffset);
+        lock.unlock();
+        copySamples(chunk.data.data() + mReadOffset, n, out + done);
+        lock.lock();
+        done += n;
+        mReadOffset += n;
+        mRemaining -= n;
+        if (mReadOffset == chunk.size) {
+            chunk.filled = false;
+            mReadChunk ^= 1;
+            mReadOffset = 0;
+            mCv.notify_all();
+        }
+    }
+    return done;
+}
+
+ssize_t RtpSource::readSome(uint8_t* data, size_t size) {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (mExit) return -1;
+        }
+        // Poll so that a pipe the client keeps open can't hold up the destructor
+        pollfd pfd = {.fd = mFd.get(), .events = POLLIN};
+        int ready = TEMP_FAILURE_RETRY(poll(&pfd, 1, kPollTimeoutMs));
+        if (ready == 0) continue;
+        ssize_t n = ready > 0 ? TEMP_FAILURE_RETRY(::read(mFd.get(), data, size)) : ready;
+        if (n < 0) ALOGE("Can't read the RTP file: %s", strerror(errno));
+        return n;
+    }
+}
+
+bool RtpSource::readHeader() {
+    // The chunk is ours until it is marked filled, and the header has to fit in it
+    Chunk& first = mChunks[0];
+    size_t size = 0;
+    bool eof = false;
+    bool isUnsigned;
+    size_t dataSize;
+    ssize_t start;
+    do {
+        ssize_t n = readSome(first.data.data() + size, kChunkSize - size);
+        if (n < 0) return false;
+        eof = n == 0;
+        size += n;
+        start = parseHeader(first.data.data(), size, eof || size == kChunkSize, &isUnsigned,
+                            &dataSize);
+    } while (start == kIncomplete);
+    if (start < 0) return false;
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mUnsigned = isUnsigned;
+    mRemaining = dataSize;
+    mReadOffset = start;
+    first.size = size;
+    first.filled = true;
+    mEof = eof;
+    return true;
+}
+
+void RtpSource::readerLoop() {
+    if (!readHeader()) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEof = true;
+        return;
+    }
+
+    size_t writeChunk = 1;
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mExit && !mEof) {
+        Chunk& chunk = mChunks[writeChunk];
+        mCv.wait(lock, [&] { return mExit || !chunk.filled; });
+        if (mExit) break;
+
+        lock.unlock();
+        ssize_t size = readSome(chunk.data.data(), kChunkSize);
+        lock.lock();
+        if (size <= 0) {
+            mEof = true;
+            break;
+        }
+        chunk.size = size;
+        chunk.filled = true;
+        writeChunk ^= 1;
+    }
+}
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
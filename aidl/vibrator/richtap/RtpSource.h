@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "HapticPlayer.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+// Streams an RTP waveform from a file descriptor: raw signed 8 bit samples, or
+// an 8 bit mono PCM WAV file at kSampleRate, starting at the current offset of the
+// fd. Files sealed against shrinking (memfds) are mapped and read in place, since
+// the client can't truncate them under the playback thread. Anything else is read
+// in chunks by a helper thread into a double buffer, so playback can start as soon
+// as the first chunk is in.
+class RtpSource : public HapticSource {
+  public:
+    static constexpr size_t kChunkSize = 8192;
+
+    ~RtpSource() override;
+
+    // Takes its own copy of fd and never blocks on it. nullptr when the header of a
+    // mapped file is invalid, a streamed one just plays nothing.
+    static std::unique_ptr<RtpSource> open(int fd);
+
+    size_t read(Sample* out, size_t count) override;
+
+    bool mapped() const { return mMap != nullptr; }
+    uint32_t underruns() const override { return mUnderruns.load(std::memory_order_relaxed); }
+
+  private:
+    struct Chunk {
+        std::array<uint8_t, kChunkSize> data;
+        size_t size = 0;
+        bool filled = false;
+    };
+
+    explicit RtpSource(::android::base::unique_fd fd) : mFd(std::move(fd)) {}
+
+    // parseHeader() result when more data may complete the header
+    static constexpr ssize_t kIncomplete = -2;
+
+    // Returns the offset of the first sample, or -1 for an invalid header. dataSize is
+    // the size of the WAV data chunk, SIZE_MAX for raw samples. complete tells whether
+    // data holds everything there is, otherwise a header cut short is kIncomplete.
+    static ssize_t parseHeader(const uint8_t* data, size_t size, bool complete,
+                               bool* isUnsigned, size_t* dataSize);
+    size_t copySamples(const uint8_t* in, size_t count, Sample* out) const;
+    size_t readStreamed(Sample* out, size_t count);
+    // Reads up to size bytes without blocking the destructor. Returns the bytes
+    // read, 0 at the end of the file, -1 on error or when the source goes away.
+    ssize_t readSome(uint8_t* data, size_t size);
+    // Fills the first chunk until the header in it is complete
+    bool readHeader();
+    void readerLoop();
+
+    ::android::base::unique_fd mFd;
+    // Set by the reader before it marks the first chunk filled when streaming
+    bool mUnsigned = false;
+    // Samples left to play, anything after the WAV data chunk is ignored. Guarded
+    // by mLock when streaming.
+    size_t mRemaining = SIZE_MAX;
+
+    // Mapped files
+    const uint8_t* mMap = nullptr;
+    size_t mMapSize = 0;
+    size_t mPosition = 0;
+
+    // Streamed files
+    std::mutex mLock;
+    std::condition_variable mCv;
+    std::array<Chunk, 2> mChunks;
+    size_t mReadChunk = 0;
+    size_t mReadOffset = 0;
+    bool mEof = false;
+    bool mExit = false;
+    std::thread mReader;
+    std::atomic<uint32_t> mUnderruns = 0;
+};
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
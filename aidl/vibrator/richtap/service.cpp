@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "RichtapVibrator.h"
+
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+
+using ::aidl::vendor::aac::hardware::richtap::vibrator::HapticOutput;
+using ::aidl::vendor::aac::hardware::richtap::vibrator::RichtapVibrator;
+
+int main() {
+    ABinderProcess_setThreadPoolMaxThreadCount(0);
+
+    std::string spec = ::android::base::GetProperty("ro.vendor.richtap.output", "ff");
+    std::unique_ptr<HapticOutput> output = HapticOutput::create(spec);
+    CHECK(output) << "No haptic output for " << spec;
+
+    // Completions within the window reach a callback as a single transaction,
+    // except for requests that finish ahead of older ones
+    std::chrono::milliseconds callbackWindow(
+            ::android::base::GetIntProperty("ro.vendor.richtap.callback_window_ms", 8, 0, 1000));
+
+    std::shared_ptr<RichtapVibrator> vibrator =
+            ndk::SharedRefBase::make<RichtapVibrator>(std::move(output), callbackWindow);
+
+    const std::string instance = std::string() + RichtapVibrator::descriptor + "/default";
+    binder_status_t status = AServiceManager_addService(vibrator->asBinder().get(), instance.c_str());
+    CHECK(status == STATUS_OK);
+
+    ABinderProcess_joinThreadPool();
+    return EXIT_FAILURE; // should not reach
+}
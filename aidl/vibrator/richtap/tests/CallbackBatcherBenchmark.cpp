@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <aidl/vendor/aac/hardware/richtap/vibrator/BnRichtapCallback.h>
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <thread>
+
+#include "CallbackBatcher.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+
+// Stand-in client, every onCallback is one oneway transaction
+class CountingCallback : public BnRichtapCallback {
+  public:
+    ndk::ScopedAStatus onCallback(int32_t value) override {
+        mLast.store(value, std::memory_order_relaxed);
+        mTransactions.fetch_add(1, std::memory_order_relaxed);
+        return ndk::ScopedAStatus::ok();
+    }
+
+    int32_t last() const { return mLast.load(std::memory_order_relaxed); }
+    uint64_t transactions() const { return mTransactions.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<int32_t> mLast = 0;
+    std::atomic<uint64_t> mTransactions = 0;
+};
+
+// A game calling performHeParam as fast as it can, each request done right away.
+// range(0) is the coalescing window in ms.
+void BM_CompletionsUnderLoad(benchmark::State& state) {
+    CallbackBatcher batcher{std::chrono::milliseconds(state.range(0))};
+    auto callback = ndk::SharedRefBase::make<CountingCallback>();
+    uint32_t seq = 0;
+    for (auto _ : state) {
+        seq = batcher.submit(callback);
+        batcher.complete(callback, seq);
+    }
+    // Let the last notification out before counting
+    while (callback->last() != static_cast<int32_t>(seq)) std::this_thread::yield();
+
+    state.counters["completions"] = benchmark::Counter(seq, benchmark::Counter::kIsRate);
+    state.counters["transactions"] =
+            benchmark::Counter(callback->transactions(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CompletionsUnderLoad)->Arg(0)->Arg(4)->Arg(16)->UseRealTime();
+
+// Frames at a fixed rate, one request per 120 Hz frame
+void BM_CompletionsPerFrame(benchmark::State& state) {
+    constexpr auto kFrame = std::chrono::microseconds(1000000 / 120);
+    CallbackBatcher batcher{std::chrono::milliseconds(state.range(0))};
+    auto callback = ndk::SharedRefBase::make<CountingCallback>();
+    uint32_t seq = 0;
+    for (auto _ : state) {
+        seq = batcher.submit(callback);
+        batcher.complete(callback, seq);
+        std::this_thread::sleep_for(kFrame);
+    }
+    while (callback->last() != static_cast<int32_t>(seq)) std::this_thread::yield();
+
+    state.counters["transactions"] =
+            benchmark::Counter(callback->transactions(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CompletionsPerFrame)->Arg(0)->Arg(16)->Arg(50)->UseRealTime();
+
+} // namespace
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
+
+BENCHMARK_MAIN();
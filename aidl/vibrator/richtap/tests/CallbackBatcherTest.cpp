@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "CallbackBatcher.h"
+#include "RecordingCallback.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+
+using std::chrono::milliseconds;
+using testing::ElementsAre;
+
+constexpr milliseconds kWindow(20);
+
+class CallbackBatcherTest : public testing::Test {
+  protected:
+    CallbackBatcher mBatcher{kWindow};
+    std::shared_ptr<RecordingCallback> mCallback =
+            ndk::SharedRefBase::make<RecordingCallback>();
+};
+
+TEST_F(CallbackBatcherTest, NumbersRequestsPerBinder) {
+    auto other = ndk::SharedRefBase::make<RecordingCallback>();
+    EXPECT_EQ(mBatcher.submit(mCallback), 1);
+    EXPECT_EQ(mBatcher.submit(mCallback), 2);
+    EXPECT_EQ(mBatcher.submit(other), 1);
+}
+
+TEST_F(CallbackBatcherTest, CoalescesWithinTheWindow) {
+    for (int i = 0; i < 10; i++) {
+        mBatcher.complete(mCallback, mBatcher.submit(mCallback));
+    }
+    ASSERT_TRUE(mCallback->waitFor(10));
+    EXPECT_THAT(mCallback->values(), ElementsAre(10));
+}
+
+TEST_F(CallbackBatcherTest, ReportsEarlyCompletionsOnTheirOwn) {
+    uint32_t ringtone = mBatcher.submit(mCallback);
+    uint32_t click = mBatcher.submit(mCallback);
+    // The click preempts the ringtone and finishes first
+    mBatcher.complete(mCallback, click);
+    std::this_thread::sleep_for(kWindow * 3);
+    EXPECT_THAT(mCallback->values(), ElementsAre(-static_cast<int32_t>(click)));
+
+    mBatcher.complete(mCallback, ringtone);
+    ASSERT_TRUE(mCallback->waitFor(click));
+    EXPECT_THAT(mCallback->values(), ElementsAre(-static_cast<int32_t>(click), click));
+}
+
+TEST_F(CallbackBatcherTest, NothingBeforeTheOldestRequestIsDone) {
+    uint32_t first = mBatcher.submit(mCallback);
+    for (int i = 0; i < 3; i++) mBatcher.submit(mCallback);
+    mBatcher.complete(mCallback, first);
+    ASSERT_TRUE(mCallback->waitFor(first));
+    std::this_thread::sleep_for(kWindow * 2);
+    EXPECT_THAT(mCallback->values(), ElementsAre(first));
+}
+
+TEST_F(CallbackBatcherTest, ZeroWindowKeepsTheOrder) {
+    CallbackBatcher batcher(milliseconds(0));
+    for (int i = 0; i < 100; i++) {
+        batcher.complete(mCallback, batcher.submit(mCallback));
+    }
+    ASSERT_TRUE(mCallback->waitFor(100));
+    auto values = mCallback->values();
+    EXPECT_TRUE(std::is_sorted(values.begin(), values.end()));
+    EXPECT_GT(values.front(), 0);
+}
+
+TEST_F(CallbackBatcherTest, InFlightBindersKeepTheirNumbering) {
+    EXPECT_EQ(mBatcher.submit(mCallback), 1);
+    // More idle binders than the batcher keeps entries for
+    std::vector<std::shared_ptr<RecordingCallback>> others;
+    for (int i = 0; i < 100; i++) {
+        auto other = ndk::SharedRefBase::make<RecordingCallback>();
+        mBatcher.complete(other, mBatcher.submit(other));
+        others.push_back(other);
+    }
+    for (const auto& other : others) ASSERT_TRUE(other->waitFor(1));
+    EXPECT_EQ(mBatcher.submit(mCallback), 2);
+}
+
+} // namespace
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
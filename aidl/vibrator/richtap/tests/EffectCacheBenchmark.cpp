@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+#include "EffectCache.h"
+#include "HapticRenderer.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+
+struct Request {
+    std::vector<int32_t> key;
+    std::function<std::vector<Sample>(const HapticRenderer&)> render;
+};
+
+// A few minutes of typing on a keyboard with haptic feedback: mostly key clicks,
+// some heavier clicks for space and delete, and the occasional scroll detent
+// pattern through performHe. Keys are laid out like RichtapVibrator's.
+std::vector<Request> typingTrace(size_t length) {
+    const std::vector<int32_t> detents[] = {
+            {HapticRenderer::kHeTransient, 0, 0, 60, 80, 0},
+            {HapticRenderer::kHeTransient, 0, 0, 40, 80, 0},
+            {HapticRenderer::kHeContinuous, 0, 20, 50, 50, 0},
+    };
+
+    std::mt19937 random(1);
+    std::vector<Request> trace;
+    for (size_t i = 0; i < length; i++) {
+        uint32_t pick = random() % 100;
+        if (pick < 80) {
+            trace.push_back({{0 /* PERFORM */, 0 /* CLICK */},
+                             [](const HapticRenderer& r) { return r.renderEffect(0); }});
+        } else if (pick < 92) {
+            trace.push_back({{0 /* PERFORM */, 5 /* HEAVY_CLICK */},
+                             [](const HapticRenderer& r) { return r.renderEffect(5); }});
+        } else {
+            const auto& data = detents[pick % 3];
+            std::vector<int32_t> key = {1 /* PERFORM_HE */, 1, 0, 255, 50};
+            key.insert(key.end(), data.begin(), data.end());
+            trace.push_back({std::move(key), [&data](const HapticRenderer& r) {
+                                 return r.renderHe(1, 0, 255, 50, data);
+                             }});
+        }
+    }
+    return trace;
+}
+
+constexpr size_t kTraceLength = 4096;
+
+void BM_TypingTraceCached(benchmark::State& state) {
+    auto trace = typingTrace(kTraceLength);
+    HapticRenderer renderer{RenderParams()};
+    EffectCache cache;
+    size_t renders = 0;
+    for (auto _ : state) {
+        for (const auto& request : trace) {
+            auto waveform = cache.get(request.key, [&] {
+                renders++;
+                return request.render(renderer);
+            });
+            benchmark::DoNotOptimize(waveform->data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * trace.size());
+    state.counters["hit_rate"] =
+            1.0 - static_cast<double>(renders) / (state.iterations() * trace.size());
+}
+BENCHMARK(BM_TypingTraceCached);
+
+// Rendering every request, as without the cache
+void BM_TypingTraceRendered(benchmark::State& state) {
+    auto trace = typingTrace(kTraceLength);
+    HapticRenderer renderer{RenderParams()};
+    for (auto _ : state) {
+        for (const auto& request : trace) {
+            auto waveform = request.render(renderer);
+            benchmark::DoNotOptimize(waveform.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * trace.size());
+}
+BENCHMARK(BM_TypingTraceRendered);
+
+// The tuning changing every range(0) requests, e.g. while the user drags a slider
+void BM_TypingTraceInvalidated(benchmark::State& state) {
+    auto trace = typingTrace(kTraceLength);
+    HapticRenderer renderer{RenderParams()};
+    EffectCache cache;
+    size_t renders = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < trace.size(); i++) {
+            if (i % state.range(0) == 0) cache.invalidate();
+            auto waveform = cache.get(trace[i].key, [&] {
+                renders++;
+                return trace[i].render(renderer);
+            });
+            benchmark::DoNotOptimize(waveform->data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * trace.size());
+    state.counters["hit_rate"] =
+            1.0 - static_cast<double>(renders) / (state.iterations() * trace.size());
+}
+BENCHMARK(BM_TypingTraceInvalidated)->Arg(16)->Arg(256);
+
+} // namespace
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
+
+BENCHMARK_MAIN();
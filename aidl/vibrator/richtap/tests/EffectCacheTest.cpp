@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "EffectCache.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+
+class EffectCacheTest : public testing::Test {
+  protected:
+    // Renders a waveform of samples samples and counts the renders
+    std::function<std::vector<Sample>()> render(size_t samples, Sample value = 1) {
+        return [this, samples, value] {
+            mRenders++;
+            return std::vector<Sample>(samples, value);
+        };
+    }
+
+    // Room for two waveforms of 40 samples
+    EffectCache mCache{100 * sizeof(Sample)};
+    int mRenders = 0;
+};
+
+TEST_F(EffectCacheTest, HitsReturnTheSameWaveform) {
+    auto first = mCache.get({0, 1}, render(40));
+    auto second = mCache.get({0, 1}, render(40));
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(mRenders, 1);
+
+    // A different key, even with the same prefix, is a miss
+    mCache.get({0, 1, 2}, render(40));
+    EXPECT_EQ(mRenders, 2);
+}
+
+TEST_F(EffectCacheTest, EvictsTheLeastRecentlyUsed) {
+    mCache.get({1}, render(40));
+    mCache.get({2}, render(40));
+    // {1} becomes the most recently used, {2} goes
+    mCache.get({1}, render(40));
+    mCache.get({3}, render(40));
+    EXPECT_EQ(mRenders, 3);
+
+    mCache.get({1}, render(40));
+    EXPECT_EQ(mRenders, 3);
+    mCache.get({2}, render(40));
+    EXPECT_EQ(mRenders, 4);
+}
+
+TEST_F(EffectCacheTest, OversizedWaveformsAreNotCached) {
+    mCache.get({1}, render(40));
+    auto big = mCache.get({9}, render(200));
+    EXPECT_EQ(big->size(), 200);
+    mCache.get({9}, render(200));
+    EXPECT_EQ(mRenders, 3);
+    // And don't push anything else out
+    mCache.get({1}, render(40));
+    EXPECT_EQ(mRenders, 3);
+}
+
+TEST_F(EffectCacheTest, InvalidateDropsEverything) {
+    auto stale = mCache.get({1}, render(40, 1));
+    mCache.invalidate();
+    auto fresh = mCache.get({1}, render(40, 2));
+    EXPECT_EQ(mRenders, 2);
+    EXPECT_EQ(fresh->front(), 2);
+    // Waveforms already handed out stay valid
+    EXPECT_EQ(stale->front(), 1);
+}
+
+TEST_F(EffectCacheTest, RenderInFlightDuringInvalidateIsNotCached) {
+    mCache.get({1}, [this] {
+        // The tuning changes while this one renders with the old tuning
+        mCache.invalidate();
+        return std::vector<Sample>(40, 1);
+    });
+    auto waveform = mCache.get({1}, render(40, 2));
+    EXPECT_EQ(mRenders, 1);
+    EXPECT_EQ(waveform->front(), 2);
+}
+
+TEST_F(EffectCacheTest, ConcurrentGets) {
+    std::atomic<int> renders = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 2000; i++) {
+                int32_t key = (i + t) % 5;
+                auto waveform = mCache.get({key}, [&] {
+                    renders++;
+                    return std::vector<Sample>(20, static_cast<Sample>(key));
+                });
+                ASSERT_EQ(waveform->front(), key);
+                if (i % 500 == 0) mCache.invalidate();
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    EXPECT_LT(renders, 4 * 2000);
+}
+
+} // namespace
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
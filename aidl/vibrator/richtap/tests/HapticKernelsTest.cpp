@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "HapticKernels.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+
+// Long enough for every vector loop plus a tail of each length
+constexpr size_t kMaxCount = 100;
+constexpr int kIterations = 20000;
+
+class HapticKernelsTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        mKernels = supportedHapticKernels();
+        ASSERT_FALSE(mKernels.empty());
+        ASSERT_STREQ(mKernels.front()->name, "scalar");
+        if (mKernels.size() == 1) GTEST_SKIP() << "Only the scalar kernels are supported";
+    }
+
+    std::vector<int16_t> randomCarrier(size_t count) {
+        std::uniform_int_distribution<int32_t> sample(INT16_MIN, INT16_MAX);
+        std::vector<int16_t> carrier(count);
+        for (int16_t& value : carrier) value = static_cast<int16_t>(sample(mRandom));
+        return carrier;
+    }
+
+    // Full scale ramps and flat gains half of the time, they hit the ends of the range
+    std::pair<int32_t, int32_t> randomGains(int iteration) {
+        std::uniform_int_distribution<int32_t> gain(0, kUnityGain);
+        switch (iteration % 4) {
+            case 0:
+                return {0, kUnityGain};
+            case 1:
+                return {kUnityGain, kUnityGain};
+            default:
+                return {gain(mRandom), gain(mRandom)};
+        }
+    }
+
+    std::vector<const HapticKernels*> mKernels;
+    std::mt19937 mRandom{1};
+};
+
+TEST_F(HapticKernelsTest, EnvelopeMatchesScalar) {
+    const HapticKernels& scalar = *mKernels.front();
+    for (int i = 0; i < kIterations; i++) {
+        size_t count = i % (kMaxCount + 1);
+        auto [startGain, endGain] = randomGains(i);
+        std::vector<int16_t> carrier = randomCarrier(count);
+        std::vector<int16_t> expected(count);
+        scalar.applyEnvelope(carrier.data(), expected.data(), count, startGain, endGain);
+
+        for (size_t k = 1; k < mKernels.size(); k++) {
+            std::vector<int16_t> out(count);
+            mKernels[k]->applyEnvelope(carrier.data(), out.data(), count, startGain, endGain);
+            ASSERT_EQ(out, expected) << mKernels[k]->name << ", count " << count << ", gain "
+                                     << startGain << " to " << endGain;
+        }
+    }
+}
+
+TEST_F(HapticKernelsTest, MixSaturateMatchesScalar) {
+    const HapticKernels& scalar = *mKernels.front();
+    std::uniform_int_distribution<int32_t> sample(INT8_MIN, INT8_MAX);
+    for (int i = 0; i < kIterations; i++) {
+        size_t count = i % (kMaxCount + 1);
+        int32_t gain = randomGains(i).first;
+        std::vector<int16_t> in = randomCarrier(count);
+        std::vector<Sample> mixed(count);
+        for (Sample& value : mixed) value = static_cast<Sample>(sample(mRandom));
+        std::vector<Sample> expected = mixed;
+        scalar.mixSaturate(in.data(), expected.data(), count, gain);
+
+        for (size_t k = 1; k < mKernels.size(); k++) {
+            std::vector<Sample> out = mixed;
+            mKernels[k]->mixSaturate(in.data(), out.data(), count, gain);
+            ASSERT_EQ(out, expected) << mKernels[k]->name << ", count " << count << ", gain "
+                                     << gain;
+        }
+    }
+}
+
+TEST_F(HapticKernelsTest, FastestIsPicked) {
+    EXPECT_EQ(&hapticKernels(), mKernels.back());
+}
+
+}  // namespace
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+
+#include "HapticPlayer.h"
+#include "HapticRenderer.h"
+#include "RecordingCallback.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+
+using std::chrono::milliseconds;
+using Clock = std::chrono::steady_clock;
+
+// A paced sink that notes when each waveform, told apart by its sample value,
+// first reaches it
+class SinkOutput : public HapticOutput {
+  public:
+    const char* name() const override { return "sink"; }
+    bool realtime() const override { return true; }
+    bool queues() const override { return true; }
+
+    bool write(const Sample* samples, size_t count) override {
+        auto now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            for (size_t i = 0; i < count; i++) {
+                if (samples[i] != mLast) {
+                    mLast = samples[i];
+                    mChanges.push_back({samples[i], now});
+                }
+                mCount[static_cast<uint8_t>(samples[i])]++;
+            }
+        }
+        mCv.notify_all();
+        return true;
+    }
+
+    void stop() override {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mLast = 0;
+            mStops.push_back(Clock::now());
+        }
+        mCv.notify_all();
+    }
+
+    // When the sink switched to value after since, if it did within timeout
+    std::optional<Clock::time_point> waitForSwitch(Sample value, Clock::time_point since,
+                                                   milliseconds timeout = milliseconds(2000)) {
+        std::unique_lock<std::mutex> lock(mLock);
+        std::optional<Clock::time_point> at;
+        mCv.wait_for(lock, timeout, [&] {
+            for (const auto& change : mChanges) {
+                if (change.value == value && change.at >= since) {
+                    at = change.at;
+                    return true;
+                }
+            }
+            return false;
+        });
+        return at;
+    }
+
+    std::optional<Clock::time_point> waitForStop(Clock::time_point since,
+                                                 milliseconds timeout = milliseconds(2000)) {
+        std::unique_lock<std::mutex> lock(mLock);
+        std::optional<Clock::time_point> at;
+        mCv.wait_for(lock, timeout, [&] {
+            auto it = std::find_if(mStops.begin(), mStops.end(),
+                                   [&](auto stop) { return stop >= since; });
+            if (it != mStops.end()) at = *it;
+            return at.has_value();
+        });
+        return at;
+    }
+
+    size_t count(Sample value) {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mCount[static_cast<uint8_t>(value)];
+    }
+
+  private:
+    struct Change {
+        Sample value;
+        Clock::time_point at;
+    };
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    Sample mLast = 0;
+    std::vector<Change> mChanges;
+    std::vector<Clock::time_point> mStops;
+    size_t mCount[256] = {};
+};
+
+// Bound on the switch to a new waveform: one buffer in flight, plus room for the
+// scheduler of a loaded host
+constexpr milliseconds kMaxSwitch(4 + 16);
+
+class HapticPlayerTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        auto output = std::make_unique<SinkOutput>();
+        mSink = output.get();
+        mPlayer.emplace(std::move(output), mBatcher);
+    }
+
+    void TearDown() override { mPlayer.reset(); }
+
+    // Returns when the waveform first reached the sink
+    Clock::time_point play(Sample value, milliseconds duration, HapticPriority priority,
+                           std::shared_ptr<IRichtapCallback> callback = nullptr) {
+        auto samples = std::make_shared<const std::vector<Sample>>(
+                HapticRenderer::samplesForMs(duration.count()), value);
+        auto start = Clock::now();
+        mPlayer->play(std::make_unique<BufferSource>(std::move(samples)), priority,
+                      std::move(callback));
+        auto at = mSink->waitForSwitch(value, start);
+        EXPECT_TRUE(at.has_value()) << "value " << static_cast<int>(value);
+        return at.value_or(Clock::now());
+    }
+
+    CallbackBatcher mBatcher{milliseconds(0)};
+    SinkOutput* mSink;
+    std::optional<HapticPlayer> mPlayer;
+};
+
+TEST_F(HapticPlayerTest, InteractivePreemptsInBoundedTime) {
+    constexpr int kRuns = 20;
+    play(1, milliseconds(10000), HapticPriority::RINGTONE);
+
+    std::vector<Clock::duration> switches;
+    for (int i = 0; i < kRuns; i++) {
+        auto start = Clock::now();
+        // Alternate values so each tap is a switch the sink can see
+        auto at = play(2 + i % 2, milliseconds(8), HapticPriority::INTERACTIVE);
+        switches.push_back(at - start);
+    }
+
+    std::sort(switches.begin(), switches.end());
+    auto us = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    };
+    RecordProperty("switch_median_us", us(switches[kRuns / 2]));
+    RecordProperty("switch_max_us", us(switches.back()));
+    EXPECT_LT(switches.back(), kMaxSwitch);
+}
+
+TEST_F(HapticPlayerTest, SuspendedRingtoneResumes) {
+    auto ringtone = ndk::SharedRefBase::make<RecordingCallback>();
+    auto tap = ndk::SharedRefBase::make<RecordingCallback>();
+    play(1, milliseconds(200), HapticPriority::RINGTONE, ringtone);
+    auto tapStart = play(2, milliseconds(20), HapticPriority::INTERACTIVE, tap);
+
+    // The tap is done and reported first, the ringtone picks up after it
+    ASSERT_TRUE(tap->waitFor(1));
+    EXPECT_TRUE(ringtone->values().empty());
+    EXPECT_TRUE(mSink->waitForSwitch(1, tapStart).has_value());
+    ASSERT_TRUE(ringtone->waitFor(1));
+
+    // And played out in full, not restarted
+    EXPECT_EQ(mSink->count(1), HapticRenderer::samplesForMs(200));
+    EXPECT_EQ(mSink->count(2), HapticRenderer::samplesForMs(20));
+}
+
+TEST_F(HapticPlayerTest, SameClassReplaces) {
+    auto first = ndk::SharedRefBase::make<RecordingCallback>();
+    play(1, milliseconds(500), HapticPriority::NOTIFICATION, first);
+    play(2, milliseconds(20), HapticPriority::NOTIFICATION);
+
+    // The first one is over, it doesn't come back
+    ASSERT_TRUE(first->waitFor(1));
+    std::this_thread::sleep_for(milliseconds(100));
+    EXPECT_LT(mSink->count(1), HapticRenderer::samplesForMs(500));
+    EXPECT_EQ(mSink->count(2), HapticRenderer::samplesForMs(20));
+}
+
+TEST_F(HapticPlayerTest, LowerClassWaits) {
+    auto tapStart = play(1, milliseconds(100), HapticPriority::INTERACTIVE);
+    auto start = Clock::now();
+    mPlayer->play(std::make_unique<BufferSource>(std::make_shared<const std::vector<Sample>>(
+                          HapticRenderer::samplesForMs(20), 2)),
+                  HapticPriority::RINGTONE, nullptr);
+
+    auto at = mSink->waitForSwitch(2, start);
+    ASSERT_TRUE(at.has_value());
+    // Not before the tap's 100 ms, less the buffer the sink is kept ahead by
+    EXPECT_GE(*at - tapStart, milliseconds(100 - 8));
+    EXPECT_EQ(mSink->count(1), HapticRenderer::samplesForMs(100));
+}
+
+TEST_F(HapticPlayerTest, StopIsBoundedAndDropsSuspended) {
+    auto ringtone = ndk::SharedRefBase::make<RecordingCallback>();
+    play(1, milliseconds(10000), HapticPriority::RINGTONE, ringtone);
+    play(2, milliseconds(10000), HapticPriority::INTERACTIVE);
+
+    auto start = Clock::now();
+    mPlayer->stop();
+    auto at = mSink->waitForStop(start);
+    ASSERT_TRUE(at.has_value());
+    EXPECT_LT(*at - start, kMaxSwitch);
+
+    // The suspended ringtone is done too, and never resumes
+    ASSERT_TRUE(ringtone->waitFor(1));
+    EXPECT_FALSE(mSink->waitForSwitch(1, start, milliseconds(100)).has_value());
+}
+
+} // namespace
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "HapticRenderer.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+
+const std::vector<int32_t> kContinuous = {HapticRenderer::kHeContinuous, 10, 100, 50, 50, 0};
+const std::vector<int32_t> kTransient = {HapticRenderer::kHeTransient, 0, 0, 50, 50, 0};
+
+TEST(HapticRendererTest, EnvelopeDuration) {
+    EXPECT_EQ(HapticRenderer::envelopeDurationMs({0, 50, 50, 100, 50, 50}), 100);
+    // Negative or non-increasing times, and partial points, are invalid
+    EXPECT_EQ(HapticRenderer::envelopeDurationMs({-5, 50, 50, 100, 50, 50}), -1);
+    EXPECT_EQ(HapticRenderer::envelopeDurationMs({10, 50, 50, 10, 50, 50}), -1);
+    EXPECT_EQ(HapticRenderer::envelopeDurationMs({10, 50, 50, 100}), -1);
+}
+
+TEST(HapticRendererTest, HeDuration) {
+    HapticRenderer renderer{RenderParams()};
+    EXPECT_EQ(renderer.heDurationMs(1, 0, kContinuous), 110);
+    // Three loops with 20 ms in between
+    EXPECT_EQ(renderer.heDurationMs(3, 20, kContinuous), 370);
+    EXPECT_GT(renderer.heDurationMs(INT32_MAX, INT32_MAX, {1, 0, 30000, 50, 50, 0}),
+              HapticRenderer::kMaxDurationMs);
+}
+
+TEST(HapticRendererTest, RenderedHeFitsItsDuration) {
+    for (int32_t f0 : {HapticRenderer::kMinF0, 1700, HapticRenderer::kMaxF0}) {
+        RenderParams params;
+        params.f0 = f0;
+        HapticRenderer renderer(params);
+        for (const auto& data : {kContinuous, kTransient}) {
+            auto samples = renderer.renderHe(1, 0, 255, 50, data);
+            EXPECT_LE(samples.size(),
+                      HapticRenderer::samplesForMs(renderer.heDurationMs(1, 0, data)))
+                    << "f0 " << f0;
+        }
+    }
+}
+
+TEST(HapticRendererTest, ConstantLength) {
+    HapticRenderer renderer{RenderParams()};
+    EXPECT_EQ(renderer.renderConstant(300, 255).size(), HapticRenderer::samplesForMs(300));
+    EXPECT_TRUE(renderer.renderConstant(0, 255).empty());
+}
+
+TEST(HapticRendererTest, Deterministic) {
+    HapticRenderer renderer{RenderParams()};
+    EXPECT_EQ(renderer.renderHe(2, 5, 200, 60, kContinuous),
+              renderer.renderHe(2, 5, 200, 60, kContinuous));
+    EXPECT_EQ(renderer.renderEnvelope({0, 0, 50, 50, 100, 50, 100, 0, 50}, false),
+              renderer.renderEnvelope({0, 0, 50, 50, 100, 50, 100, 0, 50}, false));
+}
+
+TEST(HapticRendererTest, ScaleAttenuates) {
+    RenderParams half;
+    half.dynamicScale = 50;
+    auto full = HapticRenderer(RenderParams()).renderConstant(100, 255);
+    auto scaled = HapticRenderer(half).renderConstant(100, 255);
+    ASSERT_EQ(full.size(), scaled.size());
+
+    auto peak = [](const std::vector<Sample>& samples) {
+        int32_t max = 0;
+        for (Sample sample : samples) max = std::max<int32_t>(max, std::abs(sample));
+        return max;
+    };
+    EXPECT_LT(peak(scaled), peak(full));
+    EXPECT_GT(peak(scaled), 0);
+}
+
+} // namespace
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/vendor/aac/hardware/richtap/vibrator/BnRichtapCallback.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+// Keeps every value the vibrator reports
+class RecordingCallback : public BnRichtapCallback {
+  public:
+    ndk::ScopedAStatus onCallback(int32_t value) override {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mValues.push_back(value);
+        }
+        mCv.notify_all();
+        return ndk::ScopedAStatus::ok();
+    }
+
+    // Waits until a callback reported at least value
+    bool waitFor(int32_t value, std::chrono::milliseconds timeout = std::chrono::seconds(2)) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCv.wait_for(lock, timeout,
+                            [&] { return !mValues.empty() && mValues.back() >= value; });
+    }
+
+    std::vector<int32_t> values() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mValues;
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mCv;
+    std::vector<int32_t> mValues;
+};
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "HapticOutput.h"
+#include "RecordingCallback.h"
+#include "RichtapVibrator.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+
+class RichtapVibratorTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        auto output = std::make_unique<MemoryOutput>();
+        mOutput = output.get();
+        mVibrator = ndk::SharedRefBase::make<RichtapVibrator>(std::move(output),
+                                                              std::chrono::milliseconds(0));
+        mCallback = ndk::SharedRefBase::make<RecordingCallback>();
+    }
+
+    // Owned by mVibrator
+    MemoryOutput* mOutput;
+    std::shared_ptr<RichtapVibrator> mVibrator;
+    std::shared_ptr<RecordingCallback> mCallback;
+    HapticRenderer mRenderer{RenderParams()};
+};
+
+bool endsWith(const std::vector<Sample>& samples, const std::vector<Sample>& tail) {
+    return samples.size() >= tail.size() &&
+           std::equal(tail.begin(), tail.end(), samples.end() - tail.size());
+}
+
+TEST_F(RichtapVibratorTest, OnPlaysTheRenderedWaveform) {
+    ASSERT_TRUE(mVibrator->on(300, mCallback).isOk());
+    ASSERT_TRUE(mCallback->waitFor(1));
+    EXPECT_EQ(mOutput->samples(), mRenderer.renderConstant(300, 255));
+}
+
+TEST_F(RichtapVibratorTest, PerformHeMatchesTheRenderer) {
+    const std::vector<int32_t> he = {HapticRenderer::kHeContinuous, 0, 200, 80, 50, 0};
+    auto expected = mRenderer.renderHe(1, 0, 255, 50, he);
+
+    // The second one comes from the cache
+    for (int32_t seq : {1, 2}) {
+        ASSERT_TRUE(mVibrator->performHe(1, 0, 255, 50, he, mCallback).isOk());
+        ASSERT_TRUE(mCallback->waitFor(seq));
+        EXPECT_TRUE(endsWith(mOutput->samples(), expected));
+    }
+}
+
+TEST_F(RichtapVibratorTest, PerformReportsTheDuration) {
+    int32_t durationMs = 0;
+    ASSERT_TRUE(mVibrator->perform(0 /* CLICK */, 1, mCallback, &durationMs).isOk());
+    EXPECT_GT(durationMs, 0);
+    ASSERT_TRUE(mCallback->waitFor(1));
+    EXPECT_EQ(mOutput->samples(), mRenderer.renderEffect(0));
+
+    EXPECT_FALSE(mVibrator->perform(77, 1, mCallback, &durationMs).isOk());
+    EXPECT_EQ(durationMs, -1);
+}
+
+TEST_F(RichtapVibratorTest, TuningApplies) {
+    ASSERT_TRUE(mVibrator->setF0(2000, nullptr).isOk());
+    ASSERT_TRUE(mVibrator->setDynamicScale(50, nullptr).isOk());
+    ASSERT_TRUE(mVibrator->on(100, mCallback).isOk());
+    ASSERT_TRUE(mCallback->waitFor(1));
+
+    RenderParams params;
+    params.f0 = 2000;
+    params.dynamicScale = 50;
+    EXPECT_EQ(mOutput->samples(), HapticRenderer(params).renderConstant(100, 255));
+}
+
+TEST_F(RichtapVibratorTest, RejectsInvalidInput) {
+    EXPECT_FALSE(mVibrator->on(HapticRenderer::kMaxDurationMs + 1, mCallback).isOk());
+    EXPECT_FALSE(mVibrator->setF0(HapticRenderer::kMaxF0 + 1, nullptr).isOk());
+    EXPECT_FALSE(mVibrator->performEnvelope({50, 100, 50, 0, 0, 50}, false, mCallback).isOk());
+    EXPECT_FALSE(mVibrator->performHe(1, 0, 255, 50, {1, 0, 100}, mCallback).isOk());
+    EXPECT_FALSE(mVibrator->performHeParam(HapticRenderer::kMaxDurationMs + 1, 100, 50,
+                                           mCallback).isOk());
+}
+
+TEST_F(RichtapVibratorTest, StopDropsThePlayback) {
+    ASSERT_TRUE(mVibrator->on(HapticRenderer::kMaxDurationMs, mCallback).isOk());
+    ASSERT_TRUE(mVibrator->stop(nullptr).isOk());
+    // The callback still fires, the request is over
+    ASSERT_TRUE(mCallback->waitFor(1));
+    EXPECT_LT(mOutput->samples().size(),
+              HapticRenderer::samplesForMs(HapticRenderer::kMaxDurationMs));
+}
+
+} // namespace
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl
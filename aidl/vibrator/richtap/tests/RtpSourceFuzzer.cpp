@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "RtpSource.h"
+
+using ::aidl::vendor::aac::hardware::richtap::vibrator::RtpSource;
+using ::aidl::vendor::aac::hardware::richtap::vibrator::Sample;
+using ::android::base::unique_fd;
+
+// Plays arbitrary files through the mapped path, where the whole header is parsed
+// up front against the size of the file
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    unique_fd fd(memfd_create("rtp", MFD_ALLOW_SEALING));
+    if (fd.get() < 0 || write(fd.get(), data, size) != static_cast<ssize_t>(size)) return 0;
+    fcntl(fd.get(), F_ADD_SEALS, F_SEAL_SHRINK);
+    lseek(fd.get(), 0, SEEK_SET);
+
+    auto source = RtpSource::open(fd.get());
+    // Empty files aren't mapped, streaming plays silence until the reader is done
+    if (!source || !source->mapped()) return 0;
+    Sample buffer[256];
+    size_t total = 0, count;
+    while ((count = source->read(buffer, 256)) > 0) {
+        total += count;
+        // A source never plays more samples than the file holds
+        if (total > size) abort();
+    }
+    return 0;
+}
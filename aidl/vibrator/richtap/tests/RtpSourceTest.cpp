@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2024 Paranoid Android
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "RtpSource.h"
+
+namespace aidl {
+namespace vendor {
+namespace aac {
+namespace hardware {
+namespace richtap {
+namespace vibrator {
+
+namespace {
+
+using ::android::base::unique_fd;
+
+constexpr uint8_t kWavSample = 200;
+// kWavSample once converted from unsigned 8 bit
+constexpr Sample kSample = kWavSample - 128;
+
+// An 8 bit mono WAV header announcing dataSize bytes of samples
+std::vector<uint8_t> wavHeader(uint32_t dataSize) {
+    std::vector<uint8_t> header;
+    auto put32 = [&](uint32_t value) {
+        for (int i = 0; i < 4; i++) header.push_back(value >> (8 * i));
+    };
+    auto put16 = [&](uint16_t value) {
+        header.push_back(value);
+        header.push_back(value >> 8);
+    };
+    header.insert(header.end(), {'R', 'I', 'F', 'F'});
+    put32(0);
+    header.insert(header.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    put32(16);
+    put16(1 /* PCM */);
+    put16(1);
+    put32(kSampleRate);
+    put32(kSampleRate);
+    put16(1);
+    put16(8);
+    header.insert(header.end(), {'d', 'a', 't', 'a'});
+    put32(dataSize);
+    return header;
+}
+
+// The header, dataSize samples and a trailer that must not be played
+std::vector<uint8_t> wav(uint32_t dataSize, size_t trailer = 0) {
+    auto file = wavHeader(dataSize);
+    file.insert(file.end(), dataSize, kWavSample);
+    file.insert(file.end(), trailer, 'X');
+    return file;
+}
+
+bool writeAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(write(fd, data, size));
+        if (written <= 0) return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// An unlinked regular file, which the source streams
+unique_fd tempFile() {
+    FILE* file = tmpfile();
+    unique_fd fd(dup(fileno(file)));
+    fclose(file);
+    return fd;
+}
+
+unique_fd streamedFile(const std::vector<uint8_t>& data) {
+    unique_fd fd = tempFile();
+    writeAll(fd.get(), data.data(), data.size());
+    lseek(fd.get(), 0, SEEK_SET);
+    return fd;
+}
+
+// A memfd sealed against shrinking, which the source maps
+unique_fd sealedFile(const std::vector<uint8_t>& data) {
+    unique_fd fd(memfd_create("rtp", MFD_ALLOW_SEALING));
+    writeAll(fd.get(), data.data(), data.size());
+    fcntl(fd.get(), F_ADD_SEALS, F_SEAL_SHRINK);
+    lseek(fd.get(), 0, SEEK_SET);
+    return fd;
+}
+
+// Plays the source to the end and returns how many samples it produced. Silence
+// from underruns while the reader catches up is not counted.
+size_t playAll(std::unique_ptr<RtpSource> source) {
+    Sample buffer[HapticPlayer::kBufferSamples];
+    size_t total = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (std::chrono::steady_clock::now() < deadline) {
+        size_t count = source->read(buffer, std::size(buffer));
+        if (count == 0) break;
+        size_t played = 0;
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_TRUE(buffer[i] == kSample || buffer[i] == 0) << static_cast<int>(buffer[i]);
+            played += buffer[i] == kSample;
+        }
+        if (played < count) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        total += played;
+    }
+    return total;
+}
+
+long maxRssKb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+TEST(RtpSourceTest, StreamsUpToTheEndOfTheDataChunk) {
+    auto source = RtpSource::open(streamedFile(wav(1000, 300)).get());
+    ASSERT_NE(source, nullptr);
+    EXPECT_FALSE(source->mapped());
+    EXPECT_EQ(playAll(std::move(source)), 1000);
+}
+
+TEST(RtpSourceTest, MapsSealedFiles) {
+    auto source = RtpSource::open(sealedFile(wav(1000, 300)).get());
+    ASSERT_NE(source, nullptr);
+    EXPECT_TRUE(source->mapped());
+    EXPECT_EQ(playAll(std::move(source)), 1000);
+}
+
+TEST(RtpSourceTest, StartsAtTheCurrentOffset) {
+    std::vector<uint8_t> data(100, 'P');
+    auto file = wav(1000);
+    data.insert(data.end(), file.begin(), file.end());
+    auto fd = sealedFile(data);
+    lseek(fd.get(), 100, SEEK_SET);
+
+    auto source = RtpSource::open(fd.get());
+    ASSERT_NE(source, nullptr);
+    EXPECT_TRUE(source->mapped());
+    EXPECT_EQ(playAll(std::move(source)), 1000);
+}
+
+TEST(RtpSourceTest, RejectsAnInvalidMappedHeader) {
+    auto file = wav(1000);
+    // 16 bit samples
+    file[34] = 16;
+    EXPECT_EQ(RtpSource::open(sealedFile(file).get()), nullptr);
+}
+
+TEST(RtpSourceTest, HeaderSplitAcrossShortWrites) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    unique_fd readEnd(fds[0]), writeEnd(fds[1]);
+
+    // Opening an empty pipe must not wait for the header
+    auto start = std::chrono::steady_clock::now();
+    auto source = RtpSource::open(readEnd.get());
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+    ASSERT_NE(source, nullptr);
+
+    auto file = wav(1000, 300);
+    std::thread writer([&] {
+        for (size_t i = 0; i < file.size(); i += 5) {
+            writeAll(writeEnd.get(), file.data() + i, std::min<size_t>(5, file.size() - i));
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        writeEnd.reset();
+    });
+    EXPECT_EQ(playAll(std::move(source)), 1000);
+    writer.join();
+}
+
+TEST(RtpSourceTest, DestroyedWhileThePipeIsIdle) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    unique_fd readEnd(fds[0]), writeEnd(fds[1]);
+
+    auto source = RtpSource::open(readEnd.get());
+    ASSERT_NE(source, nullptr);
+    Sample buffer[16];
+    source->read(buffer, std::size(buffer));
+    auto start = std::chrono::steady_clock::now();
+    source.reset();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+}
+
+// Start latency and peak RSS for a multi-megabyte file, streamed and mapped: the
+// first samples come out after one chunk and the file is never held in memory.
+TEST(RtpSourceTest, LargeFileStartsFastWithoutGrowingRss) {
+    constexpr uint32_t kDataSize = 16 << 20;
+    constexpr long kMaxRssGrowthKb = 1024;
+
+    for (bool sealed : {false, true}) {
+        unique_fd fd = sealed ? unique_fd(memfd_create("rtp", MFD_ALLOW_SEALING)) : tempFile();
+        auto header = wavHeader(kDataSize);
+        ASSERT_TRUE(writeAll(fd.get(), header.data(), header.size()));
+        // Written piecewise so the test itself doesn't touch kDataSize of memory
+        std::vector<uint8_t> block(64 * 1024, kWavSample);
+        for (uint32_t written = 0; written < kDataSize; written += block.size()) {
+            ASSERT_TRUE(writeAll(fd.get(), block.data(), block.size()));
+        }
+        if (sealed) fcntl(fd.get(), F_ADD_SEALS, F_SEAL_SHRINK);
+        lseek(fd.get(), 0, SEEK_SET);
+
+        long rssBefore = maxRssKb();
+        auto start = std::chrono::steady_clock::now();
+        auto source = RtpSource::open(fd.get());
+        ASSERT_NE(source, nullptr);
+        EXPECT_EQ(source->mapped(), sealed);
+
+        Sample buffer[HapticPlayer::kBufferSamples];
+        size_t count;
+        while ((count = source->read(buffer, std::size(buffer))) > 0 && buffer[0] != kSample) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        auto latency = std::chrono::steady_clock::now() - start;
+        ASSERT_GT(count, 0);
+
+        // Plays a second worth on top of the start
+        for (size_t played = 0; played < kSampleRate && count > 0; played += count) {
+            count = source->read(buffer, std::size(buffer));
+        }
+        long rssGrowth = maxRssKb() - rssBefore;
+        RecordProperty(sealed ? "mapped_start_us" : "streamed_start_us",
+                       std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+        RecordProperty(sealed ? "mapped_rss_growth_kb" : "streamed_rss_growth_kb", rssGrowth);
+        EXPECT_LT(latency, std::chrono::milliseconds(50)) << (sealed ? "mapped" : "streamed");
+        EXPECT_LT(rssGrowth, kMaxRssGrowthKb) << (sealed ? "mapped" : "streamed");
+    }
+}
+
+} // namespace
+
+} // namespace vibrator
+} // namespace richtap
+} // namespace hardware
+} // namespace aac
+} // namespace vendor
+} // namespace aidl